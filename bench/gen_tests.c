@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+// Generate a registry of tests to benchmark the framework itself
+//
+// Usage: gen_tests <count> <trivial|tiny|mixed> <directory>
+//
+// Writes <directory>/tests_<k>.c with TESTS_PER_FILE tests each, in
+// suites of TESTS_PER_SUITE tests named suite_<s>.test_<i>. The cost
+// of a test is:
+//  - trivial: returns immediately
+//  - tiny: a loop of TINY_LOOP iterations
+//  - mixed: mostly trivial, one test in 10 tiny and one in 1000 a
+//    loop of HEAVY_LOOP iterations
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TESTS_PER_FILE  10000
+#define TESTS_PER_SUITE 100
+#define TINY_LOOP       100
+#define HEAVY_LOOP      100000
+
+static long loop_of(const char *cost, long index)
+{
+  if (strcmp(cost, "tiny") == 0)
+    return TINY_LOOP;
+  if (strcmp(cost, "mixed") == 0)
+  {
+    if (index % 1000 == 0)
+      return HEAVY_LOOP;
+    if (index % 10 == 0)
+      return TINY_LOOP;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc != 4)
+  {
+    fprintf(stderr, "Usage: %s <count> <trivial|tiny|mixed> <directory>\n",
+            argv[0]);
+    return 1;
+  }
+  long count = atol(argv[1]);
+  const char *cost = argv[2];
+  if (count <= 0
+      || (strcmp(cost, "trivial") != 0 && strcmp(cost, "tiny") != 0
+          && strcmp(cost, "mixed") != 0))
+  {
+    fprintf(stderr, "Error: Invalid count %s or cost %s\n", argv[1], cost);
+    return 1;
+  }
+
+  char path[4096];
+  FILE *file = NULL;
+  for (long i = 0; i < count; ++i)
+  {
+    if (i % TESTS_PER_FILE == 0)
+    {
+      if (file != NULL)
+        fclose(file);
+      snprintf(path, sizeof(path), "%s/tests_%ld.c", argv[3],
+               i / TESTS_PER_FILE);
+      file = fopen(path, "w");
+      if (file == NULL)
+      {
+        perror(path);
+        return 1;
+      }
+      fprintf(file, "// Generated by gen_tests, do not edit\n\n");
+      fprintf(file, "#include \"micro-tests.h\"\n\n");
+      fprintf(file, "static volatile long sink;\n\n");
+    }
+
+    long loop = loop_of(cost, i);
+    fprintf(file, "TEST(suite_%ld, test_%ld)\n{\n", i / TESTS_PER_SUITE, i);
+    if (loop > 0)
+      fprintf(file, "  for (long i = 0; i < %ld; ++i)\n    sink += i;\n", loop);
+    fprintf(file, "  TEST_SUCCESS;\n}\n\n");
+  }
+  if (file != NULL && fclose(file) != 0)
+  {
+    perror(path);
+    return 1;
+  }
+  return 0;
+}
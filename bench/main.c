@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+// Runner of the generated tests, see gen_tests.c
+
+#define MICRO_TESTS_MULTITHREADED
+#define MICRO_TESTS_IMPLEMENTATION
+#include "micro-tests.h"
+
+MICRO_TESTS_MAIN
@@ -0,0 +1,86 @@
+#!/bin/sh
+# SPDX-License-Identifier: MIT
+# Author:  Giovanni Santini
+# Mail:    giovanni.santini@proton.me
+# License: MIT
+
+#
+# Benchmark the framework on generated registries of tests
+#
+# Usage: run.sh <build-dir> "<sizes>" "<costs>" "<threads>"
+#
+# For each size and cost, builds a binary with gen_tests and reports
+# the best of REPEAT runs of:
+#  - startup: running with a filter that selects no test
+#  - list: --list
+#  - filter: running a single test selected by name
+#  - dispatch: running all the tests, at each thread count
+#
+
+set -e
+
+BUILD_DIR=$1
+SIZES=$2
+COSTS=$3
+THREADS=$4
+REPEAT=${REPEAT:-3}
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--std=c99}
+BENCH_DIR=$(dirname "$0")
+ROOT_DIR=$BENCH_DIR/..
+
+now() {
+  date +%s%N
+}
+
+# Best wall time in seconds of REPEAT runs of a command
+best() {
+  best_ns=
+  for _ in $(seq "$REPEAT"); do
+    start=$(now)
+    "$@" > /dev/null
+    elapsed=$(( $(now) - start ))
+    if [ -z "$best_ns" ] || [ "$elapsed" -lt "$best_ns" ]; then
+      best_ns=$elapsed
+    fi
+  done
+  awk "BEGIN { printf \"%.4f\", $best_ns / 1e9 }"
+}
+
+mkdir -p "$BUILD_DIR"
+"$CC" -O2 -std=c99 "$BENCH_DIR/gen_tests.c" -o "$BUILD_DIR/gen_tests"
+
+printf "%-8s %-8s %-9s %-9s %-9s %-8s %s\n" \
+       tests cost startup list filter threads dispatch
+for size in $SIZES; do
+  for cost in $COSTS; do
+    dir=$BUILD_DIR/${cost}_$size
+    if [ ! -x "$dir/tests" ]; then
+      rm -rf "$dir"
+      mkdir -p "$dir"
+      "$BUILD_DIR/gen_tests" "$size" "$cost" "$dir"
+      for source in "$BENCH_DIR/main.c" "$dir"/tests_*.c; do
+        "$CC" $CFLAGS -I"$ROOT_DIR" -c "$source" \
+              -o "$dir/$(basename "$source" .c).o"
+      done
+      "$CC" -Wl,-T,"$ROOT_DIR/micro-tests.ld" "$dir"/*.o -lpthread \
+            -o "$dir/tests"
+    fi
+
+    startup=$(best "$dir/tests" --no-banner --quiet --test none)
+    list=$(best "$dir/tests" --list)
+    filter=$(best "$dir/tests" --no-banner --quiet --test "test_$((size / 2))")
+    for threads in $THREADS; do
+      if [ "$threads" -eq 1 ]; then
+        seconds=$(best "$dir/tests" --no-banner --quiet)
+      else
+        seconds=$(best "$dir/tests" --no-banner --quiet --multithreaded \
+                       --threads "$threads")
+      fi
+      throughput=$(awk "BEGIN { if ($seconds > 0) \
+        printf \"%.3f Mtests/s\", $size / $seconds / 1e6; else printf \"-\" }")
+      printf "%-8s %-8s %-9s %-9s %-9s %-8s %s\n" "$size" "$cost" \
+             "${startup}s" "${list}s" "${filter}s" "$threads" "$throughput"
+    done
+  done
+done
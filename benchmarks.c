@@ -0,0 +1,169 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+#include "micro-tests.h"
+
+#define MAX_SIZE (1 << 14)
+
+static int sorted[MAX_SIZE];
+
+static void fill_sorted(void)
+{
+  for (int i = 0; i < MAX_SIZE; ++i)
+    sorted[i] = 2 * i;
+}
+
+BENCHMARK(bench_examples, sum_of_two)
+{
+  int a = 1, b = 2;
+  for (uint64_t i = 0; i < bench->iterations; ++i)
+  {
+    MICRO_TESTS_DO_NOT_OPTIMIZE(a);
+    MICRO_TESTS_DO_NOT_OPTIMIZE(a + b);
+  }
+}
+
+BENCHMARK_COMPLEXITY(bench_examples, linear_search, 256, MAX_SIZE, 2,
+                     MICRO_TESTS_O_N)
+{
+  fill_sorted();
+  int key = 2 * ((int)bench->n - 1);
+  for (uint64_t i = 0; i < bench->iterations; ++i)
+  {
+    MICRO_TESTS_DO_NOT_OPTIMIZE(key);
+    size_t j = 0;
+    while (j < bench->n && sorted[j] != key)
+      j++;
+    MICRO_TESTS_DO_NOT_OPTIMIZE(j);
+  }
+}
+
+BENCHMARK_COMPLEXITY(bench_examples, binary_search, 256, MAX_SIZE, 2,
+                     MICRO_TESTS_O_LOG_N)
+{
+  fill_sorted();
+  int key = 1;
+  for (uint64_t i = 0; i < bench->iterations; ++i)
+  {
+    MICRO_TESTS_DO_NOT_OPTIMIZE(key);
+    size_t lo = 0, hi = bench->n;
+    while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (sorted[mid] < key)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    MICRO_TESTS_DO_NOT_OPTIMIZE(lo);
+  }
+}
+
+BENCHMARK_RANGE(bench_examples, checksum, 1 << 10, 1 << 16, 8)
+{
+  static unsigned char block[1 << 16];
+  bench->bytes = bench->n;
+  for (uint64_t i = 0; i < bench->iterations; ++i)
+  {
+    uint32_t sum = 0;
+    MICRO_TESTS_DO_NOT_OPTIMIZE(block);
+    for (size_t j = 0; j < bench->n; ++j)
+      sum = sum * 31 + block[j];
+    MICRO_TESTS_DO_NOT_OPTIMIZE(sum);
+  }
+}
+
+static uint64_t shared_counter;
+
+BENCHMARK_THREADS(bench_examples, atomic_increment, "1,2,4")
+{
+  uint64_t local = 0;
+  bench->items = 1;
+  for (uint64_t i = 0; i < bench->iterations; ++i)
+  {
+    __atomic_fetch_add(&shared_counter, 1, __ATOMIC_RELAXED);
+    local++;
+  }
+  MICRO_TESTS_DO_NOT_OPTIMIZE(local);
+}
+
+BENCHMARK_AB(bench_examples, count_bits)
+{
+  uint64_t value = 0x123456789abcdefULL;
+  for (uint64_t i = 0; i < bench->iterations; ++i)
+  {
+    MICRO_TESTS_DO_NOT_OPTIMIZE(value);
+    int bits = 0;
+    if (bench->variant == 0)
+    {
+      for (uint64_t v = value; v != 0; v >>= 1)
+        bits += (int)(v & 1);
+    } else {
+      for (uint64_t v = value; v != 0; v &= v - 1)
+        bits++;
+    }
+    MICRO_TESTS_DO_NOT_OPTIMIZE(bits);
+  }
+}
+
+#define SORT_SIZE 256
+#define SORT_BATCH 32
+
+static int unsorted[SORT_BATCH][SORT_SIZE];
+
+static void fill_unsorted(MicroTestsBench *bench, uint64_t count)
+{
+  (void) bench;
+  static uint32_t seed = 1;
+  for (uint64_t b = 0; b < count; ++b)
+    for (int i = 0; i < SORT_SIZE; ++i)
+    {
+      seed = seed * 1103515245 + 12345;
+      unsorted[b][i] = (int)(seed >> 16);
+    }
+}
+
+static void insertion_sort(int *array, int size)
+{
+  for (int i = 1; i < size; ++i)
+  {
+    int value = array[i];
+    int j = i;
+    for (; j > 0 && array[j - 1] > value; --j)
+      array[j] = array[j - 1];
+    array[j] = value;
+  }
+}
+
+BENCHMARK_BATCHED(bench_examples, insertion_sort, fill_unsorted, SORT_BATCH)
+{
+  for (uint64_t i = 0; i < bench->iterations; ++i)
+  {
+    insertion_sort(unsorted[i], SORT_SIZE);
+    MICRO_TESTS_DO_NOT_OPTIMIZE(unsorted[i]);
+  }
+}
+
+BENCHMARK(bench_examples, insertion_sort_paused)
+{
+  for (uint64_t i = 0; i < bench->iterations; ++i)
+  {
+    PAUSE_TIMING();
+    fill_unsorted(bench, 1);
+    RESUME_TIMING();
+    insertion_sort(unsorted[0], SORT_SIZE);
+    MICRO_TESTS_DO_NOT_OPTIMIZE(unsorted[0]);
+  }
+}
+
+BENCHMARK(bench_examples, malloc_free)
+{
+  for (uint64_t i = 0; i < bench->iterations; ++i)
+  {
+    char *buffer = malloc(64);
+    MICRO_TESTS_DO_NOT_OPTIMIZE(buffer);
+    free(buffer);
+  }
+}
@@ -21,12 +21,27 @@
 // - Automatic test registration — no boilerplate needed.
 // - Organize tests into suites for cleaner structure.
 // - Optional multithreaded execution to speed up large test sets.
+// - Optional process isolation, a crashing test does not stop the run.
+// - Optional analysis of the tests that write global state.
+// - Exclusive resources and serial tests for partially parallel runs.
+// - Dependencies between tests, scheduled critical path first.
+// - Parallel loops and tasks inside tests, on the threads of the runner.
+// - Optional benchmarks over input size ranges, fitted to a complexity class.
+// - Optional sampling profiler writing the folded stacks of each test.
+// - Test manifest embedded in the executable, listed without running it.
+// - Optional test plugins, shared libraries of tests loaded into one runner.
+// - Optional orchestrator running batches of several executables.
+// - Optional distributed runs, a coordinator and workers over TCP.
+// - Optional cache skipping the tests that passed with the same build.
+// - Optional capture of the output of the tests, shown when they fail.
 // - Command-line controls:
 //   - Run a specific suite or test
 //   - List available tests
 //   - Enable Multithreading
 //   - Number of threads
+//   - Adaptive number of threads, within the cgroup CPU quota
 //   - Output settings
+// - Pluggable reporters: console, TAP version 14, JUnit XML and JSON.
 //
 // Usage
 // -----
@@ -70,6 +85,175 @@
 //
 // A test should terminate with either TEST_SUCCESS or TEST_FAILED.
 //
+// With --multithreaded, a test that needs a resource for itself can
+// name it, and a test that can not share the process with any other
+// test can be marked serial. The other tests keep running in parallel.
+//
+// ```
+// TEST_RESOURCES(suite_name, uses_port, "port,tmp_file")
+// {
+//   TEST_SUCCESS;
+// }
+//
+// TEST_SERIAL(suite_name, changes_singleton)
+// {
+//   TEST_SUCCESS;
+// }
+// ```
+//
+// A test can also run after other tests, it is skipped if one of them
+// fails or is unknown. Selecting a test also runs its prerequisites.
+// With --durations, the tests on the longest chain of prerequisites
+// start first. With --isolated each test runs in its own process, so
+// a test passes state to the tests after it in a file or in memory
+// mapped MAP_SHARED before the run, not in a global.
+//
+// ```
+// TEST_AFTER(suite_name, uses_cache, "populates_cache,other_suite.test")
+// {
+//   TEST_SUCCESS;
+// }
+// ```
+//
+// TEST_WITH combines these options, which are also the tags of the
+// test in the manifest.
+//
+// ```
+// TEST_WITH(suite_name, serial_user, MICRO_TESTS_SERIAL,
+//           MICRO_TESTS_AFTER("uses_cache"))
+// {
+//   TEST_SUCCESS;
+// }
+// ```
+//
+// Inside a test, MICRO_PARALLEL_FOR splits a loop among the threads
+// of --multithreaded that are waiting for work, and MICRO_TASK_SPAWN
+// starts tasks on them. The run never uses more than --threads
+// threads, without them everything runs on the calling thread.
+//
+// ```
+// static void square(size_t i, void *ctx) { ((int*)ctx)[i] *= ((int*)ctx)[i]; }
+//
+// TEST(suite_name, parallel)
+// {
+//   MICRO_PARALLEL_FOR(0, 1024, square, array);
+//   MicroTestsTaskGroup group = {0};
+//   MICRO_TASK_SPAWN(&group, task, arg);
+//   MICRO_TASK_WAIT(&group);
+//   TEST_SUCCESS;
+// }
+// ```
+//
+// With MICRO_TESTS_BENCHMARK defined, --bench runs the benchmarks
+// instead of the tests. The body runs the measured code
+// bench->iterations times, at each input size bench->n of the range.
+// With three sizes or more, the timings are fitted to a constant plus
+// O(1), O(log n), O(n), O(n log n) or O(n^2), without the smallest
+// size from five sizes on. The benchmark fails if it fits a worse
+// class than the expected one, or than the one in --baseline, and
+// that class fits clearly worse, see MICRO_TESTS_BENCH_FIT_MARGIN.
+// The body can set bench->bytes and bench->items processed by an
+// iteration to also report GB/s and Mitems/s.
+// With MICRO_TESTS_MULTITHREADED, BENCHMARK_THREADS runs the body on
+// each thread count of a list, started together and pinned to the
+// CPUs, and reports the speedup and efficiency over the first count.
+// BENCHMARK_AB compares two variants of the body, given by
+// bench->variant, in randomized interleaved rounds and reports the
+// speedup of the second one with its 95% confidence interval.
+// Before the benchmarks, the CPU governor, turbo boost, SMT, online
+// CPUs, load average and ASLR are inspected and recorded. A noisy
+// environment is reported with warnings, and --save-baseline refuses
+// to save from it without --force if the governor, the boost or the
+// load are the cause. Active SMT and ASLR are only warnings.
+// On x86-64 with an invariant TSC, the benchmarks are timed with
+// rdtsc and rdtscp, calibrated against CLOCK_MONOTONIC, and the
+// overhead of the timer is subtracted.
+// Each input size is measured until the 95% confidence interval of
+// the median is within MICRO_TESTS_BENCH_PRECISION, or for at most
+// MICRO_TESTS_BENCH_MAX_TIME_MS, and the precision is reported.
+// The measurements start once the last MICRO_TESTS_BENCH_WARMUP_WINDOW
+// ones have no significant trend, and the warmup time is reported.
+// PAUSE_TIMING() and RESUME_TIMING() leave the setup of an iteration
+// out of the timing. BENCHMARK_BATCHED prepares a batch of inputs
+// with an untimed setup function before timing the body on them.
+// With MICRO_TESTS_BENCH_ALLOCS, malloc, calloc, realloc, the aligned
+// allocations and free are counted in thread-local counters and the
+// allocations, bytes and frees per iteration are reported and saved in
+// the baseline.
+//
+// ```
+// BENCHMARK_COMPLEXITY(suite_name, search, 8, 1 << 20, 2, MICRO_TESTS_O_LOG_N)
+// {
+//   for (uint64_t i = 0; i < bench->iterations; ++i)
+//     MICRO_TESTS_DO_NOT_OPTIMIZE(search(array, bench->n, key));
+// }
+// ```
+//
+// Each test is also described in the .micro_tests_manifest section
+// of the executable, with its suite, name, location and tags, in
+// versioned records without pointers. --manifest <executable> and
+// micro_tests_manifest_read() list them from the mapped file without
+// running it, unless MICRO_TESTS_NO_MANIFEST is defined.
+//
+// With MICRO_TESTS_PLUGINS, tests can also be built as shared
+// libraries, linked with micro-tests.ld and without the
+// implementation, and loaded into one runner with --load <library>,
+// once per library. Their tests are merged with the ones of the
+// runner and scheduled together, see plugin_tests.c and
+// `make run-plugin`.
+//
+// With MICRO_TESTS_CAPTURE, --capture redirects stdout and stderr of
+// each test to a memfd, fully buffered, and prints it on stderr after
+// the FAILED line under the lock of the reporters, or discards it if
+// the test passed. The descriptors are shared by the threads, so
+// with --multithreaded it needs --isolated, where each test writes
+// to its memfd from its own process.
+//
+// With MICRO_TESTS_CACHE, --cache <dir> records the tests that
+// passed in a file of the directory named after a key. The key hashes
+// the NT_GNU_BUILD_ID notes of the executable and of the plugins with
+// the arguments, except --cache, --no-cache and the ones of the
+// output. The next runs with the same key skip those tests, but not
+// the prerequisites of the tests that run, and --no-cache runs them
+// again.
+//
+// With MICRO_TESTS_DISTRIBUTED, --coordinator <port> plans the tests
+// and hands them out in batches to the processes started with
+// --worker <host:port>, on the same executable, and reports their
+// outcomes. The messages are a 32 bit big endian size, a byte of type
+// and a payload. Without --durations the batches are sized by number
+// of tests, at least MICRO_TESTS_DISTRIBUTED_MIN_BATCHES. The serial
+// tests and the ones using resources are in batches that run while
+// no other batch runs. A worker runs each batch in a child process,
+// one test at a time, start several per host. A test that crashes it
+// fails and the rest of the batch is queued again. So are the tests
+// not reported by a worker that disconnects, or that does not report
+// for MICRO_TESTS_DISTRIBUTED_TIMEOUT_S, and TCP keepalive notices
+// the hosts that went down. After MICRO_TESTS_DISTRIBUTED_ATTEMPTS
+// lost workers without a result, the first of those tests fails. The
+// tests left fail if no worker connects for
+// MICRO_TESTS_DISTRIBUTED_CONNECT_S once all are lost.
+// `make run-distributed` runs the coordinator and two workers on
+// loopback.
+//
+// With MICRO_TESTS_ORCHESTRATOR, --orchestrate <executable>, once
+// per executable, reads their manifests and runs their tests in
+// batches of child processes with --test-file and the TAP reporter,
+// at most --jobs at a time. The batches are sized from --durations,
+// or by number of tests without it, at least
+// MICRO_TESTS_ORCHESTRATOR_BATCHES_PER_JOB per job, are started
+// longest first from one queue, keep the tests linked by
+// TEST_AFTER together and run the serial ones alone. The TAP
+// reporter prints "# running suite.test" before each test. The test
+// that was running when a batch crashed fails, and the tests after
+// it are queued again. The files of the batches are in $TMPDIR.
+//
+// With MICRO_TESTS_PROFILE, --profile samples the CPU time of each
+// test with a SIGPROF timer of its thread, walks the frame pointers
+// up to the test function and saves the stacks in the folded format
+// of flamegraph tools, as "suite.test;outer;...;inner count". Compile
+// with -fno-omit-frame-pointer for complete stacks.
+//
 // To run the tests, you need to either call micro_tests_run(argc,
 // arv), or use the MICRO_TESTS_MAIN macro. The return value will be
 // the number of failed tests (0 on success).
@@ -92,10 +276,30 @@
 //
 //  --help,-h             show help message
 //  --list                list tests
+//  --manifest <file>     list the tests of an executable without running it
+//  --load <library>      also run the tests of a shared library
+//  --coordinator <port>  hand out batches of the tests to the workers
+//  --worker <host:port>  run the batches of a coordinator
+//  --orchestrate <file>  run the tests of another executable in batches
+//  --jobs <n>            batches running at the same time (use with --orchestrate)
 //  --suite <suite-name>  run a specific suite
 //  --test  <test-name>   run a specific test
+//  --durations <file>    schedule with and update the recorded durations
+//  --test-file <file>    run the "suite.test" tests listed in a file
+//  --reporter <name>     output format: console, tap, junit or json
 //  --multithreaded       run tests on multiple threads
 //  --threads <n>         specify the number n of threads (use with --multithreaded)
+//  --threads auto        adapt the number of threads to the load of the tests
+//  --isolated            run each test in its own process
+//  --check-globals       report the tests that write global state
+//  --bench               run the benchmarks instead of the tests
+//  --baseline <file>     compare the benchmarks with saved results
+//  --save-baseline <file> save the results of the benchmarks
+//  --force               save the baseline from a noisy environment
+//  --cache <dir>         skip the tests that passed with the same build
+//  --no-cache            run the tests that passed too (use with --cache)
+//  --capture             show the output of the tests only if they fail
+//  --profile <file>      save the folded stacks of the tests
 //  --no-banner           do not print the banner
 //  --debug               additional debug prints
 //  --quiet               do not print OK results
@@ -123,6 +327,12 @@
 #define MICRO_TESTS_MAJOR 0
 #define MICRO_TESTS_MINOR 1
 
+// The implementation uses POSIX and GNU extensions, this header should
+// be included before any other header in the implementation file
+#if defined(MICRO_TESTS_IMPLEMENTATION) && !defined(_GNU_SOURCE)
+  #define _GNU_SOURCE
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -130,6 +340,8 @@ extern "C" {
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 //
 // Configuration
@@ -150,22 +362,301 @@ extern "C" {
   #define MICRO_TESTS_MULTITHREADED
 #endif
 
-// Config: Allocator, used only for multithreaded execution
+// Config: Allocator, used for the bookkeeping of the runners
 //
 // Note: should behave like calloc(3)
-#ifdef MICRO_TESTS_MULTITHREADED
 #ifndef MICRO_TESTS_CALLOC
 #define MICRO_TESTS_CALLOC calloc
 #endif
-#endif
 
-// Config: Free allocated memory, used only for multithreaded execution
+// Config: Free allocated memory, used for the bookkeeping of the runners
 //
 // Note: should behave like free(3)
-#ifdef MICRO_TESTS_MULTITHREADED
 #ifndef MICRO_TESTS_FREE
 #define MICRO_TESTS_FREE free
 #endif
+
+// Config: Maximum number of threads of --threads auto
+#ifndef MICRO_TESTS_MAX_THREADS
+  #define MICRO_TESTS_MAX_THREADS 256
+#endif
+
+// Config: Milliseconds between two adjustments of --threads auto
+#ifndef MICRO_TESTS_ADAPT_INTERVAL_MS
+  #define MICRO_TESTS_ADAPT_INTERVAL_MS 50
+#endif
+
+// Config: Enable --load by defining MICRO_TESTS_PLUGINS
+//
+// Note: Disabled by default. The runner loads the tests of shared
+// libraries with dlopen and runs them with its own.
+#if 0
+  #define MICRO_TESTS_PLUGINS
+#endif
+
+// Config: Do not embed the manifest of the tests, nor compile
+//         --manifest and micro_tests_manifest_read, by defining
+//         MICRO_TESTS_NO_MANIFEST
+//
+// Note: By default each test also writes its suite, name, location
+// and tags in the .micro_tests_manifest section, read by --manifest
+// and micro_tests_manifest_read without running the executable.
+// MICRO_TESTS_ORCHESTRATOR needs the reader.
+#if 0
+  #define MICRO_TESTS_NO_MANIFEST
+#endif
+
+// Config: Enable --capture by defining MICRO_TESTS_CAPTURE
+//
+// Note: Disabled by default. The output of each test goes to a
+// memory file that is printed only if the test fails.
+#if 0
+  #define MICRO_TESTS_CAPTURE
+#endif
+
+// Config: Enable --cache by defining MICRO_TESTS_CACHE
+//
+// Note: Disabled by default. The tests that passed are recorded in a
+// directory under a key made of the build-ids of the executable and
+// of the plugins and of the arguments, and skipped while the key
+// stays the same.
+#if 0
+  #define MICRO_TESTS_CACHE
+#endif
+
+// Config: Enable --coordinator and --worker by defining
+//         MICRO_TESTS_DISTRIBUTED
+//
+// Note: Disabled by default. The coordinator hands out batches of
+// its tests to the workers connected over TCP, which run the same
+// executable on other hosts.
+#if 0
+  #define MICRO_TESTS_DISTRIBUTED
+#endif
+
+// Config: Estimated duration of a batch of --coordinator
+#ifndef MICRO_TESTS_DISTRIBUTED_BATCH_MS
+  #define MICRO_TESTS_DISTRIBUTED_BATCH_MS 200
+#endif
+
+// Config: Largest number of tests in a batch of --coordinator
+#ifndef MICRO_TESTS_DISTRIBUTED_BATCH_TESTS
+  #define MICRO_TESTS_DISTRIBUTED_BATCH_TESTS 32
+#endif
+
+// Config: Least number of batches of --coordinator when no test has
+//         a recorded duration, the batches are then sized by number
+//         of tests
+#ifndef MICRO_TESTS_DISTRIBUTED_MIN_BATCHES
+  #define MICRO_TESTS_DISTRIBUTED_MIN_BATCHES 64
+#endif
+
+// Config: Seconds a --worker may run a test of its batch without
+//         reporting, after which the coordinator drops it and queues
+//         its batch again
+#ifndef MICRO_TESTS_DISTRIBUTED_TIMEOUT_S
+  #define MICRO_TESTS_DISTRIBUTED_TIMEOUT_S 300
+#endif
+
+// Config: Seconds without traffic before the TCP keepalive probes of
+//         --coordinator and --worker, and between two probes
+#ifndef MICRO_TESTS_DISTRIBUTED_KEEPALIVE_S
+  #define MICRO_TESTS_DISTRIBUTED_KEEPALIVE_S 10
+#endif
+
+// Config: Times a batch is handed out without any of its tests
+//         reported before the first test that was not reported fails
+#ifndef MICRO_TESTS_DISTRIBUTED_ATTEMPTS
+  #define MICRO_TESTS_DISTRIBUTED_ATTEMPTS 2
+#endif
+
+// Config: Seconds a --worker retries to connect to the coordinator,
+//         and the coordinator waits for a worker once all are lost
+#ifndef MICRO_TESTS_DISTRIBUTED_CONNECT_S
+  #define MICRO_TESTS_DISTRIBUTED_CONNECT_S 10
+#endif
+
+// Config: Largest message between --coordinator and --worker
+#ifndef MICRO_TESTS_DISTRIBUTED_MAX_MESSAGE
+  #define MICRO_TESTS_DISTRIBUTED_MAX_MESSAGE (16 << 20)
+#endif
+
+// Config: Enable --orchestrate by defining MICRO_TESTS_ORCHESTRATOR
+//
+// Note: Disabled by default. The runner reads the manifests of other
+// test executables and runs batches of their tests in child
+// processes, with one queue for all of them.
+#if 0
+  #define MICRO_TESTS_ORCHESTRATOR
+#endif
+
+// Config: Batches of --orchestrate per job, more batches balance the
+//         jobs better but start more processes
+#ifndef MICRO_TESTS_ORCHESTRATOR_BATCHES_PER_JOB
+  #define MICRO_TESTS_ORCHESTRATOR_BATCHES_PER_JOB 4
+#endif
+
+// Config: Minimum estimated duration of a batch of --orchestrate, to
+//         amortize the start of its process
+#ifndef MICRO_TESTS_ORCHESTRATOR_MIN_BATCH_MS
+  #define MICRO_TESTS_ORCHESTRATOR_MIN_BATCH_MS 50
+#endif
+
+// Config: Enable --isolated runner by defining
+//         MICRO_TESTS_ISOLATION
+//
+// Note: Disabled by default. Each test runs in a forked process and
+// writes its result into a shared memory board, so a crashing test
+// does not take down the runner.
+#if 0
+  #define MICRO_TESTS_ISOLATION
+#endif
+
+// Config: Enable --check-globals by defining
+//         MICRO_TESTS_GLOBALS_CHECK
+//
+// Note: Disabled by default. The tests run one at a time and the
+// .data and .bss of the executable, without the state of the
+// framework, are compared before and after each test, to find the
+// tests that are not safe to run in parallel. Not with --isolated.
+// Needs the __data_start and _end symbols of the GNU toolchain.
+#if 0
+  #define MICRO_TESTS_GLOBALS_CHECK
+#endif
+
+// Config: Enable --bench by defining MICRO_TESTS_BENCHMARK
+//
+// Note: Disabled by default. The benchmarks are always registered,
+// this compiles in the runner that measures them.
+#if 0
+  #define MICRO_TESTS_BENCHMARK
+#endif
+
+// Config: Minimum duration of a measurement of a benchmark
+#ifndef MICRO_TESTS_BENCH_MIN_TIME_MS
+  #define MICRO_TESTS_BENCH_MIN_TIME_MS 10
+#endif
+
+// Config: Minimum number of measurements of each input size of a
+//         benchmark, the median is reported
+#ifndef MICRO_TESTS_BENCH_REPETITIONS
+  #define MICRO_TESTS_BENCH_REPETITIONS 10
+#endif
+
+// Config: Maximum number of measurements of each input size of a
+//         benchmark
+#ifndef MICRO_TESTS_BENCH_MAX_SAMPLES
+  #define MICRO_TESTS_BENCH_MAX_SAMPLES 256
+#endif
+
+// Config: Relative half width of the 95% confidence interval of the
+//         median at which the measurements of an input size stop
+#ifndef MICRO_TESTS_BENCH_PRECISION
+  #define MICRO_TESTS_BENCH_PRECISION 0.02
+#endif
+
+// Config: Factor by which the error of the expected complexity class
+//         must exceed the one of the best fit, plus 5%, for a
+//         benchmark to fail
+#ifndef MICRO_TESTS_BENCH_FIT_MARGIN
+  #define MICRO_TESTS_BENCH_FIT_MARGIN 1.5
+#endif
+
+// Config: Time after which the measurements of an input size stop,
+//         even if the precision was not reached
+#ifndef MICRO_TESTS_BENCH_MAX_TIME_MS
+  #define MICRO_TESTS_BENCH_MAX_TIME_MS 500
+#endif
+
+// Config: Number of consecutive measurements without a trend after
+//         which a benchmark is warmed up
+#ifndef MICRO_TESTS_BENCH_WARMUP_WINDOW
+  #define MICRO_TESTS_BENCH_WARMUP_WINDOW 8
+#endif
+
+// Config: Time after which the warmup of an input size stops, even
+//         if the measurements still have a trend
+#ifndef MICRO_TESTS_BENCH_MAX_WARMUP_MS
+  #define MICRO_TESTS_BENCH_MAX_WARMUP_MS 2000
+#endif
+
+// Config: Time the benchmarks with clock_gettime instead of the TSC
+//         by defining MICRO_TESTS_BENCH_NO_TSC
+//
+// Note: On x86-64 the benchmarks read the time stamp counter when the
+// CPU reports an invariant TSC, calibrated against CLOCK_MONOTONIC
+#if 0
+  #define MICRO_TESTS_BENCH_NO_TSC
+#endif
+
+// Config: Report the allocations of the benchmarks by defining
+//         MICRO_TESTS_BENCH_ALLOCS
+//
+// Note: Disabled by default. The implementation defines malloc,
+// calloc, realloc, memalign, aligned_alloc, posix_memalign and free,
+// counting each call in thread-local counters before forwarding it to
+// glibc. Without it nothing is
+// hooked. Needs MICRO_TESTS_BENCHMARK and the implementation in a
+// single file.
+#if 0
+  #define MICRO_TESTS_BENCH_ALLOCS
+#endif
+
+// Config: Number of interleaved rounds of BENCHMARK_AB
+#ifndef MICRO_TESTS_BENCH_AB_ROUNDS
+  #define MICRO_TESTS_BENCH_AB_ROUNDS 30
+#endif
+
+// Config: Enable --profile by defining MICRO_TESTS_PROFILE
+//
+// Note: Disabled by default. While a test runs, a timer on the CPU
+// time of its thread raises SIGPROF and the handler walks the frame
+// pointers of the test. Compile the tests with
+// -fno-omit-frame-pointer to get their full stacks.
+#if 0
+  #define MICRO_TESTS_PROFILE
+#endif
+
+// Config: Microseconds of CPU time between two samples of --profile
+#ifndef MICRO_TESTS_PROFILE_INTERVAL_US
+  #define MICRO_TESTS_PROFILE_INTERVAL_US 1000
+#endif
+
+// Config: Maximum number of samples of --profile, the following ones
+//         are dropped
+#ifndef MICRO_TESTS_PROFILE_MAX_SAMPLES
+  #define MICRO_TESTS_PROFILE_MAX_SAMPLES 16384
+#endif
+
+// Config: Maximum number of frames of a sample of --profile
+#ifndef MICRO_TESTS_PROFILE_MAX_DEPTH
+  #define MICRO_TESTS_PROFILE_MAX_DEPTH 32
+#endif
+
+// Config: Size of a cache line, used to pad shared results
+#ifndef MICRO_TESTS_CACHE_LINE
+  #define MICRO_TESTS_CACHE_LINE 64
+#endif
+
+// Config: Compile in a single reporter by defining one of
+//         MICRO_TESTS_REPORTER_CONSOLE, MICRO_TESTS_REPORTER_TAP,
+//         MICRO_TESTS_REPORTER_JUNIT or MICRO_TESTS_REPORTER_JSON
+//
+// Note: By default all the reporters are compiled in and selected at
+// run-time with --reporter. With a single reporter the calls to the
+// reporter compile down to direct function calls.
+#if 0
+  #define MICRO_TESTS_REPORTER_TAP
+#endif
+
+#if defined(MICRO_TESTS_REPORTER_CONSOLE)
+  #define _MICRO_TESTS_REPORTER console
+#elif defined(MICRO_TESTS_REPORTER_TAP)
+  #define _MICRO_TESTS_REPORTER tap
+#elif defined(MICRO_TESTS_REPORTER_JUNIT)
+  #define _MICRO_TESTS_REPORTER junit
+#elif defined(MICRO_TESTS_REPORTER_JSON)
+  #define _MICRO_TESTS_REPORTER json
 #endif
 
 //
@@ -220,6 +711,93 @@ extern "C" {
 //
 // Credits: Thanks to Sam P. (stackoverflow)
 #define TEST(__suite_name, __test_name)                        \
+  _MICRO_TESTS_TEST(__suite_name, __test_name, "", .flags = 0)
+
+// Register a test case that never runs in parallel with other tests
+//
+// Args:
+//  - arg1: suite name
+//  - arg2: test name
+#define TEST_SERIAL(__suite_name, __test_name)                 \
+  TEST_WITH(__suite_name, __test_name, MICRO_TESTS_SERIAL)
+
+// Register a test case that needs exclusive access to some resources
+//
+// Args:
+//  - arg1: suite name
+//  - arg2: test name
+//  - arg3: comma separated names of the resources, as a string
+//          literal
+//
+// Note: with --multithreaded, tests sharing a resource name never run
+// at the same time, the others still run in parallel
+#define TEST_RESOURCES(__suite_name, __test_name, __resources)  \
+  TEST_WITH(__suite_name, __test_name, MICRO_TESTS_RESOURCES(__resources))
+
+// Register a test case that runs after other tests
+//
+// Args:
+//  - arg1: suite name
+//  - arg2: test name
+//  - arg3: comma separated names of the prerequisites, as a string
+//          literal, either "suite.test" or "test" for a test in the
+//          same suite
+//
+// Note: the test is skipped if a prerequisite fails or is skipped
+#define TEST_AFTER(__suite_name, __test_name, __depends)       \
+  TEST_WITH(__suite_name, __test_name, MICRO_TESTS_AFTER(__depends))
+
+// Register a test case with several options
+//
+// Args:
+//  - arg1: suite name
+//  - arg2: test name
+//  - varargs: one to three of MICRO_TESTS_SERIAL,
+//             MICRO_TESTS_RESOURCES(...) and MICRO_TESTS_AFTER(...)
+//
+// Note: the options also make the tags of the test in the manifest,
+// separated by spaces
+#define TEST_WITH(__suite_name, __test_name, ...)              \
+  _MICRO_TESTS_TEST(__suite_name, __test_name,                 \
+    _MICRO_TESTS_CAT(_MICRO_TESTS_TAGS_, _MICRO_TESTS_COUNT(__VA_ARGS__)) \
+      (__VA_ARGS__),                                           \
+    _MICRO_TESTS_CAT(_MICRO_TESTS_INITS_, _MICRO_TESTS_COUNT(__VA_ARGS__)) \
+      (__VA_ARGS__))
+
+// Option of TEST_WITH, the test never runs in parallel with others
+#define MICRO_TESTS_SERIAL \
+  ("serial", .flags = MICRO_TESTS_FLAG_SERIAL)
+
+// Option of TEST_WITH, the test needs exclusive access to resources,
+// see TEST_RESOURCES
+#define MICRO_TESTS_RESOURCES(__resources) \
+  ("resources=" __resources, .resources = __resources)
+
+// Option of TEST_WITH, the test runs after other tests, see TEST_AFTER
+#define MICRO_TESTS_AFTER(__depends) \
+  ("after=" __depends, .depends = __depends)
+
+// A TEST_WITH option is a manifest tag and a MicroTest initializer
+#define _MICRO_TESTS_TAG(__tag, ...) __tag
+#define _MICRO_TESTS_INIT(__tag, ...) __VA_ARGS__
+#define _MICRO_TESTS_TAGS_1(__a) _MICRO_TESTS_TAG __a
+#define _MICRO_TESTS_TAGS_2(__a, __b) \
+  _MICRO_TESTS_TAG __a " " _MICRO_TESTS_TAG __b
+#define _MICRO_TESTS_TAGS_3(__a, __b, __c) \
+  _MICRO_TESTS_TAG __a " " _MICRO_TESTS_TAG __b " " _MICRO_TESTS_TAG __c
+#define _MICRO_TESTS_INITS_1(__a) _MICRO_TESTS_INIT __a
+#define _MICRO_TESTS_INITS_2(__a, __b) \
+  _MICRO_TESTS_INIT __a, _MICRO_TESTS_INIT __b
+#define _MICRO_TESTS_INITS_3(__a, __b, __c) \
+  _MICRO_TESTS_INIT __a, _MICRO_TESTS_INIT __b, _MICRO_TESTS_INIT __c
+#define _MICRO_TESTS_COUNT(...) _MICRO_TESTS_COUNT_(__VA_ARGS__, 3, 2, 1, 0)
+#define _MICRO_TESTS_COUNT_(__a, __b, __c, __n, ...) __n
+#define _MICRO_TESTS_CAT(__a, __b) _MICRO_TESTS_CAT_(__a, __b)
+#define _MICRO_TESTS_CAT_(__a, __b) __a##__b
+
+// Register a test case with its tags in the manifest
+#define _MICRO_TESTS_TEST(__suite_name, __test_name, __tags, ...) \
+  _MICRO_TESTS_MANIFEST(__suite_name, __test_name, __tags)     \
   static int __suite_name##_##__test_name(void);               \
   static MicroTest __micro_test_record_##__suite_name##_##__test_name   \
   __attribute__((used, section(".micro_tests"), aligned(sizeof(ALIGNOF(MicroTest))))) = { \
@@ -229,7 +807,8 @@ extern "C" {
     .file_name = __FILE__,                                     \
     .line_number = __LINE__,                                   \
     .function_name = #__suite_name "_" #__test_name,           \
-    .function_pointer = __suite_name##_##__test_name           \
+    .function_pointer = __suite_name##_##__test_name,          \
+    __VA_ARGS__                                                \
   };                                                           \
   static int __suite_name##_##__test_name(void)
 
@@ -241,18 +820,353 @@ extern "C" {
 #define TEST_FAILED \
   do { return -1; } while(0)
 
+// Register a benchmark
+//
+// Args:
+//  - arg1: suite name
+//  - arg2: benchmark name
+//
+// Note: the body receives a MicroTestsBench *bench and should run the
+// measured code bench->iterations times
+#define BENCHMARK(__suite_name, __bench_name)                  \
+  BENCHMARK_WITH(__suite_name, __bench_name, .range_lo = 0)
+
+// Register a benchmark measured at several input sizes
+//
+// Args:
+//  - arg1: suite name
+//  - arg2: benchmark name
+//  - arg3: first input size
+//  - arg4: last input size, included
+//  - arg5: factor between two input sizes
+//
+// Note: the input size is bench->n. With at least three sizes, the
+// timings are fitted to a complexity class
+#define BENCHMARK_RANGE(__suite_name, __bench_name, __lo, __hi, __mult) \
+  BENCHMARK_WITH(__suite_name, __bench_name, .range_lo = __lo,          \
+                 .range_hi = __hi, .range_mult = __mult)
+
+// Register a benchmark with an expected complexity
+//
+// Args:
+//  - arg1: suite name
+//  - arg2: benchmark name
+//  - arg3: first input size
+//  - arg4: last input size, included
+//  - arg5: factor between two input sizes
+//  - arg6: a MicroTestsComplexity, like MICRO_TESTS_O_N
+//
+// Note: the benchmark fails if it fits a worse complexity class
+#define BENCHMARK_COMPLEXITY(__suite_name, __bench_name, __lo, __hi,   \
+                             __mult, __complexity)                      \
+  BENCHMARK_WITH(__suite_name, __bench_name, .range_lo = __lo,          \
+                 .range_hi = __hi, .range_mult = __mult,                \
+                 .complexity = __complexity)
+
+// Register a benchmark measured with several threads at once
+//
+// Args:
+//  - arg1: suite name
+//  - arg2: benchmark name
+//  - arg3: comma separated numbers of threads, as a string
+//
+// Note: every thread runs the body with bench->iterations, its index
+// is bench->thread_index. Needs MICRO_TESTS_MULTITHREADED
+#define BENCHMARK_THREADS(__suite_name, __bench_name, __threads)       \
+  BENCHMARK_WITH(__suite_name, __bench_name, .threads = __threads)
+
+// Register two implementations compared within the same run
+//
+// Args:
+//  - arg1: suite name
+//  - arg2: benchmark name
+//
+// Note: bench->variant is 0 for the first implementation and 1 for
+// the second one. The two run in randomized interleaved rounds, and
+// the speedup of the second one is reported with its confidence
+// interval
+#define BENCHMARK_AB(__suite_name, __bench_name)                       \
+  BENCHMARK_WITH(__suite_name, __bench_name, .ab = 1)
+
+// Register a benchmark with inputs prepared out of the timing
+//
+// Args:
+//  - arg1: suite name
+//  - arg2: benchmark name
+//  - arg3: setup, a void (*)(MicroTestsBench *bench, uint64_t count)
+//          preparing count inputs
+//  - arg4: maximum number of inputs prepared at once
+//
+// Note: the body runs after each setup with bench->iterations set to
+// the number of inputs prepared
+#define BENCHMARK_BATCHED(__suite_name, __bench_name, __setup, __batch) \
+  BENCHMARK_WITH(__suite_name, __bench_name, .setup = __setup,          \
+                 .batch = __batch)
+
+// Register a benchmark with additional MicroTestsBenchSpec fields
+//
+// Args:
+//  - arg1: suite name
+//  - arg2: benchmark name
+//  - varargs: designated initializers of MicroTestsBenchSpec
+#define BENCHMARK_WITH(__suite_name, __bench_name, ...)                \
+  _MICRO_TESTS_MANIFEST(__suite_name, __bench_name, "benchmark")      \
+  static void __suite_name##_##__bench_name(MicroTestsBench *bench);  \
+  static const MicroTestsBenchSpec                                    \
+  __micro_bench_spec_##__suite_name##_##__bench_name = {              \
+    .function = __suite_name##_##__bench_name,                        \
+    __VA_ARGS__                                                       \
+  };                                                                  \
+  static MicroTest __micro_test_record_##__suite_name##_##__bench_name \
+  __attribute__((used, section(".micro_tests"), aligned(sizeof(ALIGNOF(MicroTest))))) = { \
+    .marker = 0xDeadBeaf,                                             \
+    .test_suite = #__suite_name,                                      \
+    .test_name = #__bench_name,                                       \
+    .file_name = __FILE__,                                            \
+    .line_number = __LINE__,                                          \
+    .function_name = #__suite_name "_" #__bench_name,                 \
+    .function_pointer = NULL,                                         \
+    .flags = MICRO_TESTS_FLAG_BENCHMARK,                              \
+    .bench = &__micro_bench_spec_##__suite_name##_##__bench_name,     \
+  };                                                                  \
+  static void __suite_name##_##__bench_name(MicroTestsBench *bench)
+
+// Stop timing in a benchmark body, see RESUME_TIMING
+#define PAUSE_TIMING() \
+  micro_tests_bench_pause(bench)
+
+// Restart timing in a benchmark body after PAUSE_TIMING
+#define RESUME_TIMING() \
+  micro_tests_bench_resume(bench)
+
+// Describe a test in .micro_tests_manifest, see
+// MicroTestsManifestRecord
+#ifndef MICRO_TESTS_NO_MANIFEST
+  #define _MICRO_TESTS_MANIFEST(__suite_name, __test_name, __tags)        \
+    static const struct {                                                 \
+      MicroTestsManifestRecord record;                                    \
+      char text[sizeof(#__suite_name "\0" #__test_name "\0" __FILE__     \
+                       "\0" __tags)];                                     \
+    } __micro_test_manifest_##__suite_name##_##__test_name               \
+    __attribute__((used, section(".micro_tests_manifest"), aligned(4))) = { \
+      .record = {                                                         \
+        .size    = sizeof(__micro_test_manifest_##__suite_name##_##__test_name), \
+        .version = MICRO_TESTS_MANIFEST_VERSION,                          \
+        .line    = __LINE__,                                              \
+      },                                                                  \
+      .text = #__suite_name "\0" #__test_name "\0" __FILE__ "\0" __tags,  \
+    };
+#else
+  #define _MICRO_TESTS_MANIFEST(__suite_name, __test_name, __tags)
+#endif
+
+// Keep the compiler from optimizing away a value in a benchmark
+//
+// Args:
+//  - arg1: a scalar or a pointer
+#define MICRO_TESTS_DO_NOT_OPTIMIZE(__value) \
+  __asm__ volatile("" : : "g"(__value) : "memory")
+
 // A main() function for running the tests
 #define MICRO_TESTS_MAIN \
   int main(int argc, char **argv) { return micro_tests_run(argc, argv); }
 
+// Run a loop inside a test on the threads of the runner
+//
+// Args:
+//  - arg1: first index
+//  - arg2: end of the range, excluded
+//  - arg3: body, a void (*)(size_t i, void *ctx)
+//  - arg4: context passed to the body
+//
+// Note: returns after the body ran for all the indices. See
+// micro_tests_parallel_for.
+#define MICRO_PARALLEL_FOR(__begin, __end, __fn, __ctx) \
+  micro_tests_parallel_for(__begin, __end, __fn, __ctx)
+
+// Start a task inside a test on the threads of the runner
+//
+// Args:
+//  - arg1: pointer to a MicroTestsTaskGroup, zero initialized
+//  - arg2: task, a void (*)(void *arg)
+//  - arg3: argument passed to the task
+#define MICRO_TASK_SPAWN(__group, __fn, __arg) \
+  micro_tests_task_spawn(__group, __fn, __arg)
+
+// Wait for all the tasks of a group
+//
+// Args:
+//  - arg1: pointer to a MicroTestsTaskGroup
+#define MICRO_TASK_WAIT(__group) \
+  micro_tests_task_wait(__group)
+
+#define _MICRO_TESTS_CONCAT_IMPL(a, b) a##b
+#define _MICRO_TESTS_CONCAT(a, b) _MICRO_TESTS_CONCAT_IMPL(a, b)
+
+// Notify the reporter of an event
+//
+// Args:
+//  - arg1: the event, one of the fields of MicroTestsReporter
+//  - varargs: the arguments of the event, starting with micro_tests
+//
+// Note: calls _micro_tests_<reporter>_<event> directly if a single
+// reporter was compiled in, and goes through micro_tests->reporter
+// otherwise
+#ifdef _MICRO_TESTS_REPORTER
+  #define _MICRO_TESTS_REPORT(__event, ...)                             \
+    _MICRO_TESTS_CONCAT(_micro_tests_,                                  \
+      _MICRO_TESTS_CONCAT(_MICRO_TESTS_REPORTER, _##__event))(__VA_ARGS__)
+#else
+  #define _MICRO_TESTS_REPORT(__event, micro_tests, ...)  \
+    (micro_tests)->reporter->__event(micro_tests, __VA_ARGS__)
+#endif
+
 //
 // Types
 //
 
+#ifndef MICRO_TESTS_NO_MANIFEST
+  #include <elf.h>
+  #include <fcntl.h>
+  #include <link.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+#ifdef MICRO_TESTS_PLUGINS
+  #include <dlfcn.h>
+  #include <link.h>
+#endif
 #ifdef MICRO_TESTS_MULTITHREADED
   #include <pthread.h>
+  #include <sched.h>
+#endif
+#ifdef MICRO_TESTS_ISOLATION
+  #include <errno.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/wait.h>
+#endif
+#ifdef MICRO_TESTS_ORCHESTRATOR
+  #ifdef MICRO_TESTS_NO_MANIFEST
+    #error "MICRO_TESTS_ORCHESTRATOR reads the manifests, undefine MICRO_TESTS_NO_MANIFEST"
+  #endif
+  #include <errno.h>
+  #include <fcntl.h>
+  #include <poll.h>
+  #include <unistd.h>
+  #include <sys/wait.h>
+#endif
+#ifdef MICRO_TESTS_CAPTURE
+  #include <unistd.h>
+  #include <sys/mman.h>
+#endif
+#ifdef MICRO_TESTS_CACHE
+  #include <errno.h>
+  #include <link.h>
+  #include <unistd.h>
+  #include <sys/stat.h>
+#endif
+#ifdef MICRO_TESTS_DISTRIBUTED
+  #include <errno.h>
+  #include <netdb.h>
+  #include <poll.h>
+  #include <time.h>
+  #include <unistd.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <sys/socket.h>
+  #include <sys/wait.h>
+#endif
+#ifdef MICRO_TESTS_PROFILE
+  #include <dlfcn.h>
+  #include <elf.h>
+  #include <fcntl.h>
+  #include <link.h>
+  #include <signal.h>
+  #include <ucontext.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <sys/syscall.h>
+#endif
+#ifdef MICRO_TESTS_BENCHMARK
+  #include <unistd.h>
+  #ifdef MICRO_TESTS_BENCH_ALLOCS
+    #include <errno.h>
+  #endif
+  #if defined(__x86_64__) && !defined(MICRO_TESTS_BENCH_NO_TSC)
+    #include <cpuid.h>
+    #define _MICRO_TESTS_TSC
+  #endif
 #endif
   
+// Complexity class of a benchmark, from the best to the worst
+typedef enum {
+  // Not declared, the complexity is only reported
+  MICRO_TESTS_O_AUTO = 0,
+  MICRO_TESTS_O_1,
+  MICRO_TESTS_O_LOG_N,
+  MICRO_TESTS_O_N,
+  MICRO_TESTS_O_N_LOG_N,
+  MICRO_TESTS_O_N2,
+  _MICRO_TESTS_O_COUNT,
+} MicroTestsComplexity;
+
+// State of a running benchmark
+typedef struct {
+  // Input size, 0 without a range
+  size_t n;
+  // Number of times the body should run the measured code
+  uint64_t iterations;
+  // Bytes processed by an iteration, set by the body to report GB/s
+  uint64_t bytes;
+  // Items processed by an iteration, set by the body to report
+  // Mitems/s
+  uint64_t items;
+  // Index of the thread running the body, from 0
+  int thread_index;
+  // Number of threads running the body at the same time
+  int thread_count;
+  // Implementation to run with BENCHMARK_AB, 0 or 1
+  int variant;
+  // During runtime, timer ticks spent with the timing paused
+  uint64_t paused_ticks;
+  // During runtime, timer ticks of the last PAUSE_TIMING
+  uint64_t pause_start;
+  // During runtime, number of PAUSE_TIMING
+  uint64_t pauses;
+  // During runtime, allocations of the last call of the body, with
+  // MICRO_TESTS_BENCH_ALLOCS
+  uint64_t allocs;
+  // During runtime, bytes allocated by the last call of the body
+  uint64_t alloc_bytes;
+  // During runtime, frees of the last call of the body
+  uint64_t frees;
+} MicroTestsBench;
+
+// A benchmark, see BENCHMARK_WITH
+typedef struct {
+  // Body of the benchmark
+  void (*function)(MicroTestsBench *bench);
+  // First input size
+  size_t range_lo;
+  // Last input size, included, or 0 for a single size
+  size_t range_hi;
+  // Factor between two input sizes
+  size_t range_mult;
+  // Expected complexity class
+  MicroTestsComplexity complexity;
+  // Comma separated numbers of threads to measure, or NULL
+  const char *threads;
+  // Whether the body has two variants to compare, see BENCHMARK_AB
+  _Bool ab;
+  // Prepares the inputs of the body out of the timing, or NULL
+  void (*setup)(MicroTestsBench *bench, uint64_t count);
+  // Maximum number of inputs of a setup
+  uint64_t batch;
+} MicroTestsBenchSpec;
+
 // A MicroTest
 //
 // Note: Each test will create this struct automatically in the
@@ -273,24 +1187,302 @@ typedef struct __attribute__((packed)) {
   uint32_t line_number;
   // Test function
   int (*function_pointer)(void);
+  // Bitwise or of MICRO_TESTS_FLAG_*
+  uint64_t flags;
+  // Comma separated names of the resources used exclusively, or NULL
+  const char* resources;
+  // Comma separated names of the prerequisites, or NULL
+  const char* depends;
+  // The benchmark, with MICRO_TESTS_FLAG_BENCHMARK
+  const MicroTestsBenchSpec* bench;
 
 } MicroTest;
 
-// Settings for the MicroTests framework
+// The tests are laid out as an array in .micro_tests, so the size of
+// a MicroTest must be a multiple of its alignment
+typedef char _micro_tests_check_size[(sizeof(MicroTest) % 8 == 0) ? 1 : -1];
+
+// The test never runs in parallel with other tests
+#define MICRO_TESTS_FLAG_SERIAL (1 << 0)
+// The entry is a benchmark, run only with --bench
+#define MICRO_TESTS_FLAG_BENCHMARK (1 << 1)
+
+// Version of the records of .micro_tests_manifest
+#define MICRO_TESTS_MANIFEST_VERSION 1
+
+// Header of a record of .micro_tests_manifest
+//
+// Note: The records are packed one after the other in the section,
+// each followed by the suite, name, file and tags of the test as
+// consecutive null terminated strings. They hold no pointers, so
+// they can be read from the file without loading it.
+typedef struct {
+  // Size of the record with its strings, a multiple of 4
+  uint32_t size;
+  // MICRO_TESTS_MANIFEST_VERSION of the writer
+  uint32_t version;
+  // Line where the test is located
+  uint32_t line;
+} MicroTestsManifestRecord;
+
+// A test read from a manifest
+typedef struct {
+  const char *suite;
+  const char *name;
+  const char *file;
+  uint32_t line;
+  // Space separated "serial", "resources=<names>" and "after=<names>",
+  // or "benchmark"
+  const char *tags;
+} MicroTestsManifestEntry;
+
+// A loop published by a test to the threads of the runner
+//
+// Note: The threads that are not running a test claim chunks of the
+// range, so the loop never uses more threads than --threads
+typedef struct MicroTestsJob {
+  // Body of the loop
+  void (*fn)(size_t i, void *ctx);
+  // Context passed to the body
+  void *ctx;
+  // Body of a task, see MicroTestsTaskGroup
+  void (*task)(void *arg);
+  // Argument passed to the task
+  void *arg;
+  // Next index to claim, atomic
+  size_t next;
+  // End of the range, excluded
+  size_t end;
+  // Number of indices claimed at once
+  size_t chunk;
+  // Number of indices executed, atomic
+  size_t done;
+  // Number of indices in the range
+  size_t total;
+  // Number of threads other than the owner working on the job
+  int helpers;
+  // Next published job
+  struct MicroTestsJob *next_job;
+  // Next job of the same task group
+  struct MicroTestsJob *next_task;
+} MicroTestsJob;
+
+// Tasks started with MICRO_TASK_SPAWN, zero initialize it
+typedef struct {
+  // Spawned tasks
+  MicroTestsJob *tasks;
+} MicroTestsTaskGroup;
+
+// Outcome of a MicroTest
+typedef enum {
+  MICRO_TESTS_OK = 0,
+  MICRO_TESTS_FAILED,
+  // Not executed because a prerequisite did not succeed
+  MICRO_TESTS_SKIPPED,
+} MicroTestsStatus;
+
+#ifdef MICRO_TESTS_ISOLATION
+
+// Status of a slot in the result board
+enum {
+  MICRO_TESTS_SLOT_EMPTY = 0,
+  MICRO_TESTS_SLOT_RUNNING,
+  MICRO_TESTS_SLOT_DONE,
+};
+
+// Result of an isolated test, written by the child process
+//
+// Note: There is one slot per MicroTest in a MAP_SHARED mapping,
+// each slot takes a whole cache line so that children running in
+// parallel never write to the same line
+typedef struct {
+  // One of MICRO_TESTS_SLOT_*, DONE is stored after result
+  int32_t state;
+  // Return value of the test function
+  int32_t result;
+} __attribute__((aligned(MICRO_TESTS_CACHE_LINE))) MicroTestsSlot;
+
+#endif // MICRO_TESTS_ISOLATION
+
+// Scheduling state of a MicroTest
+enum {
+  MICRO_TESTS_SCHED_PENDING = 0,
+  // Pending, but an unknown prerequisite or a cycle means that the
+  // test will be skipped
+  MICRO_TESTS_SCHED_BROKEN,
+  MICRO_TESTS_SCHED_RUNNING,
+  // Succeeded, or not selected
+  MICRO_TESTS_SCHED_DONE,
+  MICRO_TESTS_SCHED_FAILED,
+  MICRO_TESTS_SCHED_SKIPPED,
+};
+
+// Readiness of a pending MicroTest
+enum {
+  MICRO_TESTS_DEPS_READY = 0,
+  MICRO_TESTS_DEPS_WAIT,
+  MICRO_TESTS_DEPS_SKIP,
+};
+
+typedef struct MicroTests MicroTests;
+
+// A reporter formats the events of a test run
+//
+// Note: The runners serialize the calls, so a reporter does not need
+// to be thread safe. Built-in reporters are "console", "tap" (TAP
+// version 14), "junit" (JUnit XML) and "json".
 typedef struct {
+  // Name used to select the reporter with --reporter
+  const char *name;
+  // Called once before the first test, with the number of tests
+  // that will run
+  void (*on_run_start)(MicroTests *micro_tests, size_t test_count);
+  // Called before a test is executed
+  void (*on_test_start)(MicroTests *micro_tests, MicroTest *test);
+  // Called after a test is executed, with its outcome
+  void (*on_test_end)(MicroTests *micro_tests, MicroTest *test,
+                      MicroTestsStatus status);
+  // Called once after the last test, with the number of failed tests
+  void (*on_run_end)(MicroTests *micro_tests, int failed);
+} MicroTestsReporter;
+
+// Settings for the MicroTests framework
+struct MicroTests {
   // If specified, run a specific test suite
   const char *run_suite;
   // If specified, run a specific test
   const char *run_test;
+#ifndef _MICRO_TESTS_REPORTER
+  // Reporter selected with --reporter
+  const MicroTestsReporter *reporter;
+#endif
+  // During runtime, number of tests reported so far
+  size_t reported_count;
+  // During runtime, number of tests reported as skipped so far
+  size_t skipped_count;
+  // During runtime, output of a reporter held until the end of the
+  // run, or NULL
+  FILE *report_buffer;
+  char *report_text;
+  size_t report_size;
+  // If specified, file with the durations of the previous runs,
+  // updated after the run
+  const char *durations_file;
+  // During runtime, MICRO_TESTS_SCHED_* state of each MicroTest
+  unsigned char *test_state;
+  // During runtime, duration in seconds of each MicroTest, negative
+  // if unknown
+  double *durations;
+  // During runtime, indices of the selected tests, longest path
+  // to the end of the dependency graph first
+  size_t *order;
+  // During runtime, number of entries in order
+  size_t order_count;
+  // During runtime, indices of the prerequisites, the ones of test i
+  // are deps[deps_start[i]] to deps[deps_start[i + 1] - 1]
+  size_t *deps;
+  // During runtime, see deps
+  size_t *deps_start;
 #ifdef MICRO_TESTS_MULTITHREADED
   // Whether to run the tests with multiple threads
   _Bool run_multithreaded;
-  // Number of threads to use of multithreaded is enabled
+  // Number of threads to use of multithreaded is enabled, or the
+  // maximum number of threads with adaptive_threads
   int thread_number;
-  // During runtime, head index of the tests to be executed
+  // Whether to adjust the number of threads while running, given
+  // with --threads auto
+  _Bool adaptive_threads;
+  // During runtime, number of CPUs the process can use
+  int cpu_count;
+  // During runtime, number of tests that were started
+  size_t started_count;
+  // During runtime, number of threads waiting for a test to end
+  int waiting_count;
+  // During runtime, number of threads that should exit after their
+  // current test
+  int retire_count;
+  // During runtime, published jobs that may have indices left
+  MicroTestsJob *jobs;
+  // During runtime, index in order of the first test that was not
+  // started
   int current_test_index;
-  // During runtime, mutex for current_test_index
+  // During runtime, mutex for the scheduling state
   pthread_mutex_t current_test_index_mutex;
+  // During runtime, signaled when a test ends
+  pthread_cond_t test_done_cond;
+  // During runtime, test run by each thread, or NULL
+  MicroTest **running;
+  // During runtime, number of non NULL entries in running
+  int running_count;
+  // During runtime, mutex serializing the reporter calls
+  pthread_mutex_t reporter_mutex;
+#endif
+#ifdef MICRO_TESTS_GLOBALS_CHECK
+  // Whether to report the tests that write global state
+  _Bool check_globals;
+#endif
+#ifdef MICRO_TESTS_BENCHMARK
+  // Whether to run the benchmarks instead of the tests
+  _Bool run_benchmarks;
+  // If specified, file with the results to compare against
+  const char *baseline_file;
+  // If specified, file where the results are saved
+  const char *save_baseline_file;
+  // During runtime, content of baseline_file, or NULL
+  char *baseline;
+  // During runtime, opened save_baseline_file, or NULL
+  FILE *baseline_out;
+  // Whether to save the baseline from a noisy environment
+  _Bool force;
+#endif
+#ifdef MICRO_TESTS_CAPTURE
+  // Whether to capture the output of the tests, shown if they fail
+  _Bool capture;
+#endif
+#ifdef MICRO_TESTS_CACHE
+  // If specified, directory of the results of the previous runs
+  const char *cache_dir;
+  // Whether to run the tests that passed too, and record them again
+  _Bool no_cache;
+  // During runtime, file of the tests that passed with the key of the
+  // run
+  char *cache_file;
+  // During runtime, whether each MicroTest passed in a previous run
+  // and is skipped
+  unsigned char *cached;
+#endif
+#ifdef MICRO_TESTS_PROFILE
+  // If specified, file where the folded stacks of the tests are saved
+  const char *profile_file;
+#endif
+#ifndef MICRO_TESTS_NO_MANIFEST
+  // If specified, executable whose manifest is listed
+  const char *manifest_file;
+#endif
+  // If specified, file with the "suite.test" names of the tests to
+  // run, one per line
+  const char *test_file;
+  // During runtime, 1 + the position of each MicroTest in the list of
+  // test_file or of the batch of --worker, 0 if it is not listed
+  size_t *selection;
+#ifdef MICRO_TESTS_DISTRIBUTED
+  // If specified, port where --coordinator waits for the workers
+  const char *coordinator_port;
+  // If specified, "host:port" of the coordinator of --worker
+  const char *worker_address;
+#endif
+#ifdef MICRO_TESTS_ORCHESTRATOR
+  // Executables whose tests are run with --orchestrate
+  const char **executables;
+  size_t executable_count;
+  // Maximum number of executables running at the same time
+  int job_count;
+#endif
+#ifdef MICRO_TESTS_ISOLATION
+  // Whether to run each test in its own process
+  _Bool run_isolated;
+  // During runtime, shared result board with one slot per MicroTest
+  MicroTestsSlot *board;
 #endif
   // Whether to show a list of the tests
   _Bool show_list;
@@ -302,7 +1494,7 @@ typedef struct {
   _Bool debug;
   // Whether to not print OK results
   _Bool quiet;
-} MicroTests;
+};
 
 //
 // Functions
@@ -325,6 +1517,53 @@ MICRO_TESTS_DEF int micro_tests_parse_args(MicroTests *micro_tests,
 //  - micro_tests: the settings of the testing framework
 MICRO_TESTS_DEF void micro_tests_show_list(MicroTests *micro_tests);
 
+#ifdef MICRO_TESTS_PLUGINS
+// Load the tests of a shared library, see --load
+//
+// Args:
+//  - path: the shared library, linked with micro-tests.ld
+//
+// Returns: 0 on success, or a negative value on failure
+//
+// Notes: The tests of the library are appended to the registered
+// ones and scheduled with them. The library is found through its
+// __micro_tests_start and __micro_tests_stop symbols and must not
+// define the implementation. To call the functions of the runner,
+// link the runner with -rdynamic.
+MICRO_TESTS_DEF int micro_tests_load(const char *path);
+#endif // MICRO_TESTS_PLUGINS
+
+#ifndef MICRO_TESTS_NO_MANIFEST
+// Read the manifest of an executable, without running it
+//
+// Args:
+//  - path: the executable
+//  - fn: called for each test, stops the reading if it returns non zero
+//  - ctx: context passed to fn
+//
+// Returns: the number of tests read, or a negative value if the file
+// is not an ELF executable or has no .micro_tests_manifest section
+//
+// Notes: The file is mapped and only its section headers and the
+// manifest are touched. The strings of an entry are valid only
+// during the call of fn. Records of unknown versions are skipped.
+MICRO_TESTS_DEF long
+micro_tests_manifest_read(const char *path,
+                          int (*fn)(const MicroTestsManifestEntry *entry,
+                                    void *ctx),
+                          void *ctx);
+
+// List the tests in the manifest of micro_tests->manifest_file that
+// match --suite and --test
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//
+// Returns: 0 on success, or a negative value if the manifest could
+// not be read
+MICRO_TESTS_DEF int micro_tests_show_manifest(MicroTests *micro_tests);
+#endif // MICRO_TESTS_NO_MANIFEST
+
 // Run tests
 //
 // Args:
@@ -334,6 +1573,55 @@ MICRO_TESTS_DEF void micro_tests_show_list(MicroTests *micro_tests);
 // Returns: 0 on success, or the number of failed tests
 MICRO_TESTS_DEF int micro_tests_run(int argc, char **argv);
 
+// Run a loop inside a test on the threads of the runner
+//
+// Args:
+//  - begin: first index
+//  - end: end of the range, excluded
+//  - fn: body of the loop, called once for each index
+//  - ctx: context passed to the body
+//
+// Notes: The calling thread runs the loop too, and the idle threads
+// of --multithreaded take chunks of it. Without them the loop runs
+// on the calling thread.
+MICRO_TESTS_DEF void micro_tests_parallel_for(size_t begin, size_t end,
+                                              void (*fn)(size_t i, void *ctx),
+                                              void *ctx);
+
+// Start a task inside a test on the threads of the runner
+//
+// Args:
+//  - group: the group of the task
+//  - fn: the task
+//  - arg: argument passed to the task
+//
+// Notes: The task runs right away when there is no pool or its
+// memory could not be allocated
+MICRO_TESTS_DEF void micro_tests_task_spawn(MicroTestsTaskGroup *group,
+                                            void (*fn)(void *arg),
+                                            void *arg);
+
+// Wait for all the tasks of a group, running the ones not started
+//
+// Args:
+//  - group: the group of the tasks
+MICRO_TESTS_DEF void micro_tests_task_wait(MicroTestsTaskGroup *group);
+
+// Stop timing a benchmark, see PAUSE_TIMING
+//
+// Args:
+//  - bench: the running benchmark
+//
+// Notes: The time until micro_tests_bench_resume and the overhead of
+// reading the timer twice are not counted
+MICRO_TESTS_DEF void micro_tests_bench_pause(MicroTestsBench *bench);
+
+// Restart timing a benchmark, see RESUME_TIMING
+//
+// Args:
+//  - bench: the running benchmark
+MICRO_TESTS_DEF void micro_tests_bench_resume(MicroTestsBench *bench);
+
 MICRO_TESTS_DEF void micro_tests_print_banner(void);
 MICRO_TESTS_DEF void micro_tests_print_help(void);
 
@@ -341,295 +1629,6237 @@ MICRO_TESTS_DEF int _micro_tests_run(MicroTests *micro_tests);
 MICRO_TESTS_DEF int _micro_tests_strcmp(const char* s1,
                                         const char *s2);
 
-#ifdef MICRO_TESTS_MULTITHREADED
+// The registered tests, an array of _micro_tests_count() tests
+//
+// Notes: The .micro_tests section, or a copy of it followed by the
+// tests of the plugins once one is loaded
+MICRO_TESTS_DEF MicroTest *_micro_tests_tests(void);
 
-// Get the next MicroTest to run
+// Number of registered tests
+MICRO_TESTS_DEF size_t _micro_tests_count(void);
+
+// Check whether a test should run with the current settings
 //
 // Args:
 //  - micro_tests: settings for the testing framework
+//  - test: the test to check
 //
-// Returns: a pointer to a MicroTest
+// Returns: 1 if the test is valid and matches --suite and --test,
+// 0 otherwise
+MICRO_TESTS_DEF int _micro_tests_is_selected(MicroTests *micro_tests,
+                                             MicroTest *test);
+
+// Check if a test can run in this run, selected or not
 //
-// Notes: Can be called by multiple threads
-MICRO_TESTS_DEF MicroTest*
-_micro_tests_get_next_test(MicroTests *micro_tests);
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - test: the test to check
+//
+// Returns: 1 if the test is valid and a benchmark exactly when --bench
+// is given, 0 otherwise
+MICRO_TESTS_DEF int _micro_tests_is_runnable(MicroTests *micro_tests,
+                                             MicroTest *test);
 
-// A single test runner
+// Select the tests listed in micro_tests->test_file
 //
 // Args:
 //  - micro_tests: settings for the testing framework
 //
-// Returns: The number of failed tests, casted to a (void*)
-MICRO_TESTS_DEF void *_micro_tests_thread(void *micro_tests);
+// Returns: 0 on success, or a negative value on failure
+MICRO_TESTS_DEF int _micro_tests_select_from_file(MicroTests *micro_tests);
 
-// Run the tests with multiple threads
+// Select the tests named in a list
 //
 // Args:
 //  - micro_tests: settings for the testing framework
+//  - list: "suite.test" names, one per line, modified in place
 //
-// Returns: The number of failed tests
-MICRO_TESTS_DEF int
-_micro_tests_run_multithreaded(MicroTests *micro_tests);
+// Returns: 0 on success, or a negative value on failure
+MICRO_TESTS_DEF int _micro_tests_select(MicroTests *micro_tests, char *list);
 
-#endif // MICRO_TESTS_MULTITHREADED
+// Prepare the scheduling state of a run
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//
+// Returns: 0 on success, or a negative value on failure
+//
+// Notes: Resolves the prerequisites, adds the ones of the selected
+// tests to the run, skips the tests with an unknown prerequisite,
+// loads the durations of the previous runs and orders the tests by
+// the longest duration left to the end of the dependency graph, so
+// that the critical path starts first
+MICRO_TESTS_DEF int _micro_tests_plan(MicroTests *micro_tests);
 
+// Free the scheduling state, saving the durations if requested
 //
-// Variables
+// Args:
+//  - micro_tests: settings for the testing framework
+MICRO_TESTS_DEF void _micro_tests_plan_free(MicroTests *micro_tests);
+
+// Load the durations saved by a previous run
 //
+// Args:
+//  - micro_tests: settings for the testing framework
+//
+// Notes: The file has one "suite.test seconds" line per test. A
+// missing file is not an error, it is created after the run.
+MICRO_TESTS_DEF void _micro_tests_load_durations(MicroTests *micro_tests);
 
-// Start of the micro tests section (exported by the linker)
-extern char __micro_tests_start[];
-// End of the micro tests section (exported by the linker)
-extern char __micro_tests_stop[];
+// Save the durations of the tests to micro_tests->durations_file
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+MICRO_TESTS_DEF void _micro_tests_save_durations(MicroTests *micro_tests);
 
+// Check the prerequisites of a pending test
 //
-// Implementation
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - index: index of the test
 //
+// Returns: one of MICRO_TESTS_DEPS_*
+MICRO_TESTS_DEF int _micro_tests_deps_status(MicroTests *micro_tests,
+                                             size_t index);
 
-#ifdef MICRO_TESTS_IMPLEMENTATION
+// Find a test by name
+//
+// Args:
+//  - name: "suite.test", or "test" for a test in default_suite
+//  - len: length of name
+//  - default_suite: suite of the tests named without a suite
+//
+// Returns: the index of the test, or a negative value if not found
+MICRO_TESTS_DEF long _micro_tests_find_test(const char *name, size_t len,
+                                            const char *default_suite);
 
-MICRO_TESTS_DEF int _micro_tests_strcmp(const char* s1, const char *s2)
-{
-  while (*s2 != '\0' && *s1 != '\0')
-  {
-    if (*s1 != *s2)
-      return (*s1 > *s2) ? 1 : -1;
-    s1++; s2++;
-  }
-  return !(*s2 == '\0' && *s1 == '\0');
-}
+// Monotonic time
+//
+// Returns: the time in seconds
+MICRO_TESTS_DEF double _micro_tests_time(void);
 
-MICRO_TESTS_DEF int micro_tests_parse_args(MicroTests *micro_tests,
-                                           int argc, char **argv)
-{
-  // Default values
-  *micro_tests = (MicroTests){
-    .run_suite         = NULL,
-    .run_test          = NULL,
-#ifdef MICRO_TESTS_MULTITHREADED
-    .run_multithreaded = 0,
-    .thread_number     = 4,
-#endif
-    .show_list         = 0,
-    .print_banner      = 1,
-    .print_help        = 0,
-    .debug             = 0,
-    .quiet             = 0,
-  };
+// Execute a test with the current settings
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - test: the test to execute
+//
+// Returns: the outcome of the test
+MICRO_TESTS_DEF MicroTestsStatus _micro_tests_exec(MicroTests *micro_tests,
+                                                   MicroTest *test);
 
-  for (int i = 1; i < argc; ++i)
-  {
-    if (_micro_tests_strcmp(argv[i], "--help") == 0
-        || _micro_tests_strcmp(argv[i], "-h") == 0)
-    {
-      micro_tests->print_help = 1;
-    } else if (_micro_tests_strcmp(argv[i], "--list") == 0)
-    {
-      micro_tests->show_list = 1;
-    } else if (_micro_tests_strcmp(argv[i], "--suite") == 0)
-    {
-      if (i + 1 >= argc)
-      {
-        fprintf(stderr, "Usage: --suite <suite-name>\n");
-        return -1;
-      }
-      micro_tests->run_suite = argv[++i];
-    } else if (_micro_tests_strcmp(argv[i], "--test") == 0)
-    {
-      if (i + 1 >= argc)
-      {
-        fprintf(stderr, "Usage: --test <test-name>\n");
-        return -1;
-      }
-      micro_tests->run_test = argv[++i];
-    } else if (_micro_tests_strcmp(argv[i], "--no-banner") == 0)
-    {
-      micro_tests->print_banner = 0;
-    } else if (_micro_tests_strcmp(argv[i], "--debug") == 0)
-    {
-      micro_tests->debug = 1;
-    } else if (_micro_tests_strcmp(argv[i], "--quiet") == 0)
-    {
-      micro_tests->quiet = 1;
-#ifdef MICRO_TESTS_MULTITHREADED
-    } else if (_micro_tests_strcmp(argv[i], "--multithreaded") == 0)
-    {
-      micro_tests->run_multithreaded = 1;
-    } else if (_micro_tests_strcmp(argv[i], "--threads") == 0)
-    {
-      if (i + 1 >= argc)
-      {
-        fprintf(stderr, "Usage: --threads <n>\n");
-        return -1;
-      }
-      micro_tests->thread_number = atoi(argv[++i]);
-      if (micro_tests->thread_number <= 0)
-      {
-        fprintf(stderr,
-                "Error: Thread number %s must be an integer and positive number",
-                argv[i]);
-        return -1;
-      }
-#endif // MICRO_TESTS_MULTITHREADED
-    } else {
-      printf("Unrecognized argument: %s\n", argv[i]);
-      printf("Try --help or -h\n");
-      return -1;
-    }
-  }
-  return 0;
-}
+#ifdef MICRO_TESTS_GLOBALS_CHECK
 
-MICRO_TESTS_DEF int _micro_tests_run(MicroTests *micro_tests)
-{
-  int out = 0;
-  size_t count = (__micro_tests_stop - __micro_tests_start) / sizeof(MicroTest);
-  MicroTest* test = (MicroTest*)__micro_tests_start;
+// Copy the state of the framework into a snapshot of the globals,
+// so that the comparison ignores it
+//
+// Args:
+//  - snapshot: copy of the .data and .bss of the executable
+//
+// Notes: The registered tests, the registry, the pool of the jobs,
+// the timer and the profile
+MICRO_TESTS_DEF void _micro_tests_globals_ignore(char *snapshot);
 
-  for (size_t i = 0; i < count; i++)
-  {
-    MicroTest* current = &test[i];
-    
-    if (current->marker == 0xDeadBeaf)
-    {
-      if (micro_tests->run_suite != NULL &&
-          _micro_tests_strcmp(micro_tests->run_suite, current->test_suite) != 0)
-        continue;
-      if (micro_tests->run_test != NULL &&
-          _micro_tests_strcmp(micro_tests->run_test, current->test_name) != 0)
-        continue;
-      
-      int ret = current->function_pointer();       // Execute the test.
-      if (ret < 0)
-      {
-        fprintf(stderr, "suite: %s, test: %s FAILED\n",
-                current->test_suite,
-                current->test_name);
-      } else if (!micro_tests->quiet) {
-        printf("suite: %s, test: %s OK\n",
-               current->test_suite,
-               current->test_name);
-      }
-      out += ret;
-    }
-  }
+// Run the planned tests one at a time and report the ones that
+// write to the .data or .bss of the executable, unless they are
+// serial or use resources already
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//
+// Returns: The number of failed tests
+MICRO_TESTS_DEF int _micro_tests_run_check_globals(MicroTests *micro_tests);
 
-  if (!micro_tests->quiet)
-    printf("\nTests done: %d %s failed\n\n", -out, (out == -1) ? "test" : "tests");
-  return -out;
-}
+#endif // MICRO_TESTS_GLOBALS_CHECK
 
-#ifdef MICRO_TESTS_MULTITHREADED
+#ifdef MICRO_TESTS_BENCHMARK
 
-MICRO_TESTS_DEF MicroTest*
-_micro_tests_get_next_test(MicroTests *micro_tests)
-{
-  pthread_mutex_lock(&micro_tests->current_test_index_mutex);
+// Run the selected benchmarks
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//
+// Returns: the number of failed benchmarks
+MICRO_TESTS_DEF int _micro_tests_bench_run(MicroTests *micro_tests);
+
+// Run a benchmark at all its input sizes, fit and compare the results
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - test: the benchmark
+//
+// Returns: 1 if the benchmark failed, 0 otherwise
+MICRO_TESTS_DEF int _micro_tests_bench_one(MicroTests *micro_tests,
+                                           MicroTest *test);
+
+// Run a benchmark at its thread counts, with speedup and efficiency
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - test: the benchmark
+//
+// Returns: 1 if the benchmark failed, 0 otherwise
+MICRO_TESTS_DEF int _micro_tests_bench_scaling(MicroTests *micro_tests,
+                                               MicroTest *test);
+
+// Timer of the benchmarks
+typedef struct {
+  // Whether the ticks come from the TSC, otherwise they are
+  // nanoseconds of CLOCK_MONOTONIC
+  _Bool tsc;
+  // Whether the CPU has rdtscp
+  _Bool rdtscp;
+  // Nanoseconds per tick
+  double ns_per_tick;
+  // Ticks measured by an empty start and stop, subtracted from the
+  // measurements
+  uint64_t overhead;
+} MicroTestsTimer;
+
+// Choose and calibrate the timer of the benchmarks
+//
+// Notes: Uses the TSC if it is invariant, and measures the overhead
+// of reading the timer
+MICRO_TESTS_DEF void _micro_tests_timer_init(void);
 
-  MicroTest* test = (MicroTest*)__micro_tests_start;
-  size_t count = (__micro_tests_stop - __micro_tests_start) / sizeof(MicroTest);
+// Read the timer before the measured code
+//
+// Returns: the ticks
+MICRO_TESTS_DEF uint64_t _micro_tests_timer_start(void);
+
+// Read the timer after the measured code
+//
+// Returns: the ticks
+MICRO_TESTS_DEF uint64_t _micro_tests_timer_stop(void);
+
+// Seconds between two readings of the timer, without its overhead
+//
+// Args:
+//  - start: ticks of _micro_tests_timer_start
+//  - stop: ticks of _micro_tests_timer_stop
+MICRO_TESTS_DEF double _micro_tests_timer_seconds(uint64_t start,
+                                                  uint64_t stop);
+
+// Inspect the machine for sources of noise in the benchmarks
+//
+// Args:
+//  - summary: set to a description of the environment
+//  - size: size of summary
+//
+// Returns: the number of sources of noise found, each one is
+// reported as a warning
+//
+// Notes: Reads the CPU frequency governor, the turbo boost, SMT and
+// the online CPUs from /sys/devices/system/cpu, the load average and
+// the ASLR state from /proc. Active SMT and ASLR, the defaults of most
+// machines, are only warnings and are not counted.
+MICRO_TESTS_DEF int _micro_tests_bench_environment(char *summary, size_t size);
+
+// Read the first line of a file, without the newline
+//
+// Args:
+//  - path: the file
+//  - line: set to the line
+//  - size: size of line
+//
+// Returns: 0 on success, or a negative value if the file could not
+// be read
+MICRO_TESTS_DEF int _micro_tests_read_line(const char *path, char *line,
+                                           size_t size);
+
+// Compare the two variants of a benchmark in interleaved rounds
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - test: the benchmark
+//
+// Returns: 1 if the benchmark failed, 0 otherwise
+MICRO_TESTS_DEF int _micro_tests_bench_ab(MicroTests *micro_tests,
+                                          MicroTest *test);
+
+// Grow the iterations until a call of the body lasts long enough
+//
+// Args:
+//  - spec: the benchmark
+//  - bench: state of the benchmark, the iterations are set
+//  - seconds: minimum duration of a call
+//
+// Returns: 0 on success, or a negative value if the threads could
+// not be started
+MICRO_TESTS_DEF int _micro_tests_bench_calibrate(const MicroTestsBenchSpec *spec,
+                                                 MicroTestsBench *bench,
+                                                 double seconds);
+
+// Median of some values, sorting them
+//
+// Args:
+//  - values: the values
+//  - count: number of values, at least one
+MICRO_TESTS_DEF double _micro_tests_median(double *values, size_t count);
+
+// Relative half width of the 95% confidence interval of a median
+//
+// Args:
+//  - sorted: the values, sorted
+//  - count: number of values, at least one
+//
+// Notes: Distribution free, the bounds are the order statistics
+// around the median given by the normal approximation of the binomial
+MICRO_TESTS_DEF double _micro_tests_median_precision(const double *sorted,
+                                                     size_t count);
+
+// Two sided 95% quantile of the Student t distribution
+//
+// Args:
+//  - df: degrees of freedom
+MICRO_TESTS_DEF double _micro_tests_t95(size_t df);
+
+// Outcome of the measurement of a benchmark at an input size
+typedef struct {
+  // Median nanoseconds per iteration
+  double ns;
+  // Relative half width of the 95% confidence interval of ns
+  double precision;
+  // Number of measurements discarded before the steady state
+  size_t warmup_samples;
+  // Seconds from the first call of the body to the steady state
+  double warmup_seconds;
+  // Whether the steady state was reached
+  _Bool steady;
+} MicroTestsBenchResult;
+
+// Report a measurement and write it to the baseline
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - test: the benchmark
+//  - key: name of the result, see _micro_tests_bench_lookup
+//  - result: the measurement
+//  - bench: state of the measurement
+//
+// Notes: The line is not terminated, so that callers can add to it
+MICRO_TESTS_DEF void _micro_tests_bench_report(MicroTests *micro_tests,
+                                               MicroTest *test,
+                                               const char *key,
+                                               const MicroTestsBenchResult *result,
+                                               MicroTestsBench *bench);
+
+// Check whether measurements have no trend
+//
+// Args:
+//  - window: the last measurements, in a ring buffer
+//  - count: number of measurements in window, at least 3
+//  - oldest: index of the oldest measurement in window
+//
+// Returns: 1 if the slope of a least squares line is not significant
+// at 95%, or drifts less than MICRO_TESTS_BENCH_PRECISION over the
+// window, 0 otherwise
+MICRO_TESTS_DEF int _micro_tests_bench_steady(const double *window,
+                                              size_t count, size_t oldest);
+
+// Run the body of a benchmark, with the setups of BENCHMARK_BATCHED
+//
+// Args:
+//  - spec: the benchmark
+//  - bench: state of the benchmark
+MICRO_TESTS_DEF void _micro_tests_bench_body(const MicroTestsBenchSpec *spec,
+                                             MicroTestsBench *bench);
+
+// Seconds not counted by the pauses of a call of the body
+//
+// Args:
+//  - bench: state of the benchmark after the call
+MICRO_TESTS_DEF double _micro_tests_bench_paused(const MicroTestsBench *bench);
+
+// Run the body of a BENCHMARK_BATCHED on batches prepared by its setup
+//
+// Args:
+//  - spec: the benchmark
+//  - bench: state of the benchmark
+MICRO_TESTS_DEF void _micro_tests_bench_batches(const MicroTestsBenchSpec *spec,
+                                                MicroTestsBench *bench);
+
+// Run the body of a benchmark once, on bench->thread_count threads
+//
+// Args:
+//  - spec: the benchmark
+//  - bench: state of the benchmark
+//
+// Returns: the elapsed seconds, negative if the threads could not
+// be started
+MICRO_TESTS_DEF double _micro_tests_bench_call(const MicroTestsBenchSpec *spec,
+                                               MicroTestsBench *bench);
+
+// Measure a benchmark at an input size
+//
+// Args:
+//  - spec: the benchmark
+//  - bench: state with the input size and the threads, the
+//           iterations, bytes and items of the last measurement are set
+//  - result: set to the measurement, the nanoseconds are per
+//            iteration of a thread divided by the number of threads
+//
+// Returns: 0 on success, or a negative value if the threads could
+// not be started
+//
+// Notes: Discards the measurements until they have no trend, then
+// measures until the precision reaches MICRO_TESTS_BENCH_PRECISION or
+// MICRO_TESTS_BENCH_MAX_TIME_MS passed
+MICRO_TESTS_DEF int _micro_tests_bench_measure(const MicroTestsBenchSpec *spec,
+                                               MicroTestsBench *bench,
+                                               MicroTestsBenchResult *result);
+
+#ifdef MICRO_TESTS_MULTITHREADED
+
+// A thread of a benchmark with bench->thread_count > 1
+typedef struct {
+  // The benchmark
+  const MicroTestsBenchSpec *spec;
+  // State of this thread
+  MicroTestsBench bench;
+  // CPU where the thread is pinned, or -1
+  int cpu;
+  // Number of threads ready to start, atomic
+  int *ready;
+  // Set when the threads can start, atomic
+  int *go;
+} MicroTestsBenchThread;
+
+// Entry point of a MicroTestsBenchThread
+MICRO_TESTS_DEF void *_micro_tests_bench_thread(void *args);
+
+#endif // MICRO_TESTS_MULTITHREADED
+
+// Print the difference with the baseline, as " (+1.0%)"
+//
+// Args:
+//  - value: the measured value
+//  - baseline: the value in the baseline, 0 if unknown
+MICRO_TESTS_DEF void _micro_tests_bench_print_delta(double value,
+                                                    double baseline);
+
+// Least squares fit of timings to the complexity classes, as a
+// constant plus a multiple of the class
+//
+// Args:
+//  - n: the input sizes, increasing
+//  - ns: the nanoseconds per iteration at each size
+//  - count: number of sizes
+//  - intercept: set to the constant nanoseconds of the best class
+//  - coefficient: set to the nanoseconds per unit of the best class
+//  - errors: set to the root mean square error of each class,
+//    relative to the mean, _MICRO_TESTS_O_COUNT entries
+//
+// Returns: the lowest class that fits about as well as the best one
+//
+// Notes: From five sizes on, the smallest one is left out, its
+// timing is mostly the overhead of the call and of the caches
+MICRO_TESTS_DEF MicroTestsComplexity
+_micro_tests_bench_fit(const size_t *n, const double *ns, size_t count,
+                       double *intercept, double *coefficient,
+                       double *errors);
+
+// Name of a complexity class, like "O(n log n)"
+MICRO_TESTS_DEF const char*
+_micro_tests_complexity_name(MicroTestsComplexity complexity);
+
+// Value of a complexity class at an input size
+MICRO_TESTS_DEF double
+_micro_tests_complexity_value(MicroTestsComplexity complexity, double n);
+
+// Base 2 logarithm, without libm
+MICRO_TESTS_DEF double _micro_tests_log2(double x);
+
+// Square root, without libm
+MICRO_TESTS_DEF double _micro_tests_sqrt(double x);
+
+// Find a result in the baseline
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - key: name of the result, "suite.name/n", "suite.name/tN" for N
+//         threads or "suite.name/O"
+//
+// Returns: the values following the key, or NULL
+MICRO_TESTS_DEF const char*
+_micro_tests_bench_lookup(MicroTests *micro_tests, const char *key);
+
+#endif // MICRO_TESTS_BENCHMARK
+
+#ifdef MICRO_TESTS_ISOLATION
+
+// Map the shared result board, one slot for each MicroTest
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//
+// Returns: 0 on success, or a negative value on failure
+MICRO_TESTS_DEF int _micro_tests_board_open(MicroTests *micro_tests);
+
+// Unmap the shared result board
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+MICRO_TESTS_DEF void _micro_tests_board_close(MicroTests *micro_tests);
+
+// Execute a test in a forked process
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - test: the test to execute
+//
+// Returns: the outcome of the test, MICRO_TESTS_FAILED if the child
+// crashed before writing its slot
+//
+// Notes: Can be called by multiple threads. The child writes its
+// result directly into the board, the parent only waits for it.
+MICRO_TESTS_DEF MicroTestsStatus
+_micro_tests_exec_isolated(MicroTests *micro_tests, MicroTest *test);
+
+#endif // MICRO_TESTS_ISOLATION
+
+#ifdef MICRO_TESTS_CAPTURE
+
+// Redirect stdout and stderr to a file
+//
+// Args:
+//  - fd: the file
+//  - saved: set to copies of the redirected descriptors
+//
+// Returns: 0 on success, or a negative value on failure
+//
+// Notes: The streams are flushed before, so the previous output is
+// not captured
+MICRO_TESTS_DEF int _micro_tests_capture_redirect(int fd, int saved[2]);
+
+// Restore the stdout and stderr of _micro_tests_capture_redirect
+//
+// Args:
+//  - saved: the copies of the descriptors, closed
+MICRO_TESTS_DEF void _micro_tests_capture_restore(int saved[2]);
+
+// Print the output captured from the last test of the thread if it
+// failed, and discard it
+//
+// Args:
+//  - status: outcome of the test
+//
+// Notes: Called right after the test is reported, under the lock of
+// the reporters, so the output of a test is never split
+MICRO_TESTS_DEF void _micro_tests_capture_emit(MicroTestsStatus status);
+
+#endif // MICRO_TESTS_CAPTURE
+
+#ifdef MICRO_TESTS_PROFILE
+
+// A stack sampled by --profile
+typedef struct {
+  // Test running on the sampled thread
+  MicroTest *test;
+  // Number of frames
+  size_t depth;
+  // Program counters, from the innermost frame
+  void *pcs[MICRO_TESTS_PROFILE_MAX_DEPTH];
+} MicroTestsProfileSample;
+
+// A function of the symbol table of the executable
+typedef struct {
+  // Address where the function is loaded
+  uintptr_t address;
+  // Size in bytes of the function
+  size_t size;
+  // Name, in the mapped executable
+  const char *name;
+} MicroTestsProfileSymbol;
+
+// State of --profile
+typedef struct {
+  // Preallocated samples, filled by the signal handler
+  MicroTestsProfileSample *samples;
+  // Number of taken samples, can exceed
+  // MICRO_TESTS_PROFILE_MAX_SAMPLES when some were dropped
+  size_t count;
+  // Functions of the executable, sorted by address
+  MicroTestsProfileSymbol *symbols;
+  size_t symbol_count;
+  // Mapping of the executable, holding the names of the symbols
+  void *image;
+  size_t image_size;
+} MicroTestsProfile;
+
+// Allocate the samples and install the SIGPROF handler
+//
+// Returns: 0 on success, or a negative value on failure
+MICRO_TESTS_DEF int _micro_tests_profile_start(void);
+
+// Sample the calling thread until _micro_tests_profile_end
+//
+// Args:
+//  - test: the test about to run on this thread
+//  - frame: frame of the caller of the test, where the stacks stop
+//
+// Returns: 0 on success, or a negative value on failure
+MICRO_TESTS_DEF int _micro_tests_profile_begin(MicroTest *test, void *frame);
+
+// Stop sampling the calling thread
+MICRO_TESTS_DEF void _micro_tests_profile_end(void);
+
+// Take a sample of the interrupted thread, the SIGPROF handler
+//
+// Notes: Async-signal-safe, only reads the stack between the
+// interrupted stack pointer and the frame of _micro_tests_profile_begin
+MICRO_TESTS_DEF void _micro_tests_profile_handler(int signal, siginfo_t *info,
+                                                  void *context);
+
+// Load the function symbols of the executable, for the static
+// functions that dladdr can not name
+//
+// Returns: 0 on success, or a negative value on failure
+MICRO_TESTS_DEF int _micro_tests_profile_load_symbols(void);
+
+// Name of the function containing an address
+//
+// Args:
+//  - pc: the address
+//  - out: buffer for the name
+//  - size: size of the buffer
+MICRO_TESTS_DEF void _micro_tests_profile_symbol(void *pc, char *out,
+                                                 size_t size);
+
+// Write the samples as folded stacks, one line per distinct stack
+// as "suite.test;outer;...;inner count"
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//
+// Returns: 0 on success, or a negative value on failure
+MICRO_TESTS_DEF int _micro_tests_profile_write(MicroTests *micro_tests);
+
+#endif // MICRO_TESTS_PROFILE
+
+#ifdef MICRO_TESTS_ORCHESTRATOR
+
+// A test of an executable run by --orchestrate
+typedef struct {
+  // Record given to the reporter, with owned strings
+  MicroTest test;
+  // "suite.test"
+  char *name;
+  // Index of the executable in micro_tests->executables
+  size_t executable;
+  // Estimated or measured duration in seconds, negative if unknown
+  double seconds;
+  // Union-find parent, the tests linked by prerequisites share a root
+  size_t group;
+  // Whether the test is serial or uses resources, run alone
+  _Bool exclusive;
+  // Whether the test runs, selected or the prerequisite of one that is
+  _Bool selected;
+  // Whether the outcome of the test was reported
+  _Bool reported;
+} MicroTestsOrchestrated;
+
+// Tests of one executable run by a child process
+typedef struct {
+  size_t executable;
+  // Orchestrated tests of the batch, sorted by name
+  MicroTestsOrchestrated **tests;
+  size_t count;
+  // Estimated duration in seconds, or number of tests when no
+  // duration is known
+  double seconds;
+  // Whether the tests are exclusive, the batch then runs alone
+  _Bool exclusive;
+  // Whether all the tests of the batch are reported
+  _Bool done;
+  // During runtime, process running the batch, or 0
+  pid_t pid;
+  // During runtime, end of a pipe that the process holds until it
+  // exits
+  int exit_fd;
+  // During runtime, temporary files of the names of the tests, of the
+  // TAP output and of the durations
+  char *list_path;
+  char *output_path;
+  char *durations_path;
+} MicroTestsBatch;
+
+// Run the tests of micro_tests->executables in batches
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//
+// Returns: the number of failed tests, including the ones that
+// crashed their batch
+//
+// Notes: The tests are read from the manifests. Tests linked by
+// prerequisites stay in the same batch, and the serial ones and the
+// ones using resources run last, one batch at a time. The other
+// batches are sized from the --durations of the previous runs, or
+// by number of tests without them, into at least
+// MICRO_TESTS_ORCHESTRATOR_BATCHES_PER_JOB batches per job, and
+// started longest first on micro_tests->job_count processes, each running
+// "executable --reporter tap --test-file <list>". The outcomes are
+// reported as they arrive and the durations file is updated. The
+// test running when a batch crashed fails, and the tests after it
+// are queued again in the batch.
+MICRO_TESTS_DEF int _micro_tests_orchestrate(MicroTests *micro_tests);
+
+// Start a batch in a child process
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - batch: the batch
+//
+// Returns: 0 on success, or a negative value on failure
+MICRO_TESTS_DEF int _micro_tests_batch_start(MicroTests *micro_tests,
+                                             MicroTestsBatch *batch);
+
+// Report the outcomes of a finished batch and read its durations
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - batch: the batch
+//  - status: exit status of its process, or -1 if it did not start
+//
+// Returns: the number of failed tests
+//
+// Notes: If the process ended during a test, that test fails and the
+// batch keeps the tests without an outcome, to be started again.
+// Otherwise these tests fail and the batch is done.
+MICRO_TESTS_DEF int _micro_tests_batch_finish(MicroTests *micro_tests,
+                                              MicroTestsBatch *batch,
+                                              int status);
+
+#endif // MICRO_TESTS_ORCHESTRATOR
+
+#ifdef MICRO_TESTS_DISTRIBUTED
+
+// Version of the protocol between --coordinator and --worker
+#define MICRO_TESTS_PROTOCOL_VERSION 1
+
+// Messages between --coordinator and --worker
+//
+// Note: A message is the 32 bit big endian size of the rest, a byte
+// of type and its payload
+typedef enum {
+  // Worker to coordinator: 32 bit MICRO_TESTS_PROTOCOL_VERSION
+  MICRO_TESTS_MESSAGE_HELLO = 1,
+  // Coordinator to worker: "suite.test" names, one per line
+  MICRO_TESTS_MESSAGE_BATCH,
+  // Worker to coordinator: 32 bit position of the test in the batch,
+  // a byte of MicroTestsStatus and 64 bit duration in nanoseconds
+  MICRO_TESTS_MESSAGE_RESULT,
+  // Worker to coordinator: the batch is over, the tests that were not
+  // reported did not run
+  MICRO_TESTS_MESSAGE_BATCH_END,
+  // Coordinator to worker: no batches are left
+  MICRO_TESTS_MESSAGE_BYE,
+} MicroTestsMessageType;
+
+// A batch of --coordinator
+typedef struct {
+  // Indices of the tests, in the order sent
+  size_t *tests;
+  size_t count;
+  // Estimated duration in seconds
+  double seconds;
+  // Times the batch was handed out since one of its tests was reported
+  unsigned attempts;
+  // Whether the batch has serial tests or tests using resources, it
+  // then runs while no other batch runs
+  _Bool exclusive;
+  // Whether a worker runs the batch
+  _Bool running;
+  // Whether all the tests of the batch are reported
+  _Bool done;
+} MicroTestsRemoteBatch;
+
+// A worker connected to --coordinator
+typedef struct {
+  int fd;
+  // Received bytes of the messages not handled yet
+  unsigned char *buffer;
+  size_t length;
+  size_t capacity;
+  // Index of the batch of the worker, or SIZE_MAX if idle
+  size_t batch;
+  // Time of the last message or of the dispatch of the batch
+  double heard;
+  // Whether the worker said hello
+  _Bool ready;
+} MicroTestsRemoteWorker;
+
+// Send a message to the other end of a connection
+//
+// Args:
+//  - fd: the socket
+//  - type: MicroTestsMessageType of the message
+//  - payload: the payload
+//  - length: size of the payload in bytes
+//
+// Returns: 0 on success, or a negative value on failure
+MICRO_TESTS_DEF int _micro_tests_message_send(int fd,
+                                              MicroTestsMessageType type,
+                                              const void *payload,
+                                              size_t length);
+
+// Receive a message from the other end of a connection, blocking
+//
+// Args:
+//  - fd: the socket
+//  - buffer: buffer grown to hold the type, the payload and a null
+//    terminator
+//  - capacity: size of the buffer
+//  - length: set to the size of the payload, after the type
+//
+// Returns: the MicroTestsMessageType, or a negative value if the
+// connection was closed or the message is too big
+MICRO_TESTS_DEF int _micro_tests_message_recv(int fd, unsigned char **buffer,
+                                              size_t *capacity,
+                                              size_t *length);
+
+// Hand out the planned tests to the workers connecting to
+// micro_tests->coordinator_port and report their outcomes
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//
+// Returns: the number of failed tests
+//
+// Notes: The tests are split in batches of about
+// MICRO_TESTS_DISTRIBUTED_BATCH_MS, of at most
+// MICRO_TESTS_DISTRIBUTED_BATCH_TESTS, in the order of the plan.
+// Without any duration they are sized by number of tests into at
+// least MICRO_TESTS_DISTRIBUTED_MIN_BATCHES. The tests linked by
+// prerequisites are in the same batch, and the serial ones and the
+// ones using resources are in batches of their own that run while no
+// other batch runs. An idle worker gets the next queued batch. The
+// tests that a worker did not report, because one crashed, the worker
+// disconnected or did not report for MICRO_TESTS_DISTRIBUTED_TIMEOUT_S,
+// are queued again. The first of them fails once its batch was handed
+// out MICRO_TESTS_DISTRIBUTED_ATTEMPTS times without a result. The
+// tests left fail when no worker is connected for
+// MICRO_TESTS_DISTRIBUTED_CONNECT_S after the last one was lost.
+MICRO_TESTS_DEF int _micro_tests_coordinate(MicroTests *micro_tests);
+
+// Run the batches of the coordinator at micro_tests->worker_address,
+// each in a child process
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//
+// Returns: the number of failed tests, plus one if the coordinator
+// was lost
+MICRO_TESTS_DEF int _micro_tests_work(MicroTests *micro_tests);
+
+#endif // MICRO_TESTS_DISTRIBUTED
+
+#ifdef MICRO_TESTS_CACHE
+
+// Make the key of the results of --cache
+//
+// Args:
+//  - argc: number of arguments
+//  - argv: the arguments of the run
+//  - key: set to the key
+//
+// Returns: 0 on success, or a negative value if the executable or a
+// plugin has no build-id
+//
+// Notes: Hashes the NT_GNU_BUILD_ID notes of the executable and of
+// the loaded plugins, found with dl_iterate_phdr, and the arguments
+// other than --cache, --no-cache and the ones of the output
+MICRO_TESTS_DEF int _micro_tests_cache_key(int argc, char **argv,
+                                           uint64_t *key);
+
+// Skip the selected tests that passed with the same key
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - argc: number of arguments
+//  - argv: the arguments of the run
+//
+// Returns: 0 on success, or a negative value on failure
+//
+// Notes: The prerequisites of the tests that run are not skipped.
+// Nothing is skipped with --no-cache. Without build-ids the cache is
+// disabled with a warning.
+MICRO_TESTS_DEF int _micro_tests_cache_load(MicroTests *micro_tests,
+                                            int argc, char **argv);
+
+// Save the tests that passed in this run or were skipped
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//
+// Returns: 0 on success, or a negative value on failure
+MICRO_TESTS_DEF int _micro_tests_cache_save(MicroTests *micro_tests);
+
+#endif // MICRO_TESTS_CACHE
+
+#ifndef _MICRO_TESTS_REPORTER
+
+// Find a built-in reporter by name
+//
+// Args:
+//  - name: name of the reporter
+//
+// Returns: a pointer to the reporter, or NULL if not found
+MICRO_TESTS_DEF const MicroTestsReporter*
+micro_tests_find_reporter(const char *name);
+
+#endif // _MICRO_TESTS_REPORTER
+
+// Built-in reporters, see MicroTestsReporter for the events
+
+#if !defined(_MICRO_TESTS_REPORTER) || defined(MICRO_TESTS_REPORTER_CONSOLE)
+MICRO_TESTS_DEF void
+_micro_tests_console_on_run_start(MicroTests *micro_tests, size_t test_count);
+MICRO_TESTS_DEF void
+_micro_tests_console_on_test_start(MicroTests *micro_tests, MicroTest *test);
+MICRO_TESTS_DEF void
+_micro_tests_console_on_test_end(MicroTests *micro_tests, MicroTest *test,
+                                 MicroTestsStatus status);
+MICRO_TESTS_DEF void
+_micro_tests_console_on_run_end(MicroTests *micro_tests, int failed);
+#endif
+
+#if !defined(_MICRO_TESTS_REPORTER) || defined(MICRO_TESTS_REPORTER_TAP)
+MICRO_TESTS_DEF void
+_micro_tests_tap_on_run_start(MicroTests *micro_tests, size_t test_count);
+MICRO_TESTS_DEF void
+_micro_tests_tap_on_test_start(MicroTests *micro_tests, MicroTest *test);
+MICRO_TESTS_DEF void
+_micro_tests_tap_on_test_end(MicroTests *micro_tests, MicroTest *test,
+                             MicroTestsStatus status);
+MICRO_TESTS_DEF void
+_micro_tests_tap_on_run_end(MicroTests *micro_tests, int failed);
+#endif
+
+#if !defined(_MICRO_TESTS_REPORTER) || defined(MICRO_TESTS_REPORTER_JUNIT)
+// Print a string in an XML attribute value, escaping the markup
+//
+// Args:
+//  - out: the stream
+//  - text: the string
+//
+// Notes: The control characters that XML 1.0 does not allow are
+// replaced by '?'
+MICRO_TESTS_DEF void _micro_tests_print_xml(FILE *out, const char *text);
+
+MICRO_TESTS_DEF void
+_micro_tests_junit_on_run_start(MicroTests *micro_tests, size_t test_count);
+MICRO_TESTS_DEF void
+_micro_tests_junit_on_test_start(MicroTests *micro_tests, MicroTest *test);
+MICRO_TESTS_DEF void
+_micro_tests_junit_on_test_end(MicroTests *micro_tests, MicroTest *test,
+                               MicroTestsStatus status);
+MICRO_TESTS_DEF void
+_micro_tests_junit_on_run_end(MicroTests *micro_tests, int failed);
+#endif
+
+#if !defined(_MICRO_TESTS_REPORTER) || defined(MICRO_TESTS_REPORTER_JSON)
+// Print a string in a JSON string, escaping the quotes, the
+// backslashes and the control characters
+//
+// Args:
+//  - out: the stream
+//  - text: the string
+MICRO_TESTS_DEF void _micro_tests_print_json(FILE *out, const char *text);
+
+MICRO_TESTS_DEF void
+_micro_tests_json_on_run_start(MicroTests *micro_tests, size_t test_count);
+MICRO_TESTS_DEF void
+_micro_tests_json_on_test_start(MicroTests *micro_tests, MicroTest *test);
+MICRO_TESTS_DEF void
+_micro_tests_json_on_test_end(MicroTests *micro_tests, MicroTest *test,
+                              MicroTestsStatus status);
+MICRO_TESTS_DEF void
+_micro_tests_json_on_run_end(MicroTests *micro_tests, int failed);
+#endif
+
+#ifdef MICRO_TESTS_MULTITHREADED
+
+// Get the next MicroTest to run
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - thread_index: index of the calling thread
+//  - skip: set to 1 if the test should be skipped instead of run
+//
+// Returns: a pointer to a MicroTest, or NULL when no test is left
+//
+// Notes: Can be called by multiple threads. Follows the order of
+// the plan, skipping the tests that wait for a prerequisite or
+// conflict with the running ones. Waits only when none of the
+// remaining tests can start. Serial tests run last, one at a time.
+MICRO_TESTS_DEF MicroTest*
+_micro_tests_get_next_test(MicroTests *micro_tests, int thread_index,
+                           _Bool *skip);
+
+// Mark a test returned by _micro_tests_get_next_test as done
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - thread_index: index of the calling thread
+//  - status: outcome of the test
+//
+// Notes: Can be called by multiple threads
+MICRO_TESTS_DEF void _micro_tests_test_done(MicroTests *micro_tests,
+                                            int thread_index,
+                                            MicroTestsStatus status);
+
+// Check whether two tests can run at the same time
+//
+// Args:
+//  - a: the first test
+//  - b: the second test
+//
+// Returns: 1 if one of the tests is serial or they share a resource,
+// 0 otherwise
+MICRO_TESTS_DEF int _micro_tests_conflict(MicroTest *a, MicroTest *b);
+
+// Check whether two comma separated lists share a name
+//
+// Args:
+//  - a: the first list
+//  - b: the second list
+//
+// Returns: 1 if a name is in both lists, 0 otherwise
+MICRO_TESTS_DEF int _micro_tests_resources_overlap(const char *a,
+                                                   const char *b);
+
+// Arguments of a single test runner
+typedef struct {
+  MicroTests *micro_tests;
+  // Index of the thread, from 0 to thread_number - 1
+  int thread_index;
+  // Cleared by the thread when it exits
+  int alive;
+  // CPU time clock of the thread
+  clockid_t cpu_clock;
+  // CPU time of the thread at the last adjustment, in seconds
+  double cpu_time;
+} MicroTestsThread;
+
+// Start a test runner thread
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - threads: the threads
+//  - args: the arguments of the threads
+//  - index: index of the thread to start in threads and args
+//
+// Returns: 0 on success, or a negative value on failure
+MICRO_TESTS_DEF int _micro_tests_spawn_thread(MicroTests *micro_tests,
+                                              pthread_t *threads,
+                                              MicroTestsThread *args,
+                                              int index);
+
+// Run chunks of a job until none is left
+//
+// Args:
+//  - job: the job
+MICRO_TESTS_DEF void _micro_tests_job_run(MicroTestsJob *job);
+
+// Publish a job to the threads of the runner and run it
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - job: the job, initialized
+//
+// Notes: Returns once the job is done and no other thread uses it
+MICRO_TESTS_DEF void _micro_tests_job_publish(MicroTests *micro_tests,
+                                              MicroTestsJob *job);
+
+// Wait for a published job
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - job: the job
+//
+// Notes: Runs the chunks left first, returns once the job is done
+// and no other thread uses it
+MICRO_TESTS_DEF void _micro_tests_job_wait(MicroTests *micro_tests,
+                                           MicroTestsJob *job);
+
+// Help with a published job
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//
+// Returns: 1 if the thread worked on a job, 0 if there was none
+//
+// Notes: Call with current_test_index_mutex locked, the mutex is
+// released while running the job
+MICRO_TESTS_DEF int _micro_tests_job_help(MicroTests *micro_tests);
+
+// Number of CPUs the process can use
+//
+// Returns: the number of CPUs in the affinity mask, lowered to the
+// cgroup CPU quota when running in a container with a quota
+MICRO_TESTS_DEF int _micro_tests_cpu_count(void);
+
+// CPUs allowed by a cgroup CPU quota
+//
+// Args:
+//  - cpu_max: content of cpu.max of cgroup v2, "<quota> <period>" or
+//    "max <period>", or NULL to read the files of cgroup v1
+//  - cfs_quota: content of cpu.cfs_quota_us of cgroup v1, or NULL
+//  - cfs_period: content of cpu.cfs_period_us of cgroup v1, or NULL
+//
+// Returns: the quota rounded up to whole CPUs, or 0 without a quota
+MICRO_TESTS_DEF long long _micro_tests_cpu_quota(const char *cpu_max,
+                                                 const char *cfs_quota,
+                                                 const char *cfs_period);
+
+// Adjust the number of threads until all of them exit
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//  - threads: the threads, with room for thread_number of them
+//  - args: the arguments of the threads
+//  - spawned: number of threads already started, updated
+//
+// Notes: Every MICRO_TESTS_ADAPT_INTERVAL_MS compares the CPU time
+// used by the threads with the wall time. Mostly blocked threads
+// mean that more of them can run, while threads that keep more CPUs
+// busy than available are retired, half of the excess at a time.
+MICRO_TESTS_DEF void _micro_tests_adapt_threads(MicroTests *micro_tests,
+                                                pthread_t *threads,
+                                                MicroTestsThread *args,
+                                                int *spawned);
+
+// Decide how the threads change after an interval
+//
+// Args:
+//  - micro_tests: settings for the testing framework, its
+//    retire_count is raised by the threads to retire
+//  - live: number of live threads
+//  - busy: CPUs kept busy by the live threads during the interval
+//  - spawned: number of threads started so far
+//
+// Returns: the number of threads to add
+//
+// Notes: Call with current_test_index_mutex locked
+MICRO_TESTS_DEF int _micro_tests_adapt_step(MicroTests *micro_tests,
+                                            int live, double busy,
+                                            int spawned);
+
+// A single test runner
+//
+// Args:
+//  - args: pointer to a MicroTestsThread
+//
+// Returns: The number of failed tests, casted to a (void*)
+MICRO_TESTS_DEF void *_micro_tests_thread(void *args);
+
+// Run the tests with multiple threads
+//
+// Args:
+//  - micro_tests: settings for the testing framework
+//
+// Returns: The number of failed tests
+MICRO_TESTS_DEF int
+_micro_tests_run_multithreaded(MicroTests *micro_tests);
+
+#endif // MICRO_TESTS_MULTITHREADED
+
+//
+// Variables
+//
+
+// The registered tests, with the ones of the plugins
+typedef struct {
+  // Tests of the executable followed by the ones of the plugins, or
+  // NULL when no plugin is loaded
+  MicroTest *tests;
+  // Number of tests
+  size_t count;
+#ifdef MICRO_TESTS_PLUGINS
+  // Handles of the plugins, never closed since the tests point into
+  // them
+  void **plugins;
+  size_t plugin_count;
+#endif
+} MicroTestsRegistry;
+
+// Start of the micro tests section (exported by the linker)
+extern char __micro_tests_start[];
+// End of the micro tests section (exported by the linker)
+extern char __micro_tests_stop[];
+
+#ifdef MICRO_TESTS_GLOBALS_CHECK
+// Start of the .data section (defined by the C runtime)
+extern char __data_start[];
+// End of the .bss section (exported by the linker)
+extern char _end[];
+#endif
+
+#ifndef _MICRO_TESTS_REPORTER
+// Built-in reporters, terminated by an entry with a NULL name
+extern const MicroTestsReporter micro_tests_reporters[];
+#endif
+
+//
+// Implementation
+//
+
+#ifdef MICRO_TESTS_IMPLEMENTATION
+
+// Empty until a plugin is loaded, the tests are then copied here
+static MicroTestsRegistry _micro_tests_registry;
+
+#ifdef MICRO_TESTS_MULTITHREADED
+// Runner of the current --multithreaded run, for the jobs
+static MicroTests *_micro_tests_pool = NULL;
+#endif
+
+MICRO_TESTS_DEF MicroTest *_micro_tests_tests(void)
+{
+  if (_micro_tests_registry.tests != NULL)
+    return _micro_tests_registry.tests;
+  return (MicroTest*)__micro_tests_start;
+}
+
+MICRO_TESTS_DEF size_t _micro_tests_count(void)
+{
+  if (_micro_tests_registry.tests != NULL)
+    return _micro_tests_registry.count;
+  return (__micro_tests_stop - __micro_tests_start) / sizeof(MicroTest);
+}
+
+#ifdef MICRO_TESTS_PLUGINS
+
+MICRO_TESTS_DEF int micro_tests_load(const char *path)
+{
+  void *plugin = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (plugin == NULL)
+  {
+    fprintf(stderr, "Error: Could not load %s: %s\n", path, dlerror());
+    return -1;
+  }
+  for (size_t i = 0; i < _micro_tests_registry.plugin_count; ++i)
+    if (_micro_tests_registry.plugins[i] == plugin)
+    {
+      // Already loaded, dlopen counted one more reference
+      dlclose(plugin);
+      return 0;
+    }
+
+  // Looked up in the plugin and its dependencies only
+  char *start = dlsym(plugin, "__micro_tests_start");
+  char *stop = dlsym(plugin, "__micro_tests_stop");
+  if (start == NULL || stop == NULL || stop < start
+      || start == __micro_tests_start)
+  {
+    fprintf(stderr, "Error: No .micro_tests section in %s, link it with "
+            "micro-tests.ld\n", path);
+    dlclose(plugin);
+    return -1;
+  }
+
+  size_t count = _micro_tests_count();
+  size_t added = (stop - start) / sizeof(MicroTest);
+  MicroTest *tests = MICRO_TESTS_CALLOC(count + added > 0 ? count + added : 1,
+                                        sizeof(MicroTest));
+  void **plugins = MICRO_TESTS_CALLOC(_micro_tests_registry.plugin_count + 1,
+                                      sizeof(void*));
+  if (tests == NULL || plugins == NULL)
+  {
+    perror("calloc");
+    MICRO_TESTS_FREE(tests);
+    MICRO_TESTS_FREE(plugins);
+    dlclose(plugin);
+    return -1;
+  }
+  memcpy(tests, _micro_tests_tests(), count * sizeof(MicroTest));
+  memcpy(tests + count, start, added * sizeof(MicroTest));
+  if (_micro_tests_registry.plugin_count > 0)
+    memcpy(plugins, _micro_tests_registry.plugins,
+           _micro_tests_registry.plugin_count * sizeof(void*));
+  plugins[_micro_tests_registry.plugin_count] = plugin;
+
+  MICRO_TESTS_FREE(_micro_tests_registry.tests);
+  MICRO_TESTS_FREE(_micro_tests_registry.plugins);
+  _micro_tests_registry.tests = tests;
+  _micro_tests_registry.count = count + added;
+  _micro_tests_registry.plugins = plugins;
+  _micro_tests_registry.plugin_count++;
+  return 0;
+}
+
+#endif // MICRO_TESTS_PLUGINS
+
+MICRO_TESTS_DEF int _micro_tests_strcmp(const char* s1, const char *s2)
+{
+  while (*s2 != '\0' && *s1 != '\0')
+  {
+    if (*s1 != *s2)
+      return (*s1 > *s2) ? 1 : -1;
+    s1++; s2++;
+  }
+  return !(*s2 == '\0' && *s1 == '\0');
+}
+
+MICRO_TESTS_DEF int micro_tests_parse_args(MicroTests *micro_tests,
+                                           int argc, char **argv)
+{
+  // Default values
+  *micro_tests = (MicroTests){
+    .run_suite         = NULL,
+    .run_test          = NULL,
+#ifndef _MICRO_TESTS_REPORTER
+    .reporter          = &micro_tests_reporters[0],
+#endif
+    .reported_count    = 0,
+    .skipped_count     = 0,
+    .report_buffer     = NULL,
+    .report_text       = NULL,
+    .report_size       = 0,
+    .durations_file    = NULL,
+    .test_state        = NULL,
+    .durations         = NULL,
+    .order             = NULL,
+    .order_count       = 0,
+    .deps              = NULL,
+    .deps_start        = NULL,
+#ifdef MICRO_TESTS_MULTITHREADED
+    .run_multithreaded = 0,
+    .thread_number     = 4,
+    .adaptive_threads  = 0,
+#endif
+#ifdef MICRO_TESTS_GLOBALS_CHECK
+    .check_globals     = 0,
+#endif
+#ifdef MICRO_TESTS_BENCHMARK
+    .run_benchmarks     = 0,
+    .baseline_file      = NULL,
+    .save_baseline_file = NULL,
+    .baseline           = NULL,
+    .baseline_out       = NULL,
+    .force              = 0,
+#endif
+#ifdef MICRO_TESTS_CAPTURE
+    .capture            = 0,
+#endif
+#ifdef MICRO_TESTS_CACHE
+    .cache_dir          = NULL,
+    .no_cache           = 0,
+    .cache_file         = NULL,
+    .cached             = NULL,
+#endif
+#ifdef MICRO_TESTS_PROFILE
+    .profile_file       = NULL,
+#endif
+#ifndef MICRO_TESTS_NO_MANIFEST
+    .manifest_file     = NULL,
+#endif
+    .test_file         = NULL,
+    .selection         = NULL,
+#ifdef MICRO_TESTS_DISTRIBUTED
+    .coordinator_port  = NULL,
+    .worker_address    = NULL,
+#endif
+#ifdef MICRO_TESTS_ORCHESTRATOR
+    .executables       = NULL,
+    .executable_count  = 0,
+    .job_count         = 0,
+#endif
+#ifdef MICRO_TESTS_ISOLATION
+    .run_isolated      = 0,
+    .board             = NULL,
+#endif
+    .show_list         = 0,
+    .print_banner      = 1,
+    .print_help        = 0,
+    .debug             = 0,
+    .quiet             = 0,
+  };
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (_micro_tests_strcmp(argv[i], "--help") == 0
+        || _micro_tests_strcmp(argv[i], "-h") == 0)
+    {
+      micro_tests->print_help = 1;
+    } else if (_micro_tests_strcmp(argv[i], "--list") == 0)
+    {
+      micro_tests->show_list = 1;
+    } else if (_micro_tests_strcmp(argv[i], "--test-file") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --test-file <file>\n");
+        return -1;
+      }
+      micro_tests->test_file = argv[++i];
+#ifdef MICRO_TESTS_DISTRIBUTED
+    } else if (_micro_tests_strcmp(argv[i], "--coordinator") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --coordinator <port>\n");
+        return -1;
+      }
+      micro_tests->coordinator_port = argv[++i];
+    } else if (_micro_tests_strcmp(argv[i], "--worker") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --worker <host:port>\n");
+        return -1;
+      }
+      micro_tests->worker_address = argv[++i];
+#endif // MICRO_TESTS_DISTRIBUTED
+#ifdef MICRO_TESTS_ORCHESTRATOR
+    } else if (_micro_tests_strcmp(argv[i], "--orchestrate") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --orchestrate <executable>\n");
+        return -1;
+      }
+      const char **executables =
+        MICRO_TESTS_CALLOC(micro_tests->executable_count + 1, sizeof(char*));
+      if (executables == NULL)
+        return -1;
+      if (micro_tests->executable_count > 0)
+        memcpy(executables, micro_tests->executables,
+               micro_tests->executable_count * sizeof(char*));
+      executables[micro_tests->executable_count++] = argv[++i];
+      MICRO_TESTS_FREE(micro_tests->executables);
+      micro_tests->executables = executables;
+    } else if (_micro_tests_strcmp(argv[i], "--jobs") == 0)
+    {
+      if (i + 1 >= argc || (micro_tests->job_count = atoi(argv[i + 1])) <= 0)
+      {
+        fprintf(stderr, "Usage: --jobs <n>\n");
+        return -1;
+      }
+      i++;
+#endif // MICRO_TESTS_ORCHESTRATOR
+#ifdef MICRO_TESTS_PLUGINS
+    } else if (_micro_tests_strcmp(argv[i], "--load") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --load <library>\n");
+        return -1;
+      }
+      if (micro_tests_load(argv[++i]) < 0)
+        return -1;
+#endif // MICRO_TESTS_PLUGINS
+#ifndef MICRO_TESTS_NO_MANIFEST
+    } else if (_micro_tests_strcmp(argv[i], "--manifest") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --manifest <executable>\n");
+        return -1;
+      }
+      micro_tests->manifest_file = argv[++i];
+#endif // MICRO_TESTS_NO_MANIFEST
+    } else if (_micro_tests_strcmp(argv[i], "--suite") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --suite <suite-name>\n");
+        return -1;
+      }
+      micro_tests->run_suite = argv[++i];
+    } else if (_micro_tests_strcmp(argv[i], "--test") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --test <test-name>\n");
+        return -1;
+      }
+      micro_tests->run_test = argv[++i];
+    } else if (_micro_tests_strcmp(argv[i], "--durations") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --durations <file>\n");
+        return -1;
+      }
+      micro_tests->durations_file = argv[++i];
+#ifndef _MICRO_TESTS_REPORTER
+    } else if (_micro_tests_strcmp(argv[i], "--reporter") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --reporter <console|tap|junit|json>\n");
+        return -1;
+      }
+      micro_tests->reporter = micro_tests_find_reporter(argv[++i]);
+      if (micro_tests->reporter == NULL)
+      {
+        fprintf(stderr, "Error: Unknown reporter %s\n", argv[i]);
+        return -1;
+      }
+#endif // _MICRO_TESTS_REPORTER
+    } else if (_micro_tests_strcmp(argv[i], "--no-banner") == 0)
+    {
+      micro_tests->print_banner = 0;
+    } else if (_micro_tests_strcmp(argv[i], "--debug") == 0)
+    {
+      micro_tests->debug = 1;
+    } else if (_micro_tests_strcmp(argv[i], "--quiet") == 0)
+    {
+      micro_tests->quiet = 1;
+#ifdef MICRO_TESTS_MULTITHREADED
+    } else if (_micro_tests_strcmp(argv[i], "--multithreaded") == 0)
+    {
+      micro_tests->run_multithreaded = 1;
+    } else if (_micro_tests_strcmp(argv[i], "--threads") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --threads <n>\n");
+        return -1;
+      }
+      if (_micro_tests_strcmp(argv[++i], "auto") == 0)
+      {
+        micro_tests->adaptive_threads = 1;
+        continue;
+      }
+      micro_tests->adaptive_threads = 0;
+      micro_tests->thread_number = atoi(argv[i]);
+      if (micro_tests->thread_number <= 0)
+      {
+        fprintf(stderr,
+                "Error: Thread number %s must be an integer and positive number",
+                argv[i]);
+        return -1;
+      }
+#endif // MICRO_TESTS_MULTITHREADED
+#ifdef MICRO_TESTS_GLOBALS_CHECK
+    } else if (_micro_tests_strcmp(argv[i], "--check-globals") == 0)
+    {
+      micro_tests->check_globals = 1;
+#endif // MICRO_TESTS_GLOBALS_CHECK
+#ifdef MICRO_TESTS_BENCHMARK
+    } else if (_micro_tests_strcmp(argv[i], "--bench") == 0)
+    {
+      micro_tests->run_benchmarks = 1;
+    } else if (_micro_tests_strcmp(argv[i], "--baseline") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --baseline <file>\n");
+        return -1;
+      }
+      micro_tests->baseline_file = argv[++i];
+    } else if (_micro_tests_strcmp(argv[i], "--save-baseline") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --save-baseline <file>\n");
+        return -1;
+      }
+      micro_tests->save_baseline_file = argv[++i];
+    } else if (_micro_tests_strcmp(argv[i], "--force") == 0)
+    {
+      micro_tests->force = 1;
+#endif // MICRO_TESTS_BENCHMARK
+#ifdef MICRO_TESTS_CAPTURE
+    } else if (_micro_tests_strcmp(argv[i], "--capture") == 0)
+    {
+      micro_tests->capture = 1;
+#endif // MICRO_TESTS_CAPTURE
+#ifdef MICRO_TESTS_CACHE
+    } else if (_micro_tests_strcmp(argv[i], "--cache") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --cache <dir>\n");
+        return -1;
+      }
+      micro_tests->cache_dir = argv[++i];
+    } else if (_micro_tests_strcmp(argv[i], "--no-cache") == 0)
+    {
+      micro_tests->no_cache = 1;
+#endif // MICRO_TESTS_CACHE
+#ifdef MICRO_TESTS_PROFILE
+    } else if (_micro_tests_strcmp(argv[i], "--profile") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "Usage: --profile <file>\n");
+        return -1;
+      }
+      micro_tests->profile_file = argv[++i];
+#endif // MICRO_TESTS_PROFILE
+#ifdef MICRO_TESTS_ISOLATION
+    } else if (_micro_tests_strcmp(argv[i], "--isolated") == 0)
+    {
+      micro_tests->run_isolated = 1;
+#endif // MICRO_TESTS_ISOLATION
+    } else {
+      printf("Unrecognized argument: %s\n", argv[i]);
+      printf("Try --help or -h\n");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+MICRO_TESTS_DEF int _micro_tests_is_runnable(MicroTests *micro_tests,
+                                             MicroTest *test)
+{
+  if (test->marker != 0xDeadBeaf)
+    return 0;
+#ifdef MICRO_TESTS_BENCHMARK
+  if (!(test->flags & MICRO_TESTS_FLAG_BENCHMARK) != !micro_tests->run_benchmarks)
+    return 0;
+#else
+  (void) micro_tests;
+  if (test->flags & MICRO_TESTS_FLAG_BENCHMARK)
+    return 0;
+#endif
+  return 1;
+}
+
+MICRO_TESTS_DEF int _micro_tests_is_selected(MicroTests *micro_tests,
+                                             MicroTest *test)
+{
+  if (!_micro_tests_is_runnable(micro_tests, test))
+    return 0;
+  if (micro_tests->run_suite != NULL &&
+      _micro_tests_strcmp(micro_tests->run_suite, test->test_suite) != 0)
+    return 0;
+  if (micro_tests->run_test != NULL &&
+      _micro_tests_strcmp(micro_tests->run_test, test->test_name) != 0)
+    return 0;
+  if (micro_tests->selection != NULL
+      && !micro_tests->selection[test - _micro_tests_tests()])
+    return 0;
+#ifdef MICRO_TESTS_CACHE
+  if (micro_tests->cached != NULL
+      && micro_tests->cached[test - _micro_tests_tests()])
+    return 0;
+#endif
+  return 1;
+}
+
+// A name of a list of tests, with its position
+typedef struct {
+  const char *name;
+  size_t position;
+} _MicroTestsListed;
+
+static int _micro_tests_listed_compare(const void *a, const void *b)
+{
+  return strcmp(((const _MicroTestsListed*)a)->name,
+                ((const _MicroTestsListed*)b)->name);
+}
+
+MICRO_TESTS_DEF int _micro_tests_select_from_file(MicroTests *micro_tests)
+{
+  FILE *file = fopen(micro_tests->test_file, "r");
+  if (file == NULL)
+  {
+    perror(micro_tests->test_file);
+    return -1;
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char *content = MICRO_TESTS_CALLOC(size > 0 ? size + 1 : 1, 1);
+  if (content != NULL && size > 0)
+    content[fread(content, 1, size, file)] = '\0';
+  fclose(file);
+  int ret = (content != NULL) ? _micro_tests_select(micro_tests, content) : -1;
+  MICRO_TESTS_FREE(content);
+  return ret;
+}
+
+MICRO_TESTS_DEF int _micro_tests_select(MicroTests *micro_tests, char *list)
+{
+  size_t lines = 1;
+  for (const char *it = list; *it != '\0'; ++it)
+    lines += (*it == '\n');
+  size_t count = _micro_tests_count();
+  MICRO_TESTS_FREE(micro_tests->selection);
+  micro_tests->selection = MICRO_TESTS_CALLOC(count > 0 ? count : 1,
+                                              sizeof(size_t));
+  _MicroTestsListed *names = MICRO_TESTS_CALLOC(lines, sizeof(_MicroTestsListed));
+  if (micro_tests->selection == NULL || names == NULL)
+  {
+    MICRO_TESTS_FREE(names);
+    return -1;
+  }
+
+  // Sorted names, looked up by the name of each registered test
+  size_t name_count = 0;
+  for (char *line = list; *line != '\0';)
+  {
+    char *end = strchr(line, '\n');
+    if (end != NULL)
+      *end = '\0';
+    if (*line != '\0')
+    {
+      names[name_count].name = line;
+      names[name_count].position = name_count;
+      name_count++;
+    }
+    if (end == NULL)
+      break;
+    line = end + 1;
+  }
+  qsort(names, name_count, sizeof(_MicroTestsListed),
+        _micro_tests_listed_compare);
+
+  MicroTest *test = _micro_tests_tests();
+  char name[512];
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (test[i].marker != 0xDeadBeaf)
+      continue;
+    snprintf(name, sizeof(name), "%s.%s", test[i].test_suite,
+             test[i].test_name);
+    _MicroTestsListed key = { .name = name };
+    _MicroTestsListed *found = bsearch(&key, names, name_count,
+                                       sizeof(_MicroTestsListed),
+                                       _micro_tests_listed_compare);
+    micro_tests->selection[i] = (found != NULL) ? found->position + 1 : 0;
+  }
+  MICRO_TESTS_FREE(names);
+  return 0;
+}
+
+#ifdef MICRO_TESTS_CAPTURE
+
+// Memory file of the output of the test running on this thread, or -1
+static __thread int _micro_tests_capture_fd = -1;
+
+MICRO_TESTS_DEF int _micro_tests_capture_redirect(int fd, int saved[2])
+{
+  fflush(stdout);
+  fflush(stderr);
+  saved[0] = dup(STDOUT_FILENO);
+  saved[1] = dup(STDERR_FILENO);
+  if (saved[0] < 0 || saved[1] < 0
+      || dup2(fd, STDOUT_FILENO) < 0 || dup2(fd, STDERR_FILENO) < 0)
+  {
+    _micro_tests_capture_restore(saved);
+    return -1;
+  }
+  return 0;
+}
+
+MICRO_TESTS_DEF void _micro_tests_capture_restore(int saved[2])
+{
+  fflush(stdout);
+  fflush(stderr);
+  if (saved[0] >= 0)
+  {
+    dup2(saved[0], STDOUT_FILENO);
+    close(saved[0]);
+  }
+  if (saved[1] >= 0)
+  {
+    dup2(saved[1], STDERR_FILENO);
+    close(saved[1]);
+  }
+}
+
+MICRO_TESTS_DEF void _micro_tests_capture_emit(MicroTestsStatus status)
+{
+  int fd = _micro_tests_capture_fd;
+  if (fd < 0)
+    return;
+  _micro_tests_capture_fd = -1;
+
+  if (status == MICRO_TESTS_FAILED)
+  {
+    // After the line of the reporter, the FAILED line of the console
+    // is on stderr and the TAP reporter flushes its lines
+    fflush(stderr);
+    char buffer[4096];
+    ssize_t length;
+    off_t offset = 0;
+    char last = '\n';
+    while ((length = pread(fd, buffer, sizeof(buffer), offset)) > 0)
+    {
+      offset += length;
+      last = buffer[length - 1];
+      for (ssize_t written = 0, n; written < length; written += n)
+        if ((n = write(STDERR_FILENO, buffer + written, length - written)) <= 0)
+          break;
+    }
+    if (last != '\n')
+      (void) !write(STDERR_FILENO, "\n", 1);
+  }
+  close(fd);
+}
+
+#endif // MICRO_TESTS_CAPTURE
+
+MICRO_TESTS_DEF MicroTestsStatus _micro_tests_exec(MicroTests *micro_tests,
+                                                   MicroTest *test)
+{
+#ifdef MICRO_TESTS_CAPTURE
+  if (micro_tests->capture)
+  {
+    // Discard the output of a test that was not reported
+    _micro_tests_capture_emit(MICRO_TESTS_OK);
+    _micro_tests_capture_fd = memfd_create("micro-tests-capture", MFD_CLOEXEC);
+  }
+#endif
+#ifdef MICRO_TESTS_ISOLATION
+  if (micro_tests->run_isolated)
+    return _micro_tests_exec_isolated(micro_tests, test);
+#else
+  (void) micro_tests;
+#endif
+
+#ifdef MICRO_TESTS_CAPTURE
+  int saved[2];
+  _Bool captured = _micro_tests_capture_fd >= 0
+    && _micro_tests_capture_redirect(_micro_tests_capture_fd, saved) == 0;
+#endif
+#ifdef MICRO_TESTS_PROFILE
+  // The samples stop at the frame of this function
+  _Bool profiled = micro_tests->profile_file != NULL
+    && _micro_tests_profile_begin(test, __builtin_frame_address(0)) == 0;
+#endif
+  int ret = test->function_pointer();       // Execute the test.
+#ifdef MICRO_TESTS_PROFILE
+  if (profiled)
+    _micro_tests_profile_end();
+#endif
+#ifdef MICRO_TESTS_CAPTURE
+  if (captured)
+    _micro_tests_capture_restore(saved);
+#endif
+  return (ret < 0) ? MICRO_TESTS_FAILED : MICRO_TESTS_OK;
+}
+
+#ifdef MICRO_TESTS_ISOLATION
+
+MICRO_TESTS_DEF int _micro_tests_board_open(MicroTests *micro_tests)
+{
+  size_t count = _micro_tests_count();
+  size_t size = (count > 0 ? count : 1) * sizeof(MicroTestsSlot);
+
+  void *board = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (board == MAP_FAILED)
+  {
+    perror("mmap");
+    return -1;
+  }
+  micro_tests->board = (MicroTestsSlot*) board;
+  return 0;
+}
+
+MICRO_TESTS_DEF void _micro_tests_board_close(MicroTests *micro_tests)
+{
+  size_t count = _micro_tests_count();
+  size_t size = (count > 0 ? count : 1) * sizeof(MicroTestsSlot);
+
+  munmap(micro_tests->board, size);
+  micro_tests->board = NULL;
+}
+
+MICRO_TESTS_DEF MicroTestsStatus
+_micro_tests_exec_isolated(MicroTests *micro_tests, MicroTest *test)
+{
+  MicroTestsSlot *slot =
+    &micro_tests->board[test - _micro_tests_tests()];
+  slot->result = 0;
+  __atomic_store_n(&slot->state, MICRO_TESTS_SLOT_RUNNING, __ATOMIC_RELAXED);
+
+  // Flush so that the child does not write buffered output twice, and
+  // keep the reporters out of stdio while forking so that the child
+  // does not inherit a locked stream
+#ifdef MICRO_TESTS_MULTITHREADED
+  if (micro_tests->run_multithreaded)
+    pthread_mutex_lock(&micro_tests->reporter_mutex);
+#endif
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+#ifdef MICRO_TESTS_MULTITHREADED
+  if (micro_tests->run_multithreaded)
+    pthread_mutex_unlock(&micro_tests->reporter_mutex);
+#endif
+
+  if (pid < 0)
+  {
+    perror("fork");
+    return MICRO_TESTS_FAILED;
+  }
+  if (pid == 0)
+  {
+#ifdef MICRO_TESTS_MULTITHREADED
+    // The other threads of the runner are not in the child, and one
+    // of them may hold the mutex of the pool: run the jobs here
+    _micro_tests_pool = NULL;
+#endif
+#ifdef MICRO_TESTS_CAPTURE
+    if (_micro_tests_capture_fd >= 0)
+    {
+      dup2(_micro_tests_capture_fd, STDOUT_FILENO);
+      dup2(_micro_tests_capture_fd, STDERR_FILENO);
+    }
+#endif
+    slot->result = test->function_pointer();       // Execute the test.
+    __atomic_store_n(&slot->state, MICRO_TESTS_SLOT_DONE, __ATOMIC_RELEASE);
+    fflush(NULL);
+    _exit(0);
+  }
+
+  int wstatus;
+  while (waitpid(pid, &wstatus, 0) < 0)
+  {
+    if (errno != EINTR)
+    {
+      perror("waitpid");
+      return MICRO_TESTS_FAILED;
+    }
+  }
+
+  if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) == MICRO_TESTS_SLOT_DONE)
+    return (slot->result < 0) ? MICRO_TESTS_FAILED : MICRO_TESTS_OK;
+
+  if (WIFSIGNALED(wstatus))
+    fprintf(stderr, "error: %s:%u: test %s crashed with signal %d\n",
+            test->file_name, (unsigned) test->line_number,
+            test->function_name, WTERMSIG(wstatus));
+  else
+    fprintf(stderr, "error: %s:%u: test %s exited with status %d\n",
+            test->file_name, (unsigned) test->line_number,
+            test->function_name, WEXITSTATUS(wstatus));
+  return MICRO_TESTS_FAILED;
+}
+
+#endif // MICRO_TESTS_ISOLATION
+
+MICRO_TESTS_DEF double _micro_tests_time(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+MICRO_TESTS_DEF long _micro_tests_find_test(const char *name, size_t len,
+                                            const char *default_suite)
+{
+  size_t count = _micro_tests_count();
+  MicroTest* test = _micro_tests_tests();
+
+  const char *dot = memchr(name, '.', len);
+  const char *suite = (dot != NULL) ? name : default_suite;
+  size_t suite_len = (dot != NULL) ? (size_t)(dot - name) : strlen(default_suite);
+  const char *test_name = (dot != NULL) ? dot + 1 : name;
+  size_t test_name_len = len - (size_t)(test_name - name);
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (test[i].marker != 0xDeadBeaf)
+      continue;
+    if (strncmp(test[i].test_suite, suite, suite_len) == 0
+        && test[i].test_suite[suite_len] == '\0'
+        && strncmp(test[i].test_name, test_name, test_name_len) == 0
+        && test[i].test_name[test_name_len] == '\0')
+      return (long)i;
+  }
+  return -1;
+}
+
+MICRO_TESTS_DEF void _micro_tests_load_durations(MicroTests *micro_tests)
+{
+  FILE *file = fopen(micro_tests->durations_file, "r");
+  if (file == NULL)
+    return;
+
+  char name[512];
+  double seconds;
+  while (fscanf(file, "%511s %lf", name, &seconds) == 2)
+  {
+    long index = _micro_tests_find_test(name, strlen(name), "");
+    if (index >= 0)
+      micro_tests->durations[index] = seconds;
+  }
+  fclose(file);
+}
+
+MICRO_TESTS_DEF void _micro_tests_save_durations(MicroTests *micro_tests)
+{
+  size_t count = _micro_tests_count();
+  MicroTest* test = _micro_tests_tests();
+
+  FILE *file = fopen(micro_tests->durations_file, "w");
+  if (file == NULL)
+  {
+    perror(micro_tests->durations_file);
+    return;
+  }
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (test[i].marker == 0xDeadBeaf && micro_tests->durations[i] >= 0)
+      fprintf(file, "%s.%s %.9f\n", test[i].test_suite, test[i].test_name,
+              micro_tests->durations[i]);
+  }
+  fclose(file);
+}
+
+typedef struct {
+  double priority;
+  size_t index;
+} _MicroTestsRank;
+
+static int _micro_tests_rank_compare(const void *a, const void *b)
+{
+  const _MicroTestsRank *ra = a, *rb = b;
+  if (ra->priority != rb->priority)
+    return (ra->priority > rb->priority) ? -1 : 1;
+  return (ra->index > rb->index) - (ra->index < rb->index);
+}
+
+MICRO_TESTS_DEF int _micro_tests_plan(MicroTests *micro_tests)
+{
+  size_t count = _micro_tests_count();
+  MicroTest* test = _micro_tests_tests();
+  size_t n = (count > 0) ? count : 1;
+
+  micro_tests->test_state  = MICRO_TESTS_CALLOC(n, 1);
+  micro_tests->durations   = MICRO_TESTS_CALLOC(n, sizeof(double));
+  micro_tests->order       = MICRO_TESTS_CALLOC(n, sizeof(size_t));
+  micro_tests->deps_start  = MICRO_TESTS_CALLOC(count + 1, sizeof(size_t));
+  micro_tests->order_count = 0;
+  // Temporary: dependents graph, ranks and the topological order
+  size_t *rdeps_start = MICRO_TESTS_CALLOC(count + 1, sizeof(size_t));
+  size_t *pending     = MICRO_TESTS_CALLOC(n, sizeof(size_t));
+  size_t *topo        = MICRO_TESTS_CALLOC(n, sizeof(size_t));
+  double *longest     = MICRO_TESTS_CALLOC(n, sizeof(double));
+  _MicroTestsRank *ranks = MICRO_TESTS_CALLOC(n, sizeof(_MicroTestsRank));
+
+  // Count the prerequisites, each separated by a comma
+  size_t deps_count = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    micro_tests->deps_start[i] = deps_count;
+    if (test[i].marker != 0xDeadBeaf || test[i].depends == NULL)
+      continue;
+    for (const char *it = test[i].depends; *it != '\0'; ++it)
+      deps_count += (*it == ',');
+    deps_count += (test[i].depends[0] != '\0');
+  }
+  micro_tests->deps_start[count] = deps_count;
+  micro_tests->deps = MICRO_TESTS_CALLOC(deps_count > 0 ? deps_count : 1,
+                                         sizeof(size_t));
+  size_t *rdeps = MICRO_TESTS_CALLOC(deps_count > 0 ? deps_count : 1,
+                                     sizeof(size_t));
+
+  if (micro_tests->test_state == NULL || micro_tests->durations == NULL
+      || micro_tests->order == NULL || micro_tests->deps_start == NULL
+      || micro_tests->deps == NULL || rdeps_start == NULL || rdeps == NULL
+      || pending == NULL || topo == NULL || longest == NULL || ranks == NULL)
+  {
+    fprintf(stderr, "Error: could not allocate the scheduling state\n");
+    MICRO_TESTS_FREE(rdeps);
+    MICRO_TESTS_FREE(rdeps_start);
+    MICRO_TESTS_FREE(pending);
+    MICRO_TESTS_FREE(topo);
+    MICRO_TESTS_FREE(longest);
+    MICRO_TESTS_FREE(ranks);
+    _micro_tests_plan_free(micro_tests);
+    return -1;
+  }
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    micro_tests->durations[i] = -1;
+    // Tests that do not run count as done for their dependents
+    micro_tests->test_state[i] = _micro_tests_is_selected(micro_tests, &test[i])
+      ? MICRO_TESTS_SCHED_PENDING : MICRO_TESTS_SCHED_DONE;
+  }
+  if (micro_tests->durations_file != NULL)
+    _micro_tests_load_durations(micro_tests);
+
+  // Resolve the prerequisites, the unknown ones and the ones that are
+  // not runnable are marked with count
+  for (size_t i = 0; i < count; ++i)
+  {
+    const char *it = test[i].depends;
+    size_t d = micro_tests->deps_start[i];
+    while (d < micro_tests->deps_start[i + 1])
+    {
+      size_t len = strcspn(it, ",");
+      long index = _micro_tests_find_test(it, len, test[i].test_suite);
+      if (index >= 0 && !_micro_tests_is_runnable(micro_tests, &test[index]))
+        index = -1;
+      micro_tests->deps[d++] = (index >= 0) ? (size_t)index : count;
+      it += len + (it[len] == ',');
+    }
+  }
+
+  // The prerequisites of the selected tests run too, even if they are
+  // not selected themselves
+  size_t top = 0;
+  for (size_t i = 0; i < count; ++i)
+    if (micro_tests->test_state[i] == MICRO_TESTS_SCHED_PENDING)
+      topo[top++] = i;
+  while (top > 0)
+  {
+    size_t i = topo[--top];
+    for (size_t d = micro_tests->deps_start[i]; d < micro_tests->deps_start[i + 1]; ++d)
+    {
+      size_t dep = micro_tests->deps[d];
+      if (dep < count && micro_tests->test_state[dep] == MICRO_TESTS_SCHED_DONE)
+      {
+        micro_tests->test_state[dep] = MICRO_TESTS_SCHED_PENDING;
+        topo[top++] = dep;
+      }
+    }
+  }
+
+  // The tests that run with an unknown prerequisite are skipped, the
+  // prerequisite then points to the test itself
+  for (size_t i = 0; i < count; ++i)
+  {
+    const char *it = test[i].depends;
+    for (size_t d = micro_tests->deps_start[i]; d < micro_tests->deps_start[i + 1]; ++d)
+    {
+      size_t len = strcspn(it, ",");
+      if (micro_tests->deps[d] == count)
+      {
+        if (micro_tests->test_state[i] != MICRO_TESTS_SCHED_DONE)
+        {
+          fprintf(stderr, "error: %s:%u: test %s depends on unknown test %.*s\n",
+                  test[i].file_name, (unsigned) test[i].line_number,
+                  test[i].function_name, (int)len, it);
+          micro_tests->test_state[i] = MICRO_TESTS_SCHED_BROKEN;
+        }
+        micro_tests->deps[d] = i;
+      }
+      it += len + (it[len] == ',');
+    }
+  }
+
+  // Dependents of each test, and prerequisites left for each test,
+  // counting only the edges between selected tests
+  for (size_t d = 0; d < deps_count; ++d)
+    rdeps_start[micro_tests->deps[d] + 1]++;
+  for (size_t i = 0; i < count; ++i)
+    rdeps_start[i + 1] += rdeps_start[i];
+  for (size_t i = 0; i < count; ++i)
+  {
+    for (size_t d = micro_tests->deps_start[i]; d < micro_tests->deps_start[i + 1]; ++d)
+    {
+      size_t dep = micro_tests->deps[d];
+      rdeps[rdeps_start[dep]++] = i;
+      if (dep != i && micro_tests->test_state[dep] != MICRO_TESTS_SCHED_DONE)
+        pending[i]++;
+    }
+  }
+  for (size_t i = count; i > 0; --i)
+    rdeps_start[i] = rdeps_start[i - 1];
+  rdeps_start[0] = 0;
+
+  // Topological order of the selected tests
+  size_t topo_count = 0, known = 0;
+  double known_sum = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (micro_tests->test_state[i] == MICRO_TESTS_SCHED_DONE)
+      continue;
+    if (pending[i] == 0)
+      topo[topo_count++] = i;
+    if (micro_tests->durations[i] >= 0)
+    {
+      known++;
+      known_sum += micro_tests->durations[i];
+    }
+  }
+  for (size_t t = 0; t < topo_count; ++t)
+  {
+    size_t i = topo[t];
+    for (size_t r = rdeps_start[i]; r < rdeps_start[i + 1]; ++r)
+      if (rdeps[r] != i && --pending[rdeps[r]] == 0)
+        topo[topo_count++] = rdeps[r];
+  }
+
+  // Longest duration from each test to the end of the graph, tests
+  // without a recorded duration count as the average one
+  double fallback = (known > 0) ? known_sum / (double)known : 1.0;
+  for (size_t t = topo_count; t > 0; --t)
+  {
+    size_t i = topo[t - 1];
+    double duration = (micro_tests->durations[i] >= 0)
+      ? micro_tests->durations[i] : fallback;
+    // Keep prerequisites strictly before their dependents
+    if (duration < 1e-9)
+      duration = 1e-9;
+    double tail = 0;
+    for (size_t r = rdeps_start[i]; r < rdeps_start[i + 1]; ++r)
+      if (rdeps[r] != i && longest[rdeps[r]] > tail
+          && micro_tests->test_state[rdeps[r]] != MICRO_TESTS_SCHED_DONE)
+        tail = longest[rdeps[r]];
+    longest[i] = duration + tail;
+  }
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (micro_tests->test_state[i] == MICRO_TESTS_SCHED_DONE)
+      continue;
+    if (pending[i] > 0)
+    {
+      fprintf(stderr, "error: %s:%u: test %s is part of a dependency cycle\n",
+              test[i].file_name, (unsigned) test[i].line_number,
+              test[i].function_name);
+      micro_tests->test_state[i] = MICRO_TESTS_SCHED_BROKEN;
+    }
+    ranks[micro_tests->order_count++] = (_MicroTestsRank){
+      .priority = longest[i],
+      .index    = i,
+    };
+  }
+  qsort(ranks, micro_tests->order_count, sizeof(_MicroTestsRank),
+        _micro_tests_rank_compare);
+  for (size_t i = 0; i < micro_tests->order_count; ++i)
+    micro_tests->order[i] = ranks[i].index;
+
+  MICRO_TESTS_FREE(rdeps);
+  MICRO_TESTS_FREE(rdeps_start);
+  MICRO_TESTS_FREE(pending);
+  MICRO_TESTS_FREE(topo);
+  MICRO_TESTS_FREE(longest);
+  MICRO_TESTS_FREE(ranks);
+  return 0;
+}
+
+MICRO_TESTS_DEF void _micro_tests_plan_free(MicroTests *micro_tests)
+{
+  if (micro_tests->durations_file != NULL && micro_tests->durations != NULL
+      && micro_tests->order != NULL)
+    _micro_tests_save_durations(micro_tests);
+
+  MICRO_TESTS_FREE(micro_tests->test_state);
+  MICRO_TESTS_FREE(micro_tests->durations);
+  MICRO_TESTS_FREE(micro_tests->order);
+  MICRO_TESTS_FREE(micro_tests->deps);
+  MICRO_TESTS_FREE(micro_tests->deps_start);
+  micro_tests->test_state = NULL;
+  micro_tests->durations  = NULL;
+  micro_tests->order      = NULL;
+  micro_tests->deps       = NULL;
+  micro_tests->deps_start = NULL;
+}
+
+MICRO_TESTS_DEF int _micro_tests_deps_status(MicroTests *micro_tests,
+                                             size_t index)
+{
+  if (micro_tests->test_state[index] == MICRO_TESTS_SCHED_BROKEN)
+    return MICRO_TESTS_DEPS_SKIP;
+
+  int status = MICRO_TESTS_DEPS_READY;
+  for (size_t d = micro_tests->deps_start[index];
+       d < micro_tests->deps_start[index + 1]; ++d)
+  {
+    unsigned char state = micro_tests->test_state[micro_tests->deps[d]];
+    if (state == MICRO_TESTS_SCHED_FAILED || state == MICRO_TESTS_SCHED_SKIPPED)
+      return MICRO_TESTS_DEPS_SKIP;
+    if (state != MICRO_TESTS_SCHED_DONE)
+      status = MICRO_TESTS_DEPS_WAIT;
+  }
+  return status;
+}
+
+MICRO_TESTS_DEF int _micro_tests_run(MicroTests *micro_tests)
+{
+  int failed = 0;
+  MicroTest* test = _micro_tests_tests();
+
+  _MICRO_TESTS_REPORT(on_run_start, micro_tests, micro_tests->order_count);
+  for (size_t i = 0; i < micro_tests->order_count; i++)
+  {
+    size_t index = micro_tests->order[i];
+    MicroTest* current = &test[index];
+
+    // The plan puts the prerequisites first, so waiting means that
+    // one of them could not be ordered
+    MicroTestsStatus status = MICRO_TESTS_SKIPPED;
+    if (_micro_tests_deps_status(micro_tests, index) == MICRO_TESTS_DEPS_READY)
+    {
+      _MICRO_TESTS_REPORT(on_test_start, micro_tests, current);
+      double start = _micro_tests_time();
+      status = _micro_tests_exec(micro_tests, current);
+      micro_tests->durations[index] = _micro_tests_time() - start;
+    }
+
+    if (status == MICRO_TESTS_FAILED)
+      failed++;
+    micro_tests->test_state[index] = (status == MICRO_TESTS_OK)
+      ? MICRO_TESTS_SCHED_DONE
+      : (status == MICRO_TESTS_FAILED) ? MICRO_TESTS_SCHED_FAILED
+      : MICRO_TESTS_SCHED_SKIPPED;
+    _MICRO_TESTS_REPORT(on_test_end, micro_tests, current, status);
+#ifdef MICRO_TESTS_CAPTURE
+    _micro_tests_capture_emit(status);
+#endif
+  }
+  _MICRO_TESTS_REPORT(on_run_end, micro_tests, failed);
+
+  return failed;
+}
+
+#ifdef MICRO_TESTS_PROFILE
+
+// glibc before 2.35 does not name the thread of SIGEV_THREAD_ID
+#ifndef sigev_notify_thread_id
+  #define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+static MicroTestsProfile _micro_tests_profile;
+// Test running on this thread and frame of its caller, read by the
+// signal handler
+static __thread MicroTest *_micro_tests_profile_test;
+static __thread uintptr_t _micro_tests_profile_frame;
+static __thread timer_t _micro_tests_profile_timer;
+
+MICRO_TESTS_DEF int _micro_tests_profile_start(void)
+{
+  _micro_tests_profile.samples =
+    MICRO_TESTS_CALLOC(MICRO_TESTS_PROFILE_MAX_SAMPLES,
+                       sizeof(MicroTestsProfileSample));
+  if (_micro_tests_profile.samples == NULL)
+  {
+    perror("calloc");
+    return -1;
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = _micro_tests_profile_handler;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, NULL) != 0)
+  {
+    perror("sigaction");
+    MICRO_TESTS_FREE(_micro_tests_profile.samples);
+    _micro_tests_profile.samples = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+MICRO_TESTS_DEF int _micro_tests_profile_begin(MicroTest *test, void *frame)
+{
+  struct sigevent event;
+  memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = SIGPROF;
+  event.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event,
+                   &_micro_tests_profile_timer) != 0)
+    return -1;
+
+  _micro_tests_profile_frame = (uintptr_t)frame;
+  _micro_tests_profile_test = test;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+  struct itimerspec interval = {
+    .it_interval = {
+      .tv_sec  = MICRO_TESTS_PROFILE_INTERVAL_US / 1000000,
+      .tv_nsec = (MICRO_TESTS_PROFILE_INTERVAL_US % 1000000) * 1000L,
+    },
+  };
+  interval.it_value = interval.it_interval;
+  if (timer_settime(_micro_tests_profile_timer, 0, &interval, NULL) != 0)
+  {
+    _micro_tests_profile_end();
+    return -1;
+  }
+  return 0;
+}
+
+MICRO_TESTS_DEF void _micro_tests_profile_end(void)
+{
+  timer_delete(_micro_tests_profile_timer);
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  _micro_tests_profile_test = NULL;
+}
+
+MICRO_TESTS_DEF void _micro_tests_profile_handler(int signal, siginfo_t *info,
+                                                  void *context)
+{
+  (void) signal;
+  (void) info;
+  MicroTest *test = _micro_tests_profile_test;
+  if (test == NULL)
+    return;
+  size_t index = __atomic_fetch_add(&_micro_tests_profile.count, 1,
+                                    __ATOMIC_RELAXED);
+  if (index >= MICRO_TESTS_PROFILE_MAX_SAMPLES)
+    return;
+
+  ucontext_t *ucontext = context;
+  uintptr_t pc = 0, fp = 0, sp = 0;
+#if defined(__x86_64__)
+  pc = (uintptr_t)ucontext->uc_mcontext.gregs[REG_RIP];
+  fp = (uintptr_t)ucontext->uc_mcontext.gregs[REG_RBP];
+  sp = (uintptr_t)ucontext->uc_mcontext.gregs[REG_RSP];
+#elif defined(__aarch64__)
+  pc = (uintptr_t)ucontext->uc_mcontext.pc;
+  fp = (uintptr_t)ucontext->uc_mcontext.regs[29];
+  sp = (uintptr_t)ucontext->uc_mcontext.sp;
+#else
+  (void) ucontext;
+#endif
+
+  // A frame record is the caller frame and the return address. The
+  // walk stays between the stack pointer and the frame of the caller
+  // of the test, and the return into it is not recorded
+  MicroTestsProfileSample *sample = &_micro_tests_profile.samples[index];
+  uintptr_t top = _micro_tests_profile_frame;
+  size_t depth = 0;
+  if (pc != 0)
+    sample->pcs[depth++] = (void*)pc;
+  while (depth < MICRO_TESTS_PROFILE_MAX_DEPTH
+         && fp >= sp && fp < top && fp % sizeof(uintptr_t) == 0)
+  {
+    uintptr_t next = ((uintptr_t*)fp)[0];
+    if (next <= fp || next >= top)
+      break;
+    sample->pcs[depth++] = (void*)((uintptr_t*)fp)[1];
+    fp = next;
+  }
+  sample->depth = depth;
+  sample->test = test;
+}
+
+static int _micro_tests_symbol_compare(const void *a, const void *b)
+{
+  const MicroTestsProfileSymbol *x = a, *y = b;
+  return (x->address > y->address) - (x->address < y->address);
+}
+
+MICRO_TESTS_DEF int _micro_tests_profile_load_symbols(void)
+{
+  Dl_info self;
+  if (dladdr(&_micro_tests_profile, &self) == 0)
+    return -1;
+  int fd = open("/proc/self/exe", O_RDONLY);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ElfW(Ehdr)))
+  {
+    close(fd);
+    return -1;
+  }
+  void *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED)
+    return -1;
+  _micro_tests_profile.image = image;
+  _micro_tests_profile.image_size = st.st_size;
+
+  const unsigned char *bytes = image;
+  const ElfW(Ehdr) *header = image;
+  if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0
+      || header->e_shoff == 0
+      || header->e_shoff + (size_t)header->e_shnum * sizeof(ElfW(Shdr))
+         > (size_t)st.st_size)
+    return -1;
+
+  // Position independent executables are relative to their load base
+  uintptr_t base = (header->e_type == ET_DYN) ? (uintptr_t)self.dli_fbase : 0;
+  const ElfW(Shdr) *sections = (const ElfW(Shdr)*)(bytes + header->e_shoff);
+  for (size_t i = 0; i < header->e_shnum; ++i)
+  {
+    if (sections[i].sh_type != SHT_SYMTAB
+        || sections[i].sh_link >= header->e_shnum)
+      continue;
+    const ElfW(Shdr) *strtab = &sections[sections[i].sh_link];
+    if (sections[i].sh_offset + sections[i].sh_size > (size_t)st.st_size
+        || strtab->sh_offset + strtab->sh_size > (size_t)st.st_size)
+      return -1;
+
+    const ElfW(Sym) *symbols = (const ElfW(Sym)*)(bytes + sections[i].sh_offset);
+    size_t count = sections[i].sh_size / sizeof(ElfW(Sym));
+    _micro_tests_profile.symbols =
+      MICRO_TESTS_CALLOC(count > 0 ? count : 1, sizeof(MicroTestsProfileSymbol));
+    if (_micro_tests_profile.symbols == NULL)
+      return -1;
+    for (size_t j = 0; j < count; ++j)
+    {
+      if (ELF64_ST_TYPE(symbols[j].st_info) != STT_FUNC
+          || symbols[j].st_value == 0
+          || symbols[j].st_name >= strtab->sh_size)
+        continue;
+      _micro_tests_profile.symbols[_micro_tests_profile.symbol_count++] =
+        (MicroTestsProfileSymbol){
+          .address = base + symbols[j].st_value,
+          .size    = symbols[j].st_size,
+          .name    = (const char*)bytes + strtab->sh_offset + symbols[j].st_name,
+        };
+    }
+    qsort(_micro_tests_profile.symbols, _micro_tests_profile.symbol_count,
+          sizeof(MicroTestsProfileSymbol), _micro_tests_symbol_compare);
+    return 0;
+  }
+  return -1;
+}
+
+MICRO_TESTS_DEF void _micro_tests_profile_symbol(void *pc, char *out,
+                                                 size_t size)
+{
+  // The last function starting at or before the address
+  uintptr_t address = (uintptr_t)pc;
+  size_t lo = 0, hi = _micro_tests_profile.symbol_count;
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    if (_micro_tests_profile.symbols[mid].address <= address)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo > 0)
+  {
+    const MicroTestsProfileSymbol *symbol = &_micro_tests_profile.symbols[lo - 1];
+    if (address < symbol->address + (symbol->size > 0 ? symbol->size : 1))
+    {
+      snprintf(out, size, "%s", symbol->name);
+      return;
+    }
+  }
+
+  Dl_info info;
+  if (dladdr(pc, &info) != 0 && info.dli_sname != NULL)
+    snprintf(out, size, "%s", info.dli_sname);
+  else if (dladdr(pc, &info) != 0 && info.dli_fname != NULL)
+  {
+    const char *name = strrchr(info.dli_fname, '/');
+    snprintf(out, size, "%s+0x%lx", (name != NULL) ? name + 1 : info.dli_fname,
+             (unsigned long)(address - (uintptr_t)info.dli_fbase));
+  }
+  else
+    snprintf(out, size, "0x%lx", (unsigned long)address);
+}
+
+static int _micro_tests_line_compare(const void *a, const void *b)
+{
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+MICRO_TESTS_DEF int _micro_tests_profile_write(MicroTests *micro_tests)
+{
+  size_t taken = __atomic_load_n(&_micro_tests_profile.count, __ATOMIC_RELAXED);
+  size_t count = (taken < MICRO_TESTS_PROFILE_MAX_SAMPLES)
+    ? taken : MICRO_TESTS_PROFILE_MAX_SAMPLES;
+  int ret = 0;
+
+  FILE *file = fopen(micro_tests->profile_file, "w");
+  char **lines = MICRO_TESTS_CALLOC(count > 0 ? count : 1, sizeof(char*));
+  if (file == NULL || lines == NULL)
+  {
+    perror("Error: Could not write the profile");
+    ret = -1;
+    goto done;
+  }
+  if (_micro_tests_profile_load_symbols() < 0 && micro_tests->debug)
+    printf("debug: no symbol table in the executable, using dladdr\n");
+
+  // One line per sample, from the outermost frame. The callers of
+  // the innermost frame are looked up before their return address
+  char line[4096];
+  size_t lines_count = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    MicroTestsProfileSample *sample = &_micro_tests_profile.samples[i];
+    if (sample->test == NULL)
+      continue;
+    size_t length = snprintf(line, sizeof(line), "%s.%s",
+                             sample->test->test_suite, sample->test->test_name);
+    for (size_t frame = sample->depth; frame-- > 0 && length < sizeof(line);)
+    {
+      char name[256];
+      void *pc = (frame == 0) ? sample->pcs[frame]
+                              : (void*)((uintptr_t)sample->pcs[frame] - 1);
+      _micro_tests_profile_symbol(pc, name, sizeof(name));
+      length += snprintf(line + length, sizeof(line) - length, ";%s", name);
+    }
+    if (length >= sizeof(line))
+      length = sizeof(line) - 1;
+    lines[lines_count] = MICRO_TESTS_CALLOC(length + 1, 1);
+    if (lines[lines_count] == NULL)
+      break;
+    memcpy(lines[lines_count++], line, length);
+  }
+
+  // Identical stacks are adjacent once sorted
+  qsort(lines, lines_count, sizeof(char*), _micro_tests_line_compare);
+  for (size_t i = 0; i < lines_count;)
+  {
+    size_t same = i + 1;
+    while (same < lines_count && strcmp(lines[same], lines[i]) == 0)
+      same++;
+    fprintf(file, "%s %zu\n", lines[i], same - i);
+    i = same;
+  }
+
+  if (!micro_tests->quiet)
+  {
+    printf("Profile: %zu samples saved to %s", lines_count,
+           micro_tests->profile_file);
+    if (taken > count)
+      printf(", %zu dropped", taken - count);
+    printf("\n");
+  }
+
+done:
+  if (lines != NULL)
+    for (size_t i = 0; i < count; ++i)
+      MICRO_TESTS_FREE(lines[i]);
+  MICRO_TESTS_FREE(lines);
+  if (file != NULL && fclose(file) != 0)
+    ret = -1;
+  MICRO_TESTS_FREE(_micro_tests_profile.samples);
+  MICRO_TESTS_FREE(_micro_tests_profile.symbols);
+  if (_micro_tests_profile.image != NULL)
+    munmap(_micro_tests_profile.image, _micro_tests_profile.image_size);
+  _micro_tests_profile = (MicroTestsProfile){ 0 };
+  return ret;
+}
+
+#endif // MICRO_TESTS_PROFILE
+
+#ifdef MICRO_TESTS_ORCHESTRATOR
+
+// Tests of the manifests, while they are read
+typedef struct {
+  MicroTests *micro_tests;
+  MicroTestsOrchestrated *tests;
+  size_t count;
+  size_t capacity;
+  size_t executable;
+  _Bool failed;
+} _MicroTestsOrchestratorReader;
+
+static char *_micro_tests_strdup(const char *string)
+{
+  size_t length = strlen(string);
+  char *copy = MICRO_TESTS_CALLOC(length + 1, 1);
+  if (copy != NULL)
+    memcpy(copy, string, length);
+  return copy;
+}
+
+static int _micro_tests_orchestrator_add(const MicroTestsManifestEntry *entry,
+                                         void *ctx)
+{
+  _MicroTestsOrchestratorReader *reader = ctx;
+  MicroTests *micro_tests = reader->micro_tests;
+  if (_micro_tests_strcmp(entry->tags, "benchmark") == 0)
+    return 0;
+  // The executable changed since it was counted
+  if (reader->count >= reader->capacity)
+    return 1;
+
+  MicroTestsOrchestrated *test = &reader->tests[reader->count];
+  size_t length = strlen(entry->suite) + 1 + strlen(entry->name);
+  test->name = MICRO_TESTS_CALLOC(length + 1, 1);
+  test->test.test_suite = _micro_tests_strdup(entry->suite);
+  test->test.test_name = _micro_tests_strdup(entry->name);
+  test->test.file_name = _micro_tests_strdup(entry->file);
+  _Bool exclusive = 0;
+  for (const char *tag = entry->tags; *tag != '\0'; )
+  {
+    size_t length = strcspn(tag, " ");
+    if (length == 6 && strncmp(tag, "serial", 6) == 0)
+      exclusive = 1;
+    else if (strncmp(tag, "resources=", 10) == 0)
+      exclusive = 1;
+    else if (strncmp(tag, "after=", 6) == 0 && test->test.depends == NULL)
+    {
+      char *depends = MICRO_TESTS_CALLOC(length - 5, 1);
+      if (depends != NULL)
+        memcpy(depends, tag + 6, length - 6);
+      test->test.depends = depends;
+    }
+    tag += length + (tag[length] == ' ');
+  }
+  reader->count++;
+  if (test->name == NULL || test->test.test_suite == NULL
+      || test->test.test_name == NULL || test->test.file_name == NULL)
+  {
+    reader->failed = 1;
+    return 1;
+  }
+
+  snprintf(test->name, length + 1, "%s.%s", entry->suite, entry->name);
+  test->test.marker = 0xDeadBeaf;
+  test->test.line_number = entry->line;
+  test->test.function_name = test->name;
+  test->executable = reader->executable;
+  test->seconds = -1;
+  test->group = reader->count - 1;
+  test->exclusive = exclusive;
+  test->selected = (micro_tests->run_suite == NULL
+                    || _micro_tests_strcmp(micro_tests->run_suite, entry->suite) == 0)
+    && (micro_tests->run_test == NULL
+        || _micro_tests_strcmp(micro_tests->run_test, entry->name) == 0);
+  return 0;
+}
+
+// Prerequisite of tests[i] named by the length bytes of name, looked
+// up in its executable, or SIZE_MAX
+static size_t _micro_tests_orchestrated_prerequisite(MicroTestsOrchestrated *tests,
+                                                     size_t *executable_start,
+                                                     size_t i, const char *name,
+                                                     size_t length)
+{
+  size_t e = tests[i].executable;
+  for (size_t j = executable_start[e]; j < executable_start[e + 1]; ++j)
+  {
+    _Bool same = (memchr(name, '.', length) != NULL)
+      ? strlen(tests[j].name) == length
+        && strncmp(tests[j].name, name, length) == 0
+      : strlen(tests[j].test.test_name) == length
+        && strncmp(tests[j].test.test_name, name, length) == 0
+        && strcmp(tests[j].test.test_suite, tests[i].test.test_suite) == 0;
+    if (same)
+      return j;
+  }
+  return SIZE_MAX;
+}
+
+static size_t _micro_tests_group_find(MicroTestsOrchestrated *tests, size_t i)
+{
+  while (tests[i].group != i)
+  {
+    tests[i].group = tests[tests[i].group].group;
+    i = tests[i].group;
+  }
+  return i;
+}
+
+static int _micro_tests_orchestrated_compare(const void *a, const void *b)
+{
+  const MicroTestsOrchestrated *x = *(MicroTestsOrchestrated * const *)a;
+  const MicroTestsOrchestrated *y = *(MicroTestsOrchestrated * const *)b;
+  return strcmp(x->name, y->name);
+}
+
+// First of the tests sorted by name with a name, or count
+static size_t _micro_tests_orchestrated_find(MicroTestsOrchestrated **sorted,
+                                             size_t count, const char *name)
+{
+  size_t lo = 0, hi = count;
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    if (strcmp(sorted[mid]->name, name) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return (lo < count && strcmp(sorted[lo]->name, name) == 0) ? lo : count;
+}
+
+// Exclusive batches last, then the longest first
+static int _micro_tests_batch_compare(const void *a, const void *b)
+{
+  const MicroTestsBatch *x = a, *y = b;
+  if (x->exclusive != y->exclusive)
+    return x->exclusive - y->exclusive;
+  return (x->seconds < y->seconds) - (x->seconds > y->seconds);
+}
+
+// Create an empty temporary file in $TMPDIR, or in /tmp
+//
+// Returns: a descriptor of the file, or -1 on failure, and its path
+// to free in *path
+static int _micro_tests_temp_file(char **path)
+{
+  const char *dir = getenv("TMPDIR");
+  if (dir == NULL || dir[0] == '\0')
+    dir = "/tmp";
+  size_t size = strlen(dir) + sizeof("/micro-tests-XXXXXX");
+  *path = MICRO_TESTS_CALLOC(size, 1);
+  if (*path == NULL)
+    return -1;
+  snprintf(*path, size, "%s/micro-tests-XXXXXX", dir);
+  int fd = mkstemp(*path);
+  if (fd < 0)
+  {
+    MICRO_TESTS_FREE(*path);
+    *path = NULL;
+  }
+  return fd;
+}
+
+MICRO_TESTS_DEF int _micro_tests_batch_start(MicroTests *micro_tests,
+                                             MicroTestsBatch *batch)
+{
+  const char *executable = micro_tests->executables[batch->executable];
+  int list_fd = _micro_tests_temp_file(&batch->list_path);
+  int output_fd = _micro_tests_temp_file(&batch->output_path);
+  int durations_fd = _micro_tests_temp_file(&batch->durations_path);
+  if (durations_fd >= 0)
+    close(durations_fd);
+  // The pipe reaches end of file when the process exits, the read end
+  // is not inherited by the other batches
+  int exit_pipe[2] = { -1, -1 };
+  if (pipe(exit_pipe) == 0)
+    fcntl(exit_pipe[0], F_SETFD, FD_CLOEXEC);
+
+  FILE *list = (list_fd >= 0) ? fdopen(list_fd, "w") : NULL;
+  if (list != NULL)
+    for (size_t i = 0; i < batch->count; ++i)
+      fprintf(list, "%s\n", batch->tests[i]->name);
+  if (list == NULL || fclose(list) != 0 || output_fd < 0 || durations_fd < 0
+      || exit_pipe[0] < 0)
+  {
+    perror("Error: Could not write the batch");
+    if (list == NULL && list_fd >= 0)
+      close(list_fd);
+    if (output_fd >= 0)
+      close(output_fd);
+    if (exit_pipe[0] >= 0)
+    {
+      close(exit_pipe[0]);
+      close(exit_pipe[1]);
+    }
+    return -1;
+  }
+
+  fflush(stdout);
+  batch->pid = fork();
+  if (batch->pid == 0)
+  {
+    char *argv[] = {
+      (char*)executable, "--no-banner", "--reporter", "tap",
+      "--test-file", batch->list_path, "--durations", batch->durations_path,
+      NULL,
+    };
+    dup2(output_fd, STDOUT_FILENO);
+    close(output_fd);
+    execv(executable, argv);
+    perror(executable);
+    _exit(127);
+  }
+  close(output_fd);
+  close(exit_pipe[1]);
+  if (batch->pid < 0)
+  {
+    perror("fork");
+    batch->pid = 0;
+    close(exit_pipe[0]);
+    return -1;
+  }
+  batch->exit_fd = exit_pipe[0];
+  return 0;
+}
+
+MICRO_TESTS_DEF int _micro_tests_batch_finish(MicroTests *micro_tests,
+                                              MicroTestsBatch *batch,
+                                              int status)
+{
+  int failed = 0;
+  char line[1024];
+  // The test that started last
+  size_t running = batch->count;
+
+  // "# running suite.test", "ok 1 - suite.test",
+  // "ok 2 - suite.test # SKIP ..." or "not ok 3 - suite.test"
+  FILE *output = (batch->output_path != NULL)
+    ? fopen(batch->output_path, "r") : NULL;
+  while (output != NULL && fgets(line, sizeof(line), output) != NULL)
+  {
+    MicroTestsStatus outcome;
+    if (strncmp(line, "# running ", 10) == 0)
+    {
+      line[strcspn(line, "\n")] = '\0';
+      running = _micro_tests_orchestrated_find(batch->tests, batch->count,
+                                               line + 10);
+      continue;
+    }
+    if (strncmp(line, "ok ", 3) == 0)
+      outcome = MICRO_TESTS_OK;
+    else if (strncmp(line, "not ok ", 7) == 0)
+      outcome = MICRO_TESTS_FAILED;
+    else
+      continue;
+    char *name = strstr(line, " - ");
+    if (name == NULL)
+      continue;
+    name += 3;
+    char *directive = strstr(name, " # ");
+    if (directive != NULL)
+    {
+      if (strncmp(directive, " # SKIP", 7) == 0)
+        outcome = MICRO_TESTS_SKIPPED;
+      *directive = '\0';
+    }
+    name[strcspn(name, "\n")] = '\0';
+
+    size_t index = _micro_tests_orchestrated_find(batch->tests, batch->count,
+                                                  name);
+    if (index == batch->count || batch->tests[index]->reported)
+      continue;
+    batch->tests[index]->reported = 1;
+    _MICRO_TESTS_REPORT(on_test_end, micro_tests, &batch->tests[index]->test,
+                        outcome);
+    failed += (outcome == MICRO_TESTS_FAILED);
+  }
+  if (output != NULL)
+    fclose(output);
+
+  FILE *durations = (batch->durations_path != NULL)
+    ? fopen(batch->durations_path, "r") : NULL;
+  double seconds;
+  while (durations != NULL && fscanf(durations, "%511s %lf", line, &seconds) == 2)
+  {
+    size_t index = _micro_tests_orchestrated_find(batch->tests, batch->count,
+                                                  line);
+    if (index < batch->count)
+      batch->tests[index]->seconds = seconds;
+  }
+  if (durations != NULL)
+    fclose(durations);
+
+  size_t missing = 0;
+  for (size_t i = 0; i < batch->count; ++i)
+    missing += !batch->tests[i]->reported;
+  if (missing > 0)
+  {
+    const char *executable = micro_tests->executables[batch->executable];
+    if (status >= 0 && WIFSIGNALED(status))
+      fprintf(stderr, "Error: %s was killed by signal %d before reporting %zu tests\n",
+              executable, WTERMSIG(status), missing);
+    else
+      fprintf(stderr, "Error: %s exited with status %d before reporting %zu tests\n",
+              executable, (status >= 0) ? WEXITSTATUS(status) : -1, missing);
+  }
+  // The test that was running failed with the process, the ones after
+  // it run again. Without one, the process could not run the tests
+  _Bool again = running < batch->count && !batch->tests[running]->reported;
+  size_t kept = 0;
+  for (size_t i = 0; i < batch->count; ++i)
+  {
+    if (batch->tests[i]->reported)
+      continue;
+    if (again && i != running)
+    {
+      batch->tests[kept++] = batch->tests[i];
+      continue;
+    }
+    batch->tests[i]->reported = 1;
+    _MICRO_TESTS_REPORT(on_test_end, micro_tests, &batch->tests[i]->test,
+                        MICRO_TESTS_FAILED);
+    failed++;
+  }
+  if (kept > 0)
+    fprintf(stderr, "Error: %zu tests of the batch are queued again\n", kept);
+  batch->count = kept;
+  batch->done = (kept == 0);
+
+  char **paths[] = {
+    &batch->list_path, &batch->output_path, &batch->durations_path,
+  };
+  for (size_t p = 0; p < sizeof(paths) / sizeof(paths[0]); ++p)
+  {
+    if (*paths[p] != NULL)
+      unlink(*paths[p]);
+    MICRO_TESTS_FREE(*paths[p]);
+    *paths[p] = NULL;
+  }
+  return failed;
+}
+
+MICRO_TESTS_DEF int _micro_tests_orchestrate(MicroTests *micro_tests)
+{
+  size_t executable_count = micro_tests->executable_count;
+  size_t capacity = 0;
+  for (size_t e = 0; e < executable_count; ++e)
+  {
+    long count = micro_tests_manifest_read(micro_tests->executables[e],
+                                           NULL, NULL);
+    if (count < 0)
+    {
+      fprintf(stderr, "Error: No test manifest in %s\n",
+              micro_tests->executables[e]);
+      return 1;
+    }
+    capacity += count;
+  }
+
+  _MicroTestsOrchestratorReader reader = {
+    .micro_tests = micro_tests,
+    .tests       = MICRO_TESTS_CALLOC(capacity > 0 ? capacity : 1,
+                                      sizeof(MicroTestsOrchestrated)),
+    .capacity    = capacity,
+  };
+  size_t *executable_start = MICRO_TESTS_CALLOC(executable_count + 1,
+                                                sizeof(size_t));
+  MicroTestsOrchestrated **sorted = MICRO_TESTS_CALLOC(capacity > 0 ? capacity : 1,
+                                                       sizeof(void*));
+  size_t *group_batch = MICRO_TESTS_CALLOC(capacity > 0 ? capacity : 1,
+                                           sizeof(size_t));
+  double *group_seconds = MICRO_TESTS_CALLOC(capacity > 0 ? capacity : 1,
+                                             sizeof(double));
+  size_t *groups = MICRO_TESTS_CALLOC(capacity > 0 ? capacity : 1,
+                                      sizeof(size_t));
+  MicroTestsBatch *batches = MICRO_TESTS_CALLOC(capacity > 0 ? capacity : 1,
+                                                sizeof(MicroTestsBatch));
+  MicroTestsOrchestrated **members = MICRO_TESTS_CALLOC(capacity > 0 ? capacity : 1,
+                                                        sizeof(void*));
+  struct pollfd *polled = NULL;
+  size_t *polled_batch = NULL;
+  int failed = 0;
+  if (reader.tests == NULL || executable_start == NULL || sorted == NULL
+      || group_batch == NULL || group_seconds == NULL || groups == NULL
+      || batches == NULL || members == NULL)
+  {
+    perror("calloc");
+    failed = 1;
+    goto done;
+  }
+
+  for (size_t e = 0; e < executable_count; ++e)
+  {
+    executable_start[e] = reader.count;
+    reader.executable = e;
+    micro_tests_manifest_read(micro_tests->executables[e],
+                              _micro_tests_orchestrator_add, &reader);
+  }
+  executable_start[executable_count] = reader.count;
+  if (reader.failed)
+  {
+    perror("calloc");
+    failed = 1;
+    goto done;
+  }
+  MicroTestsOrchestrated *tests = reader.tests;
+  size_t count = reader.count;
+
+  // The prerequisites of the selected tests run too, and the tests
+  // linked by prerequisites run in the same batch, in the order of
+  // their executable
+  size_t *stack = groups, top = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (!tests[i].selected)
+      continue;
+    stack[top++] = i;
+    while (top > 0)
+    {
+      size_t t = stack[--top];
+      const char *depends = tests[t].test.depends;
+      while (depends != NULL && *depends != '\0')
+      {
+        size_t length = strcspn(depends, ",");
+        size_t j = _micro_tests_orchestrated_prerequisite(tests, executable_start,
+                                                          t, depends, length);
+        if (j != SIZE_MAX)
+        {
+          if (!tests[j].selected)
+          {
+            tests[j].selected = 1;
+            stack[top++] = j;
+          }
+          tests[_micro_tests_group_find(tests, t)].group =
+            _micro_tests_group_find(tests, j);
+        }
+        depends += length;
+        depends += (*depends == ',');
+      }
+    }
+  }
+
+  // Durations of the previous runs, by name
+  for (size_t i = 0; i < count; ++i)
+    sorted[i] = &tests[i];
+  qsort(sorted, count, sizeof(void*), _micro_tests_orchestrated_compare);
+  FILE *file = (micro_tests->durations_file != NULL)
+    ? fopen(micro_tests->durations_file, "r") : NULL;
+  if (file != NULL)
+  {
+    char name[512];
+    double seconds;
+    while (fscanf(file, "%511s %lf", name, &seconds) == 2)
+      for (size_t i = _micro_tests_orchestrated_find(sorted, count, name);
+           i < count && strcmp(sorted[i]->name, name) == 0; ++i)
+        sorted[i]->seconds = seconds;
+    fclose(file);
+  }
+  double known_sum = 0;
+  size_t known = 0;
+  for (size_t i = 0; i < count; ++i)
+    if (tests[i].selected && tests[i].seconds >= 0)
+    {
+      known_sum += tests[i].seconds;
+      known++;
+    }
+  // Without any duration the batches are sized by number of tests,
+  // otherwise the tests not measured yet take the mean duration
+  _Bool by_count = (known == 0);
+  double fallback = by_count ? 1 : known_sum / known;
+
+  // Groups with their estimated durations, exclusive if a test is
+  size_t group_count = 0, selected = 0;
+  double total = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (!tests[i].selected)
+      continue;
+    selected++;
+    size_t root = _micro_tests_group_find(tests, i);
+    double seconds = (tests[i].seconds >= 0) ? tests[i].seconds : fallback;
+    group_seconds[root] += seconds;
+    total += seconds;
+    if (tests[i].exclusive)
+      tests[root].exclusive = 1;
+    if (root == i)
+      groups[group_count++] = i;
+  }
+
+  // Right-sized batches of the groups of an executable, longest
+  // groups first. The exclusive groups of an executable share a batch
+  int jobs = (micro_tests->job_count > 0) ? micro_tests->job_count
+                                          : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  jobs = (jobs > 0) ? jobs : 1;
+  double target = total / (jobs * MICRO_TESTS_ORCHESTRATOR_BATCHES_PER_JOB);
+  if (!by_count && target < MICRO_TESTS_ORCHESTRATOR_MIN_BATCH_MS * 1e-3)
+    target = MICRO_TESTS_ORCHESTRATOR_MIN_BATCH_MS * 1e-3;
+  for (size_t i = 1; i < group_count; ++i)
+    for (size_t j = i; j > 0 && group_seconds[groups[j]] > group_seconds[groups[j - 1]]; --j)
+    {
+      size_t swap = groups[j];
+      groups[j] = groups[j - 1];
+      groups[j - 1] = swap;
+    }
+  size_t batch_count = 0;
+  for (size_t e = 0; e < executable_count; ++e)
+  {
+    size_t open = SIZE_MAX, exclusive = SIZE_MAX;
+    for (size_t g = 0; g < group_count; ++g)
+    {
+      size_t root = groups[g];
+      if (tests[root].executable != e)
+        continue;
+      size_t *batch = tests[root].exclusive ? &exclusive : &open;
+      if (*batch == SIZE_MAX
+          || (!tests[root].exclusive
+              && batches[*batch].seconds + group_seconds[root] > target))
+      {
+        *batch = batch_count++;
+        batches[*batch].executable = e;
+        batches[*batch].exclusive = tests[root].exclusive;
+      }
+      batches[*batch].seconds += group_seconds[root];
+      group_batch[root] = *batch;
+    }
+  }
+
+  // Tests of each batch, sorted by name to match the TAP output
+  for (size_t i = 0; i < count; ++i)
+    if (tests[i].selected)
+      batches[group_batch[_micro_tests_group_find(tests, i)]].count++;
+  size_t offset = 0;
+  for (size_t b = 0; b < batch_count; ++b)
+  {
+    batches[b].tests = members + offset;
+    offset += batches[b].count;
+    batches[b].count = 0;
+  }
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (!tests[i].selected)
+      continue;
+    MicroTestsBatch *batch = &batches[group_batch[_micro_tests_group_find(tests, i)]];
+    batch->tests[batch->count++] = &tests[i];
+  }
+  for (size_t b = 0; b < batch_count; ++b)
+    qsort(batches[b].tests, batches[b].count, sizeof(void*),
+          _micro_tests_orchestrated_compare);
+  qsort(batches, batch_count, sizeof(MicroTestsBatch), _micro_tests_batch_compare);
+
+  if (micro_tests->debug)
+    printf("debug: %zu tests of %zu executables in %zu batches of %.3f %s on %d jobs\n",
+           selected, executable_count, batch_count, target,
+           by_count ? "tests" : "s", jobs);
+
+  // The ends of the pipes of the running batches, and their batches
+  polled = MICRO_TESTS_CALLOC((size_t)jobs, sizeof(struct pollfd));
+  polled_batch = MICRO_TESTS_CALLOC((size_t)jobs, sizeof(size_t));
+  if (polled == NULL || polled_batch == NULL)
+  {
+    perror("calloc");
+    failed = 1;
+    goto done;
+  }
+
+  // One queue for all the executables, the exclusive batches alone.
+  // A batch that crashed is queued again with the tests it did not run
+  _MICRO_TESTS_REPORT(on_run_start, micro_tests, selected);
+  size_t done_count = 0;
+  int running = 0;
+  _Bool exclusive_running = 0;
+  while (done_count < batch_count)
+  {
+    for (size_t b = 0; b < batch_count && running < jobs && !exclusive_running;
+         ++b)
+    {
+      MicroTestsBatch *batch = &batches[b];
+      if (batch->done || batch->pid != 0)
+        continue;
+      if (batch->exclusive && running > 0)
+        break;
+      if (_micro_tests_batch_start(micro_tests, batch) < 0)
+      {
+        failed += _micro_tests_batch_finish(micro_tests, batch, -1);
+        done_count += batch->done;
+        continue;
+      }
+      running++;
+      exclusive_running = batch->exclusive;
+    }
+    if (running == 0)
+      continue;
+
+    // Only the processes of the batches, not the other children of
+    // the program
+    size_t polled_count = 0;
+    for (size_t b = 0; b < batch_count; ++b)
+      if (batches[b].pid != 0)
+      {
+        polled[polled_count] = (struct pollfd){
+          .fd = batches[b].exit_fd, .events = POLLIN,
+        };
+        polled_batch[polled_count++] = b;
+      }
+    if (poll(polled, polled_count, -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("poll");
+      break;
+    }
+    for (size_t p = 0; p < polled_count; ++p)
+    {
+      if (polled[p].revents == 0)
+        continue;
+      MicroTestsBatch *batch = &batches[polled_batch[p]];
+      int status;
+      while (waitpid(batch->pid, &status, 0) < 0)
+        if (errno != EINTR)
+        {
+          perror("waitpid");
+          status = -1;
+          break;
+        }
+      close(batch->exit_fd);
+      batch->pid = 0;
+      running--;
+      exclusive_running = 0;
+      failed += _micro_tests_batch_finish(micro_tests, batch, status);
+      done_count += batch->done;
+    }
+  }
+  _MICRO_TESTS_REPORT(on_run_end, micro_tests, failed);
+
+  file = (micro_tests->durations_file != NULL)
+    ? fopen(micro_tests->durations_file, "w") : NULL;
+  if (file != NULL)
+  {
+    for (size_t i = 0; i < count; ++i)
+      if (sorted[i]->seconds >= 0)
+        fprintf(file, "%s %.9f\n", sorted[i]->name, sorted[i]->seconds);
+    fclose(file);
+  }
+
+done:
+  for (size_t i = 0; reader.tests != NULL && i < reader.count; ++i)
+  {
+    MICRO_TESTS_FREE(reader.tests[i].name);
+    MICRO_TESTS_FREE((void*)reader.tests[i].test.test_suite);
+    MICRO_TESTS_FREE((void*)reader.tests[i].test.test_name);
+    MICRO_TESTS_FREE((void*)reader.tests[i].test.file_name);
+    MICRO_TESTS_FREE((void*)reader.tests[i].test.depends);
+  }
+  MICRO_TESTS_FREE(reader.tests);
+  MICRO_TESTS_FREE(executable_start);
+  MICRO_TESTS_FREE(sorted);
+  MICRO_TESTS_FREE(group_batch);
+  MICRO_TESTS_FREE(group_seconds);
+  MICRO_TESTS_FREE(groups);
+  MICRO_TESTS_FREE(batches);
+  MICRO_TESTS_FREE(members);
+  MICRO_TESTS_FREE(polled);
+  MICRO_TESTS_FREE(polled_batch);
+  return failed;
+}
+
+#endif // MICRO_TESTS_ORCHESTRATOR
+
+#ifdef MICRO_TESTS_DISTRIBUTED
+
+static void _micro_tests_put32(unsigned char *out, uint32_t value)
+{
+  out[0] = (unsigned char)(value >> 24);
+  out[1] = (unsigned char)(value >> 16);
+  out[2] = (unsigned char)(value >> 8);
+  out[3] = (unsigned char)value;
+}
+
+static uint32_t _micro_tests_get32(const unsigned char *in)
+{
+  return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16)
+    | ((uint32_t)in[2] << 8) | (uint32_t)in[3];
+}
+
+// Grow a buffer to hold at least size bytes, keeping its content
+static int _micro_tests_reserve(unsigned char **buffer, size_t *capacity,
+                                size_t size)
+{
+  if (size <= *capacity)
+    return 0;
+  size_t grown = (*capacity > 0) ? *capacity : 256;
+  while (grown < size)
+    grown *= 2;
+  unsigned char *bigger = MICRO_TESTS_CALLOC(grown, 1);
+  if (bigger == NULL)
+    return -1;
+  if (*capacity > 0)
+    memcpy(bigger, *buffer, *capacity);
+  MICRO_TESTS_FREE(*buffer);
+  *buffer = bigger;
+  *capacity = grown;
+  return 0;
+}
+
+static int _micro_tests_send_all(int fd, const void *data, size_t length)
+{
+  const unsigned char *it = data;
+  while (length > 0)
+  {
+    ssize_t sent = send(fd, it, length, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent <= 0)
+      return -1;
+    it += sent;
+    length -= (size_t)sent;
+  }
+  return 0;
+}
+
+static int _micro_tests_recv_all(int fd, void *data, size_t length)
+{
+  unsigned char *it = data;
+  while (length > 0)
+  {
+    ssize_t received = recv(fd, it, length, 0);
+    if (received < 0 && errno == EINTR)
+      continue;
+    if (received <= 0)
+      return -1;
+    it += received;
+    length -= (size_t)received;
+  }
+  return 0;
+}
+
+MICRO_TESTS_DEF int _micro_tests_message_send(int fd,
+                                              MicroTestsMessageType type,
+                                              const void *payload,
+                                              size_t length)
+{
+  unsigned char header[5];
+  _micro_tests_put32(header, (uint32_t)(length + 1));
+  header[4] = (unsigned char)type;
+  if (_micro_tests_send_all(fd, header, sizeof(header)) < 0
+      || _micro_tests_send_all(fd, payload, length) < 0)
+    return -1;
+  return 0;
+}
+
+MICRO_TESTS_DEF int _micro_tests_message_recv(int fd, unsigned char **buffer,
+                                              size_t *capacity,
+                                              size_t *length)
+{
+  unsigned char header[4];
+  if (_micro_tests_recv_all(fd, header, sizeof(header)) < 0)
+    return -1;
+  uint32_t size = _micro_tests_get32(header);
+  if (size == 0 || size > MICRO_TESTS_DISTRIBUTED_MAX_MESSAGE)
+    return -1;
+  // One more byte to terminate the payload
+  if (_micro_tests_reserve(buffer, capacity, (size_t)size + 1) < 0
+      || _micro_tests_recv_all(fd, *buffer, size) < 0)
+    return -1;
+  (*buffer)[size] = '\0';
+  *length = size - 1;
+  return (*buffer)[0];
+}
+
+// Probe an idle connection, so that a lost host is noticed
+static void _micro_tests_keepalive(int fd)
+{
+  int on = 1, seconds = MICRO_TESTS_DISTRIBUTED_KEEPALIVE_S, probes = 3;
+  setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &seconds, sizeof(seconds));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &seconds, sizeof(seconds));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+}
+
+static int _micro_tests_connect(const char *address)
+{
+  const char *colon = strrchr(address, ':');
+  if (colon == NULL)
+  {
+    fprintf(stderr, "Usage: --worker <host:port>\n");
+    return -1;
+  }
+  char host[256];
+  snprintf(host, sizeof(host), "%.*s", (int)(colon - address), address);
+
+  struct addrinfo hints = { 0 };
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  // The workers may start before the coordinator
+  struct timespec interval = { .tv_sec = 0, .tv_nsec = 100 * 1000 * 1000 };
+  for (int attempt = 0; attempt < MICRO_TESTS_DISTRIBUTED_CONNECT_S * 10;
+       ++attempt)
+  {
+    struct addrinfo *list;
+    int error = getaddrinfo(host, colon + 1, &hints, &list);
+    if (error != 0)
+    {
+      fprintf(stderr, "Error: %s: %s\n", address, gai_strerror(error));
+      return -1;
+    }
+    for (struct addrinfo *it = list; it != NULL; it = it->ai_next)
+    {
+      int fd = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+      if (fd < 0)
+        continue;
+      if (connect(fd, it->ai_addr, it->ai_addrlen) == 0)
+      {
+        freeaddrinfo(list);
+        _micro_tests_keepalive(fd);
+        return fd;
+      }
+      close(fd);
+    }
+    freeaddrinfo(list);
+    nanosleep(&interval, NULL);
+  }
+  fprintf(stderr, "Error: Could not connect to %s\n", address);
+  return -1;
+}
+
+static int _micro_tests_listen(const char *port)
+{
+  struct addrinfo hints = { 0 };
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  struct addrinfo *list;
+  int error = getaddrinfo(NULL, port, &hints, &list);
+  if (error != 0)
+  {
+    fprintf(stderr, "Error: --coordinator %s: %s\n", port, gai_strerror(error));
+    return -1;
+  }
+  int fd = -1;
+  for (struct addrinfo *it = list; it != NULL && fd < 0; it = it->ai_next)
+  {
+    fd = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+    if (fd < 0)
+      continue;
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(fd, it->ai_addr, it->ai_addrlen) != 0 || listen(fd, 64) != 0)
+    {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(list);
+  if (fd < 0)
+    perror("Error: --coordinator");
+  return fd;
+}
+
+static int _micro_tests_remote_report(MicroTests *micro_tests, size_t index,
+                                      MicroTestsStatus status, double seconds)
+{
+  micro_tests->durations[index] = seconds;
+  micro_tests->test_state[index] = (status == MICRO_TESTS_OK)
+    ? MICRO_TESTS_SCHED_DONE
+    : (status == MICRO_TESTS_FAILED) ? MICRO_TESTS_SCHED_FAILED
+    : MICRO_TESTS_SCHED_SKIPPED;
+  _MICRO_TESTS_REPORT(on_test_end, micro_tests, &_micro_tests_tests()[index],
+                      status);
+  return status == MICRO_TESTS_FAILED;
+}
+
+// Fail the tests of a batch that were not reported
+static int _micro_tests_remote_fail(MicroTests *micro_tests,
+                                    MicroTestsRemoteBatch *batch)
+{
+  int failed = 0;
+  for (size_t i = 0; i < batch->count; ++i)
+    if (micro_tests->test_state[batch->tests[i]] == MICRO_TESTS_SCHED_PENDING)
+      failed += _micro_tests_remote_report(micro_tests, batch->tests[i],
+                                           MICRO_TESTS_FAILED, -1);
+  batch->done = 1;
+  return failed;
+}
+
+// Queue the tests of a batch that were not reported again. After
+// MICRO_TESTS_DISTRIBUTED_ATTEMPTS without a result, the first of them
+// is the likely cause and fails
+static int _micro_tests_remote_requeue(MicroTests *micro_tests,
+                                       MicroTestsRemoteBatch *batch)
+{
+  int failed = 0;
+  size_t kept = 0;
+  for (size_t i = 0; i < batch->count; ++i)
+  {
+    size_t index = batch->tests[i];
+    if (micro_tests->test_state[index] != MICRO_TESTS_SCHED_PENDING)
+      continue;
+    // The batch is in the order of the plan, a prerequisite that failed
+    // was reported before
+    if (_micro_tests_deps_status(micro_tests, index) == MICRO_TESTS_DEPS_SKIP)
+      _micro_tests_remote_report(micro_tests, index, MICRO_TESTS_SKIPPED, -1);
+    else
+      batch->tests[kept++] = index;
+  }
+  batch->count = kept;
+  if (kept > 0 && batch->attempts >= MICRO_TESTS_DISTRIBUTED_ATTEMPTS)
+  {
+    MicroTest *test = &_micro_tests_tests()[batch->tests[0]];
+    fprintf(stderr, "Error: %s.%s was lost %u times\n", test->test_suite,
+            test->test_name, batch->attempts);
+    failed = _micro_tests_remote_report(micro_tests, batch->tests[0],
+                                        MICRO_TESTS_FAILED, -1);
+    batch->count--;
+    memmove(batch->tests, batch->tests + 1, batch->count * sizeof(size_t));
+    batch->attempts = 0;
+  }
+  batch->running = 0;
+  batch->done = (batch->count == 0);
+  return failed;
+}
+
+// Send the next batch that can run to an idle worker
+static int _micro_tests_remote_dispatch(MicroTestsRemoteBatch *batches,
+                                        size_t batch_count,
+                                        MicroTestsRemoteWorker *worker)
+{
+  // An exclusive batch runs alone
+  size_t running = 0;
+  for (size_t b = 0; b < batch_count; ++b)
+  {
+    if (batches[b].running && batches[b].exclusive)
+      return 0;
+    running += batches[b].running;
+  }
+  size_t b = 0;
+  while (b < batch_count
+         && (batches[b].running || batches[b].done
+             || (batches[b].exclusive && running > 0)))
+    b++;
+  if (b == batch_count)
+    return 0;
+
+  MicroTest *test = _micro_tests_tests();
+  size_t length = 0;
+  for (size_t i = 0; i < batches[b].count; ++i)
+  {
+    MicroTest *current = &test[batches[b].tests[i]];
+    length += strlen(current->test_suite) + strlen(current->test_name) + 2;
+  }
+  char *names = MICRO_TESTS_CALLOC(length + 1, 1);
+  if (names == NULL)
+    return -1;
+  char *it = names;
+  for (size_t i = 0; i < batches[b].count; ++i)
+  {
+    MicroTest *current = &test[batches[b].tests[i]];
+    it += sprintf(it, "%s.%s\n", current->test_suite, current->test_name);
+  }
+  int ret = _micro_tests_message_send(worker->fd, MICRO_TESTS_MESSAGE_BATCH,
+                                      names, length);
+  MICRO_TESTS_FREE(names);
+  if (ret < 0)
+    return -1;
+  batches[b].running = 1;
+  batches[b].attempts++;
+  worker->batch = b;
+  worker->heard = _micro_tests_time();
+  return 0;
+}
+
+// Handle the messages received from a worker
+//
+// Returns: the number of failed tests, or a negative value if the
+// worker broke the protocol
+static int _micro_tests_remote_handle(MicroTests *micro_tests,
+                                      MicroTestsRemoteBatch *batches,
+                                      MicroTestsRemoteWorker *worker)
+{
+  int failed = 0;
+  size_t offset = 0;
+  while (worker->length - offset >= 4)
+  {
+    const unsigned char *message = worker->buffer + offset;
+    uint32_t size = _micro_tests_get32(message);
+    if (size == 0 || size > MICRO_TESTS_DISTRIBUTED_MAX_MESSAGE)
+      return -1;
+    if (worker->length - offset < 4 + (size_t)size)
+      break;
+    offset += 4 + size;
+
+    const unsigned char *payload = message + 5;
+    size_t length = size - 1;
+    MicroTestsRemoteBatch *batch = (worker->batch != SIZE_MAX)
+      ? &batches[worker->batch] : NULL;
+    switch (message[4])
+    {
+    case MICRO_TESTS_MESSAGE_HELLO:
+      if (length != 4
+          || _micro_tests_get32(payload) != MICRO_TESTS_PROTOCOL_VERSION)
+      {
+        fprintf(stderr, "Error: A worker speaks another protocol version\n");
+        return -1;
+      }
+      worker->ready = 1;
+      break;
+    case MICRO_TESTS_MESSAGE_RESULT:
+    {
+      if (batch == NULL || length != 13)
+        return -1;
+      uint32_t position = _micro_tests_get32(payload);
+      uint64_t nanoseconds = ((uint64_t)_micro_tests_get32(payload + 5) << 32)
+        | _micro_tests_get32(payload + 9);
+      if (position >= batch->count || payload[4] > MICRO_TESTS_SKIPPED)
+        return -1;
+      size_t index = batch->tests[position];
+      if (micro_tests->test_state[index] == MICRO_TESTS_SCHED_PENDING)
+        failed += _micro_tests_remote_report(micro_tests, index,
+                                             (MicroTestsStatus)payload[4],
+                                             nanoseconds * 1e-9);
+      // This attempt counts, the next ones start again
+      batch->attempts = 1;
+      break;
+    }
+    case MICRO_TESTS_MESSAGE_BATCH_END:
+      if (batch == NULL)
+        return -1;
+      failed += _micro_tests_remote_requeue(micro_tests, batch);
+      if (!batch->done)
+        fprintf(stderr, "Error: A worker did not run %zu tests of its batch, "
+                "they are queued again\n", batch->count);
+      worker->batch = SIZE_MAX;
+      break;
+    default:
+      return -1;
+    }
+  }
+  memmove(worker->buffer, worker->buffer + offset, worker->length - offset);
+  worker->length -= offset;
+  return failed;
+}
+
+// Close the connection of a worker, the tests of its batch that were
+// not reported go back to the queue
+static int _micro_tests_remote_drop(MicroTests *micro_tests,
+                                    MicroTestsRemoteBatch *batches,
+                                    MicroTestsRemoteWorker *worker)
+{
+  int failed = 0;
+  close(worker->fd);
+  MICRO_TESTS_FREE(worker->buffer);
+  if (worker->batch != SIZE_MAX)
+  {
+    fprintf(stderr, "Error: Lost a worker, its batch is queued again\n");
+    failed = _micro_tests_remote_requeue(micro_tests, &batches[worker->batch]);
+  }
+  *worker = (MicroTestsRemoteWorker){ .fd = -1, .batch = SIZE_MAX };
+  return failed;
+}
+
+static size_t _micro_tests_remote_find(size_t *group, size_t i)
+{
+  while (group[i] != i)
+  {
+    group[i] = group[group[i]];
+    i = group[i];
+  }
+  return i;
+}
+
+MICRO_TESTS_DEF int _micro_tests_coordinate(MicroTests *micro_tests)
+{
+  size_t count = _micro_tests_count();
+  size_t n = (count > 0) ? count : 1;
+  size_t *group = MICRO_TESTS_CALLOC(n, sizeof(size_t));
+  size_t *group_batch = MICRO_TESTS_CALLOC(n, sizeof(size_t));
+  size_t *members = MICRO_TESTS_CALLOC(n, sizeof(size_t));
+  MicroTestsRemoteBatch *batches = MICRO_TESTS_CALLOC(n, sizeof(MicroTestsRemoteBatch));
+  MicroTestsRemoteWorker *workers = NULL;
+  // The listener, then the workers
+  struct pollfd *polled = MICRO_TESTS_CALLOC(1, sizeof(struct pollfd));
+  size_t worker_count = 0, worker_capacity = 0;
+  int failed = 0;
+  int listener = -1;
+  if (group == NULL || group_batch == NULL || members == NULL
+      || batches == NULL || polled == NULL)
+  {
+    perror("calloc");
+    failed = 1;
+    goto done;
+  }
+
+  // Tests linked by prerequisites run in the same batch and process
+  double known_sum = 0;
+  size_t known = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    group[i] = i;
+    group_batch[i] = SIZE_MAX;
+  }
+  for (size_t k = 0; k < micro_tests->order_count; ++k)
+  {
+    size_t i = micro_tests->order[k];
+    for (size_t d = micro_tests->deps_start[i]; d < micro_tests->deps_start[i + 1]; ++d)
+      group[_micro_tests_remote_find(group, i)] =
+        _micro_tests_remote_find(group, micro_tests->deps[d]);
+    if (micro_tests->durations[i] >= 0)
+    {
+      known_sum += micro_tests->durations[i];
+      known++;
+    }
+  }
+  // Without any duration the batches are sized by number of tests,
+  // otherwise the tests not measured yet take the mean duration
+  double fallback = (known > 0) ? known_sum / known : 0;
+  size_t batch_tests = MICRO_TESTS_DISTRIBUTED_BATCH_TESTS;
+  if (known == 0)
+  {
+    size_t per_batch = (micro_tests->order_count
+                        + MICRO_TESTS_DISTRIBUTED_MIN_BATCHES - 1)
+      / MICRO_TESTS_DISTRIBUTED_MIN_BATCHES;
+    if (per_batch < batch_tests)
+      batch_tests = (per_batch > 0) ? per_batch : 1;
+  }
+
+  // A group is exclusive if one of its tests is
+  MicroTest *test = _micro_tests_tests();
+  for (size_t k = 0; k < micro_tests->order_count; ++k)
+  {
+    size_t i = micro_tests->order[k];
+    if ((test[i].flags & MICRO_TESTS_FLAG_SERIAL) || test[i].resources != NULL)
+      group_batch[_micro_tests_remote_find(group, i)] = SIZE_MAX - 1;
+  }
+
+  // Batches of about MICRO_TESTS_DISTRIBUTED_BATCH_MS in the order of
+  // the plan, so the critical path is handed out first. The exclusive
+  // groups fill batches of their own
+  size_t batch_count = 0, open[2] = { SIZE_MAX, SIZE_MAX };
+  for (size_t k = 0; k < micro_tests->order_count; ++k)
+  {
+    size_t i = micro_tests->order[k];
+    // Reported as skipped without a worker
+    if (micro_tests->test_state[i] == MICRO_TESTS_SCHED_BROKEN)
+      continue;
+    size_t root = _micro_tests_remote_find(group, i);
+    if (group_batch[root] >= SIZE_MAX - 1)
+    {
+      _Bool exclusive = (group_batch[root] == SIZE_MAX - 1);
+      size_t *batch = &open[exclusive];
+      if (*batch == SIZE_MAX
+          || batches[*batch].seconds >= MICRO_TESTS_DISTRIBUTED_BATCH_MS * 1e-3
+          || batches[*batch].count >= batch_tests)
+      {
+        *batch = batch_count++;
+        batches[*batch].exclusive = exclusive;
+      }
+      group_batch[root] = *batch;
+    }
+    MicroTestsRemoteBatch *batch = &batches[group_batch[root]];
+    batch->seconds += (micro_tests->durations[i] >= 0)
+      ? micro_tests->durations[i] : fallback;
+    batch->count++;
+  }
+  size_t offset = 0;
+  for (size_t b = 0; b < batch_count; ++b)
+  {
+    batches[b].tests = members + offset;
+    offset += batches[b].count;
+    batches[b].count = 0;
+  }
+  for (size_t k = 0; k < micro_tests->order_count; ++k)
+  {
+    size_t i = micro_tests->order[k];
+    if (micro_tests->test_state[i] == MICRO_TESTS_SCHED_BROKEN)
+      continue;
+    MicroTestsRemoteBatch *batch =
+      &batches[group_batch[_micro_tests_remote_find(group, i)]];
+    batch->tests[batch->count++] = i;
+  }
+
+  listener = _micro_tests_listen(micro_tests->coordinator_port);
+  if (listener < 0)
+  {
+    failed = 1;
+    goto done;
+  }
+  if (micro_tests->debug)
+    printf("debug: %zu tests in %zu batches, waiting for workers on port %s\n",
+           micro_tests->order_count, batch_count,
+           micro_tests->coordinator_port);
+
+  _MICRO_TESTS_REPORT(on_run_start, micro_tests, micro_tests->order_count);
+  // An unknown prerequisite or a cycle, like in _micro_tests_run
+  for (size_t k = 0; k < micro_tests->order_count; ++k)
+    if (micro_tests->test_state[micro_tests->order[k]] == MICRO_TESTS_SCHED_BROKEN)
+      _micro_tests_remote_report(micro_tests, micro_tests->order[k],
+                                 MICRO_TESTS_SKIPPED, -1);
+  size_t done_count = 0;
+  // Time the last worker was lost, or -1 if a worker is connected or
+  // none connected yet
+  double deserted = -1;
+  _Bool connected = 0;
+  while (done_count < batch_count)
+  {
+    // Hand out the queued batches to the idle workers
+    for (size_t w = 0; w < worker_count; ++w)
+      if (workers[w].ready && workers[w].batch == SIZE_MAX
+          && _micro_tests_remote_dispatch(batches, batch_count, &workers[w]) < 0)
+        failed += _micro_tests_remote_drop(micro_tests, batches, &workers[w]);
+
+    // The dropped workers are removed after the dispatch
+    size_t kept = 0;
+    for (size_t w = 0; w < worker_count; ++w)
+      if (workers[w].fd >= 0)
+        workers[kept++] = workers[w];
+    worker_count = kept;
+    done_count = 0;
+    for (size_t b = 0; b < batch_count; ++b)
+      done_count += batches[b].done;
+    if (done_count == batch_count)
+      break;
+
+    // Once all the workers are lost, another one may still connect
+    double now = _micro_tests_time();
+    if (worker_count > 0 || !connected)
+      deserted = -1;
+    else if (deserted < 0)
+      deserted = now;
+    else if (now - deserted >= MICRO_TESTS_DISTRIBUTED_CONNECT_S)
+    {
+      fprintf(stderr, "Error: No worker for %d s, the tests left fail\n",
+              MICRO_TESTS_DISTRIBUTED_CONNECT_S);
+      for (size_t b = 0; b < batch_count; ++b)
+        if (!batches[b].done)
+          failed += _micro_tests_remote_fail(micro_tests, &batches[b]);
+      break;
+    }
+
+    // Wake up for the first worker that stays silent for too long, or
+    // when no worker came back
+    int timeout = -1;
+    if (deserted >= 0)
+      timeout = (int)((deserted + MICRO_TESTS_DISTRIBUTED_CONNECT_S - now)
+                      * 1000) + 1;
+    polled[0] = (struct pollfd){ .fd = listener, .events = POLLIN };
+    for (size_t w = 0; w < worker_count; ++w)
+    {
+      polled[w + 1] = (struct pollfd){ .fd = workers[w].fd, .events = POLLIN };
+      if (workers[w].batch == SIZE_MAX)
+        continue;
+      double left = workers[w].heard + MICRO_TESTS_DISTRIBUTED_TIMEOUT_S - now;
+      int milliseconds = (left > 0) ? (int)(left * 1000) + 1 : 0;
+      if (timeout < 0 || milliseconds < timeout)
+        timeout = milliseconds;
+    }
+    if (poll(polled, worker_count + 1, timeout) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("poll");
+      failed++;
+      break;
+    }
+
+    for (size_t w = 0; w < worker_count; ++w)
+    {
+      if (polled[w + 1].revents == 0)
+        continue;
+      MicroTestsRemoteWorker *worker = &workers[w];
+      int handled = -1;
+      if (_micro_tests_reserve(&worker->buffer, &worker->capacity,
+                               worker->length + 4096) == 0)
+      {
+        ssize_t received = recv(worker->fd, worker->buffer + worker->length,
+                                worker->capacity - worker->length, 0);
+        if (received > 0)
+        {
+          worker->length += (size_t)received;
+          worker->heard = _micro_tests_time();
+          handled = _micro_tests_remote_handle(micro_tests, batches, worker);
+        } else if (received < 0 && errno == EINTR)
+          handled = 0;
+      }
+      if (handled < 0)
+        failed += _micro_tests_remote_drop(micro_tests, batches, worker);
+      else
+        failed += handled;
+    }
+
+    // A worker stuck in a test, or on a host that stopped answering
+    now = _micro_tests_time();
+    for (size_t w = 0; w < worker_count; ++w)
+      if (workers[w].fd >= 0 && workers[w].batch != SIZE_MAX
+          && now - workers[w].heard > MICRO_TESTS_DISTRIBUTED_TIMEOUT_S)
+      {
+        fprintf(stderr, "Error: A worker did not report for %d s\n",
+                MICRO_TESTS_DISTRIBUTED_TIMEOUT_S);
+        failed += _micro_tests_remote_drop(micro_tests, batches, &workers[w]);
+      }
+
+    if (polled[0].revents & POLLIN)
+    {
+      int fd = accept(listener, NULL, NULL);
+      if (fd >= 0 && worker_count == worker_capacity)
+      {
+        size_t capacity = (worker_capacity > 0) ? 2 * worker_capacity : 8;
+        MicroTestsRemoteWorker *grown =
+          MICRO_TESTS_CALLOC(capacity, sizeof(MicroTestsRemoteWorker));
+        struct pollfd *grown_polled =
+          MICRO_TESTS_CALLOC(capacity + 1, sizeof(struct pollfd));
+        if (grown == NULL || grown_polled == NULL)
+        {
+          MICRO_TESTS_FREE(grown);
+          MICRO_TESTS_FREE(grown_polled);
+          close(fd);
+          fd = -1;
+        } else
+        {
+          if (worker_count > 0)
+            memcpy(grown, workers, worker_count * sizeof(MicroTestsRemoteWorker));
+          MICRO_TESTS_FREE(workers);
+          MICRO_TESTS_FREE(polled);
+          workers = grown;
+          polled = grown_polled;
+          worker_capacity = capacity;
+        }
+      }
+      if (fd >= 0)
+      {
+        connected = 1;
+        _micro_tests_keepalive(fd);
+        workers[worker_count++] = (MicroTestsRemoteWorker){
+          .fd = fd, .batch = SIZE_MAX,
+        };
+      }
+    }
+  }
+  _MICRO_TESTS_REPORT(on_run_end, micro_tests, failed);
+
+done:
+  for (size_t w = 0; w < worker_count; ++w)
+  {
+    _micro_tests_message_send(workers[w].fd, MICRO_TESTS_MESSAGE_BYE, NULL, 0);
+    close(workers[w].fd);
+    MICRO_TESTS_FREE(workers[w].buffer);
+  }
+  if (listener >= 0)
+    close(listener);
+  MICRO_TESTS_FREE(workers);
+  MICRO_TESTS_FREE(polled);
+  MICRO_TESTS_FREE(group);
+  MICRO_TESTS_FREE(group_batch);
+  MICRO_TESTS_FREE(members);
+  MICRO_TESTS_FREE(batches);
+  return failed;
+}
+
+// Outcome of a test of the batch, from the child process of a worker
+typedef struct {
+  // Position of the test in the plan of the batch
+  size_t position;
+  MicroTestsStatus status;
+  uint64_t nanoseconds;
+} _MicroTestsWorkerResult;
+
+// Send the outcome of the test at a position of the batch
+static int _micro_tests_work_report(int fd, size_t position,
+                                    MicroTestsStatus status,
+                                    uint64_t nanoseconds)
+{
+  unsigned char result[13];
+  _micro_tests_put32(result, (uint32_t)position);
+  result[4] = (unsigned char)status;
+  _micro_tests_put32(result + 5, (uint32_t)(nanoseconds >> 32));
+  _micro_tests_put32(result + 9, (uint32_t)nanoseconds);
+  return _micro_tests_message_send(fd, MICRO_TESTS_MESSAGE_RESULT,
+                                   result, sizeof(result));
+}
+
+// Run the planned tests of a batch and write their outcomes to fd
+static void _micro_tests_work_batch(MicroTests *batch, int fd)
+{
+  MicroTest *test = _micro_tests_tests();
+  for (size_t k = 0; k < batch->order_count; ++k)
+  {
+    size_t index = batch->order[k];
+    MicroTestsStatus status = MICRO_TESTS_SKIPPED;
+    double start = _micro_tests_time();
+    if (_micro_tests_deps_status(batch, index) == MICRO_TESTS_DEPS_READY)
+      status = _micro_tests_exec(batch, &test[index]);
+    batch->test_state[index] = (status == MICRO_TESTS_OK)
+      ? MICRO_TESTS_SCHED_DONE
+      : (status == MICRO_TESTS_FAILED) ? MICRO_TESTS_SCHED_FAILED
+      : MICRO_TESTS_SCHED_SKIPPED;
+    _MicroTestsWorkerResult result = {
+      .position    = k,
+      .status      = status,
+      .nanoseconds = (uint64_t)((_micro_tests_time() - start) * 1e9),
+    };
+    fflush(stdout);
+    if (write(fd, &result, sizeof(result)) != sizeof(result))
+      return;
+  }
+}
+
+MICRO_TESTS_DEF int _micro_tests_work(MicroTests *micro_tests)
+{
+  int fd = _micro_tests_connect(micro_tests->worker_address);
+  if (fd < 0)
+    return 1;
+
+  unsigned char hello[4];
+  _micro_tests_put32(hello, MICRO_TESTS_PROTOCOL_VERSION);
+  unsigned char *buffer = NULL;
+  size_t capacity = 0, length = 0;
+  int failed = 0;
+  int type = (_micro_tests_message_send(fd, MICRO_TESTS_MESSAGE_HELLO,
+                                        hello, sizeof(hello)) == 0)
+    ? _micro_tests_message_recv(fd, &buffer, &capacity, &length) : -1;
+  while (type == MICRO_TESTS_MESSAGE_BATCH)
+  {
+    // The batch is planned and run like a --test-file
+    MicroTests batch = *micro_tests;
+    batch.selection = NULL;
+    batch.durations_file = NULL;
+    if (_micro_tests_select(&batch, (char*)buffer + 1) < 0
+        || _micro_tests_plan(&batch) < 0)
+    {
+      MICRO_TESTS_FREE(batch.selection);
+      type = -1;
+      break;
+    }
+
+    // A child runs the batch, so that a crashing test only ends it
+    int pipe_fd[2];
+    pid_t pid = -1;
+    if (pipe(pipe_fd) == 0)
+    {
+      fflush(stdout);
+      fflush(stderr);
+      pid = fork();
+      if (pid == 0)
+      {
+        close(fd);
+        close(pipe_fd[0]);
+        _micro_tests_work_batch(&batch, pipe_fd[1]);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(0);
+      }
+      close(pipe_fd[1]);
+    }
+    if (pid < 0)
+    {
+      perror("fork");
+      _micro_tests_plan_free(&batch);
+      MICRO_TESTS_FREE(batch.selection);
+      type = -1;
+      break;
+    }
+
+    MicroTest *test = _micro_tests_tests();
+    _MicroTestsWorkerResult result;
+    size_t ran = 0;
+    int sent = 0;
+    while (sent == 0)
+    {
+      ssize_t got = read(pipe_fd[0], &result, sizeof(result));
+      if (got < 0 && errno == EINTR)
+        continue;
+      if (got != sizeof(result) || result.position != ran)
+        break;
+      ran++;
+      size_t index = batch.order[result.position];
+      failed += (result.status == MICRO_TESTS_FAILED);
+      // A prerequisite outside of the batch is not reported
+      if (batch.selection[index] != 0)
+        sent = _micro_tests_work_report(fd, batch.selection[index] - 1,
+                                        result.status, result.nanoseconds);
+    }
+    close(pipe_fd[0]);
+    int wstatus = 0;
+    while (waitpid(pid, &wstatus, 0) < 0 && errno == EINTR)
+      ;
+    // The test that ended the child fails, the coordinator queues the
+    // tests after it again
+    if (ran < batch.order_count && sent == 0)
+    {
+      size_t index = batch.order[ran];
+      fprintf(stderr, "Error: %s.%s ended the batch", test[index].test_suite,
+              test[index].test_name);
+      if (WIFSIGNALED(wstatus))
+        fprintf(stderr, " with signal %d", WTERMSIG(wstatus));
+      fprintf(stderr, "\n");
+      failed++;
+      if (batch.selection[index] != 0)
+        sent = _micro_tests_work_report(fd, batch.selection[index] - 1,
+                                        MICRO_TESTS_FAILED, 0);
+    }
+    if (micro_tests->debug)
+      printf("debug: ran %zu tests of a batch of %zu\n", ran,
+             batch.order_count);
+    _micro_tests_plan_free(&batch);
+    MICRO_TESTS_FREE(batch.selection);
+
+    type = (sent == 0 && _micro_tests_message_send(fd,
+                           MICRO_TESTS_MESSAGE_BATCH_END, NULL, 0) == 0)
+      ? _micro_tests_message_recv(fd, &buffer, &capacity, &length) : -1;
+  }
+  if (type != MICRO_TESTS_MESSAGE_BYE)
+  {
+    fprintf(stderr, "Error: Lost the coordinator %s\n",
+            micro_tests->worker_address);
+    failed++;
+  }
+  close(fd);
+  MICRO_TESTS_FREE(buffer);
+  return failed;
+}
+
+#endif // MICRO_TESTS_DISTRIBUTED
+
+#ifdef MICRO_TESTS_CACHE
+
+// Objects whose build-ids make the key of --cache
+typedef struct {
+  uint64_t hash;
+  // Load addresses of the plugins
+  ElfW(Addr) *plugins;
+  size_t plugin_count;
+  // Objects visited, hashed and without a build-id
+  size_t visited;
+  size_t hashed;
+  size_t missing;
+} _MicroTestsBuildIds;
+
+static uint64_t _micro_tests_fnv(uint64_t hash, const void *data, size_t size)
+{
+  const unsigned char *it = data;
+  for (size_t i = 0; i < size; ++i)
+  {
+    hash ^= it[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static int _micro_tests_build_id_visit(struct dl_phdr_info *info, size_t size,
+                                       void *ctx)
+{
+  (void) size;
+  _MicroTestsBuildIds *ids = ctx;
+  // The executable comes first, the plugins are among the libraries
+  _Bool wanted = (ids->visited++ == 0);
+  for (size_t p = 0; p < ids->plugin_count && !wanted; ++p)
+    wanted = (info->dlpi_addr == ids->plugins[p]);
+  if (!wanted)
+    return 0;
+
+  for (ElfW(Half) h = 0; h < info->dlpi_phnum; ++h)
+  {
+    const ElfW(Phdr) *phdr = &info->dlpi_phdr[h];
+    if (phdr->p_type != PT_NOTE)
+      continue;
+    const unsigned char *it =
+      (const unsigned char*)(info->dlpi_addr + phdr->p_vaddr);
+    const unsigned char *end = it + phdr->p_memsz;
+    while (it + sizeof(ElfW(Nhdr)) <= end)
+    {
+      const ElfW(Nhdr) *note = (const ElfW(Nhdr)*)it;
+      const unsigned char *name = it + sizeof(ElfW(Nhdr));
+      const unsigned char *desc = name + ((note->n_namesz + 3) & ~3u);
+      if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4
+          && memcmp(name, "GNU", 4) == 0 && desc + note->n_descsz <= end)
+      {
+        ids->hash = _micro_tests_fnv(ids->hash, desc, note->n_descsz);
+        ids->hashed++;
+        return 0;
+      }
+      it = desc + ((note->n_descsz + 3) & ~3u);
+    }
+  }
+  ids->missing++;
+  return 0;
+}
+
+MICRO_TESTS_DEF int _micro_tests_cache_key(int argc, char **argv,
+                                           uint64_t *key)
+{
+  _MicroTestsBuildIds ids = {
+    .hash    = 0xcbf29ce484222325ULL,
+    .plugins = NULL,
+  };
+#ifdef MICRO_TESTS_PLUGINS
+  size_t count = _micro_tests_registry.plugin_count;
+  ids.plugins = MICRO_TESTS_CALLOC(count > 0 ? count : 1, sizeof(ElfW(Addr)));
+  if (ids.plugins == NULL)
+    return -1;
+  for (size_t p = 0; p < count; ++p)
+  {
+    struct link_map *map;
+    if (dlinfo(_micro_tests_registry.plugins[p], RTLD_DI_LINKMAP, &map) == 0)
+      ids.plugins[ids.plugin_count++] = map->l_addr;
+  }
+#endif
+  dl_iterate_phdr(_micro_tests_build_id_visit, &ids);
+  MICRO_TESTS_FREE(ids.plugins);
+  if (ids.hashed == 0 || ids.missing > 0)
+    return -1;
+
+  // The arguments select the tests and may change their outcomes,
+  // except the ones of the cache and of the output
+  static const struct { const char *name; int values; } ignored[] = {
+    { "--cache", 1 }, { "--no-cache", 0 }, { "--reporter", 1 },
+    { "--durations", 1 }, { "--no-banner", 0 }, { "--debug", 0 },
+    { "--quiet", 0 },
+  };
+  for (int i = 1; i < argc; ++i)
+  {
+    size_t k = 0;
+    while (k < sizeof(ignored) / sizeof(ignored[0])
+           && _micro_tests_strcmp(argv[i], ignored[k].name) != 0)
+      k++;
+    if (k < sizeof(ignored) / sizeof(ignored[0]))
+      i += ignored[k].values;
+    else
+      ids.hash = _micro_tests_fnv(ids.hash, argv[i], strlen(argv[i]) + 1);
+  }
+  *key = ids.hash;
+  return 0;
+}
+
+MICRO_TESTS_DEF int _micro_tests_cache_load(MicroTests *micro_tests,
+                                            int argc, char **argv)
+{
+  uint64_t key;
+  if (_micro_tests_cache_key(argc, argv, &key) < 0)
+  {
+    fprintf(stderr, "Warning: --cache needs the build-ids of the tests, "
+            "link them with -Wl,--build-id\n");
+    micro_tests->cache_dir = NULL;
+    return 0;
+  }
+  if (mkdir(micro_tests->cache_dir, 0777) != 0 && errno != EEXIST)
+  {
+    perror(micro_tests->cache_dir);
+    return -1;
+  }
+  size_t count = _micro_tests_count();
+  size_t length = strlen(micro_tests->cache_dir) + 18;
+  micro_tests->cache_file = MICRO_TESTS_CALLOC(length, 1);
+  micro_tests->cached = MICRO_TESTS_CALLOC(count > 0 ? count : 1, 1);
+  size_t *stack = MICRO_TESTS_CALLOC(count > 0 ? count : 1, sizeof(size_t));
+  if (micro_tests->cache_file == NULL || micro_tests->cached == NULL
+      || stack == NULL)
+  {
+    MICRO_TESTS_FREE(stack);
+    return -1;
+  }
+  snprintf(micro_tests->cache_file, length, "%s/%016llx",
+           micro_tests->cache_dir, (unsigned long long)key);
+
+  FILE *file = micro_tests->no_cache ? NULL
+    : fopen(micro_tests->cache_file, "r");
+  if (file == NULL)
+  {
+    MICRO_TESTS_FREE(stack);
+    return 0;
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char *content = MICRO_TESTS_CALLOC(size > 0 ? size + 1 : 1, 1);
+  if (content != NULL && size > 0)
+    content[fread(content, 1, size, file)] = '\0';
+  fclose(file);
+
+  // The passed tests, looked up like a --test-file
+  MicroTests passed = *micro_tests;
+  passed.selection = NULL;
+  if (content == NULL || _micro_tests_select(&passed, content) < 0)
+  {
+    MICRO_TESTS_FREE(content);
+    MICRO_TESTS_FREE(passed.selection);
+    MICRO_TESTS_FREE(stack);
+    return -1;
+  }
+  MicroTest *test = _micro_tests_tests();
+  for (size_t i = 0; i < count; ++i)
+    micro_tests->cached[i] = passed.selection[i] != 0
+      && _micro_tests_is_selected(micro_tests, &test[i]);
+  MICRO_TESTS_FREE(content);
+  MICRO_TESTS_FREE(passed.selection);
+
+  // The prerequisites of the tests that run again run too, they may
+  // prepare state for them
+  size_t top = 0;
+  for (size_t i = 0; i < count; ++i)
+    if (_micro_tests_is_selected(micro_tests, &test[i]))
+      stack[top++] = i;
+  while (top > 0)
+  {
+    MicroTest *current = &test[stack[--top]];
+    for (const char *it = current->depends; it != NULL && *it != '\0';)
+    {
+      size_t len = strcspn(it, ",");
+      long index = _micro_tests_find_test(it, len, current->test_suite);
+      if (index >= 0 && micro_tests->cached[index])
+      {
+        micro_tests->cached[index] = 0;
+        stack[top++] = (size_t)index;
+      }
+      it += len + (it[len] == ',');
+    }
+  }
+  MICRO_TESTS_FREE(stack);
+
+  size_t skipped = 0;
+  for (size_t i = 0; i < count; ++i)
+    skipped += micro_tests->cached[i];
+  if (skipped > 0)
+    fprintf(stderr, "Skipping %zu tests that passed with the same build-id "
+            "and arguments, use --no-cache to run them\n", skipped);
+  return 0;
+}
+
+MICRO_TESTS_DEF int _micro_tests_cache_save(MicroTests *micro_tests)
+{
+  // Written aside and renamed, the concurrent runs see a whole file
+  size_t length = strlen(micro_tests->cache_file) + 32;
+  char *temporary = MICRO_TESTS_CALLOC(length, 1);
+  if (temporary == NULL)
+    return -1;
+  snprintf(temporary, length, "%s.%ld", micro_tests->cache_file,
+           (long)getpid());
+  FILE *file = fopen(temporary, "w");
+  if (file == NULL)
+  {
+    perror(temporary);
+    MICRO_TESTS_FREE(temporary);
+    return -1;
+  }
+
+  size_t count = _micro_tests_count();
+  MicroTest *test = _micro_tests_tests();
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (test[i].marker != 0xDeadBeaf)
+      continue;
+    if (micro_tests->cached[i]
+        || (_micro_tests_is_selected(micro_tests, &test[i])
+            && micro_tests->test_state[i] == MICRO_TESTS_SCHED_DONE))
+      fprintf(file, "%s.%s\n", test[i].test_suite, test[i].test_name);
+  }
+  int ret = (fclose(file) == 0
+             && rename(temporary, micro_tests->cache_file) == 0) ? 0 : -1;
+  if (ret < 0)
+  {
+    perror(micro_tests->cache_file);
+    unlink(temporary);
+  }
+  MICRO_TESTS_FREE(temporary);
+  return ret;
+}
+
+#endif // MICRO_TESTS_CACHE
+
+#ifdef MICRO_TESTS_BENCHMARK
+
+MICRO_TESTS_DEF double _micro_tests_log2(double x)
+{
+  if (x <= 0)
+    return 0;
+
+  // x = m * 2^e with m in [1, 2)
+  int e = 0;
+  while (x >= 2) { x /= 2; e++; }
+  while (x < 1)  { x *= 2; e--; }
+
+  // ln(m) = 2 * atanh((m - 1) / (m + 1)), the ratio is at most 1/3
+  double y = (x - 1) / (x + 1);
+  double y2 = y * y;
+  double term = y;
+  double ln = 0;
+  for (int k = 1; k < 40; k += 2)
+  {
+    ln += term / k;
+    term *= y2;
+  }
+  return e + 2 * ln / 0.69314718055994530942;
+}
+
+MICRO_TESTS_DEF double _micro_tests_sqrt(double x)
+{
+  if (x <= 0)
+    return 0;
+  double r = (x > 1) ? x : 1;
+  for (int i = 0; i < 100; ++i)
+  {
+    double next = (r + x / r) / 2;
+    if (next >= r)
+      break;
+    r = next;
+  }
+  return r;
+}
+
+MICRO_TESTS_DEF const char*
+_micro_tests_complexity_name(MicroTestsComplexity complexity)
+{
+  switch (complexity)
+  {
+  case MICRO_TESTS_O_1:       return "O(1)";
+  case MICRO_TESTS_O_LOG_N:   return "O(log n)";
+  case MICRO_TESTS_O_N:       return "O(n)";
+  case MICRO_TESTS_O_N_LOG_N: return "O(n log n)";
+  case MICRO_TESTS_O_N2:      return "O(n^2)";
+  default:                    return "O(?)";
+  }
+}
+
+MICRO_TESTS_DEF double
+_micro_tests_complexity_value(MicroTestsComplexity complexity, double n)
+{
+  switch (complexity)
+  {
+  case MICRO_TESTS_O_LOG_N:   return _micro_tests_log2(n);
+  case MICRO_TESTS_O_N:       return n;
+  case MICRO_TESTS_O_N_LOG_N: return n * _micro_tests_log2(n);
+  case MICRO_TESTS_O_N2:      return n * n;
+  default:                    return 1;
+  }
+}
+
+MICRO_TESTS_DEF MicroTestsComplexity
+_micro_tests_bench_fit(const size_t *n, const double *ns, size_t count,
+                       double *intercept, double *coefficient,
+                       double *errors)
+{
+  if (count >= 5)
+  {
+    n++;
+    ns++;
+    count--;
+  }
+
+  double mean = 0;
+  for (size_t i = 0; i < count; ++i)
+    mean += ns[i] / count;
+
+  double intercepts[_MICRO_TESTS_O_COUNT] = {0};
+  double coefficients[_MICRO_TESTS_O_COUNT] = {0};
+  MicroTestsComplexity best = MICRO_TESTS_O_1;
+  for (int c = MICRO_TESTS_O_1; c < _MICRO_TESTS_O_COUNT; ++c)
+  {
+    // Minimize sum (ns - intercept - coefficient * f(n))^2, a class
+    // that would need a negative coefficient is only a constant
+    double mean_f = 0;
+    for (size_t i = 0; i < count; ++i)
+      mean_f += _micro_tests_complexity_value(c, (double)n[i]) / count;
+    double ff = 0, tf = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+      double f = _micro_tests_complexity_value(c, (double)n[i]) - mean_f;
+      ff += f * f;
+      tf += (ns[i] - mean) * f;
+    }
+    coefficients[c] = (ff > 0 && tf > 0) ? tf / ff : 0;
+    intercepts[c] = mean - coefficients[c] * mean_f;
+
+    double error = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+      double d = ns[i] - intercepts[c]
+        - coefficients[c] * _micro_tests_complexity_value(c, (double)n[i]);
+      error += d * d;
+    }
+    errors[c] = (mean > 0) ? _micro_tests_sqrt(error / count) / mean : 0;
+    if (errors[c] < errors[best])
+      best = c;
+  }
+
+  // Noise can favor a neighboring class, so take the lowest class
+  // that fits almost as well as the best one
+  for (int c = MICRO_TESTS_O_1; c < (int)best; ++c)
+    if (errors[c] <= errors[best] * 1.1 + 0.01)
+    {
+      best = c;
+      break;
+    }
+
+  *intercept = intercepts[best];
+  *coefficient = coefficients[best];
+  return best;
+}
+
+#ifdef MICRO_TESTS_MULTITHREADED
+
+MICRO_TESTS_DEF void *_micro_tests_bench_thread(void *args)
+{
+  MicroTestsBenchThread *thread = args;
+  if (thread->cpu >= 0)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(thread->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+
+  // Start barrier, the threads spin so that they start together
+  __atomic_fetch_add(thread->ready, 1, __ATOMIC_RELEASE);
+  while (!__atomic_load_n(thread->go, __ATOMIC_ACQUIRE))
+    sched_yield();
+
+  _micro_tests_bench_body(thread->spec, &thread->bench);
+  return NULL;
+}
+
+#endif // MICRO_TESTS_MULTITHREADED
+
+// Timer of the benchmarks, see _micro_tests_timer_init
+static MicroTestsTimer _micro_tests_timer = {
+  .tsc         = 0,
+  .rdtscp      = 0,
+  .ns_per_tick = 1,
+  .overhead    = 0,
+};
+
+MICRO_TESTS_DEF uint64_t _micro_tests_timer_start(void)
+{
+#ifdef _MICRO_TESTS_TSC
+  if (_micro_tests_timer.tsc)
+  {
+    // lfence keeps the earlier instructions out of the measurement
+    uint32_t lo, hi;
+    __asm__ __volatile__("lfence\n\trdtsc" : "=a"(lo), "=d"(hi) : : "memory");
+    return ((uint64_t)hi << 32) | lo;
+  }
+#endif
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+MICRO_TESTS_DEF uint64_t _micro_tests_timer_stop(void)
+{
+#ifdef _MICRO_TESTS_TSC
+  if (_micro_tests_timer.tsc)
+  {
+    // rdtscp waits for the measured code, lfence keeps the later
+    // instructions out
+    uint32_t lo, hi;
+    if (_micro_tests_timer.rdtscp)
+      __asm__ __volatile__("rdtscp\n\tlfence" : "=a"(lo), "=d"(hi)
+                           : : "rcx", "memory");
+    else
+      __asm__ __volatile__("lfence\n\trdtsc\n\tlfence" : "=a"(lo), "=d"(hi)
+                           : : "memory");
+    return ((uint64_t)hi << 32) | lo;
+  }
+#endif
+  return _micro_tests_timer_start();
+}
+
+MICRO_TESTS_DEF double _micro_tests_timer_seconds(uint64_t start,
+                                                  uint64_t stop)
+{
+  uint64_t ticks = (stop > start) ? stop - start : 0;
+  ticks = (ticks > _micro_tests_timer.overhead)
+    ? ticks - _micro_tests_timer.overhead : 0;
+  return (double)ticks * _micro_tests_timer.ns_per_tick * 1e-9;
+}
+
+MICRO_TESTS_DEF void _micro_tests_timer_init(void)
+{
+  _micro_tests_timer.tsc = 0;
+  _micro_tests_timer.ns_per_tick = 1;
+  _micro_tests_timer.overhead = 0;
+
+#ifdef _MICRO_TESTS_TSC
+  // Invariant TSC: CPUID 0x80000007 EDX bit 8, rdtscp: CPUID
+  // 0x80000001 EDX bit 27
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8)))
+  {
+    _micro_tests_timer.rdtscp =
+      __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) && (edx & (1u << 27));
+    _micro_tests_timer.tsc = 1;
+
+    // Count the ticks of 20 milliseconds of CLOCK_MONOTONIC
+    double start_time = _micro_tests_time();
+    uint64_t start = _micro_tests_timer_start();
+    double elapsed;
+    do
+      elapsed = _micro_tests_time() - start_time;
+    while (elapsed < 0.02);
+    uint64_t stop = _micro_tests_timer_stop();
+    if (stop > start)
+      _micro_tests_timer.ns_per_tick = elapsed * 1e9 / (double)(stop - start);
+    else
+      _micro_tests_timer.tsc = 0;
+  }
+#endif
+
+  // The cheapest of many empty measurements
+  uint64_t overhead = UINT64_MAX;
+  for (int i = 0; i < 1000; ++i)
+  {
+    uint64_t start = _micro_tests_timer_start();
+    uint64_t stop = _micro_tests_timer_stop();
+    if (stop >= start && stop - start < overhead)
+      overhead = stop - start;
+  }
+  _micro_tests_timer.overhead = (overhead != UINT64_MAX) ? overhead : 0;
+}
+
+#if defined(MICRO_TESTS_BENCHMARK) && defined(MICRO_TESTS_BENCH_ALLOCS)
+
+typedef struct {
+  uint64_t allocs;
+  uint64_t bytes;
+  uint64_t frees;
+} _MicroTestsAllocs;
+
+// Counted by the hooks, and saved by PAUSE_TIMING to drop the
+// allocations until RESUME_TIMING
+static __thread _MicroTestsAllocs _micro_tests_allocs;
+static __thread _MicroTestsAllocs _micro_tests_allocs_paused;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+  _micro_tests_allocs.allocs++;
+  _micro_tests_allocs.bytes += size;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+  _micro_tests_allocs.allocs++;
+  _micro_tests_allocs.bytes += count * size;
+  return __libc_calloc(count, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+  _micro_tests_allocs.allocs++;
+  _micro_tests_allocs.bytes += size;
+  return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+  return memalign(alignment, size);
+}
+
+// Checks the alignment as glibc does, the block is counted only once
+// it is allocated
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+  if (alignment % sizeof(void *) != 0 ||
+      (alignment & (alignment - 1)) != 0 || alignment == 0)
+    return EINVAL;
+
+  void *block = __libc_memalign(alignment, size);
+  if (block == NULL)
+    return ENOMEM;
+  _micro_tests_allocs.allocs++;
+  _micro_tests_allocs.bytes += size;
+  *ptr = block;
+  return 0;
+}
+
+// A realloc frees the old block and allocates the new one
+void *realloc(void *ptr, size_t size)
+{
+  if (size > 0)
+  {
+    _micro_tests_allocs.allocs++;
+    _micro_tests_allocs.bytes += size;
+  }
+  if (ptr != NULL)
+    _micro_tests_allocs.frees++;
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+  if (ptr != NULL)
+    _micro_tests_allocs.frees++;
+  __libc_free(ptr);
+}
+
+#endif // MICRO_TESTS_BENCH_ALLOCS
+
+MICRO_TESTS_DEF void _micro_tests_bench_body(const MicroTestsBenchSpec *spec,
+                                             MicroTestsBench *bench)
+{
+#ifdef MICRO_TESTS_BENCH_ALLOCS
+  _MicroTestsAllocs before = _micro_tests_allocs;
+#endif
+
+  if (spec->setup == NULL)
+    spec->function(bench);
+  else
+    _micro_tests_bench_batches(spec, bench);
+
+#ifdef MICRO_TESTS_BENCH_ALLOCS
+  bench->allocs      = _micro_tests_allocs.allocs - before.allocs;
+  bench->alloc_bytes = _micro_tests_allocs.bytes - before.bytes;
+  bench->frees       = _micro_tests_allocs.frees - before.frees;
+#endif
+}
+
+MICRO_TESTS_DEF void _micro_tests_bench_batches(const MicroTestsBenchSpec *spec,
+                                                MicroTestsBench *bench)
+{
+  uint64_t iterations = bench->iterations;
+  uint64_t batch = (spec->batch > 0) ? spec->batch : 1;
+  for (uint64_t done = 0; done < iterations;)
+  {
+    uint64_t count = (iterations - done < batch) ? iterations - done : batch;
+    micro_tests_bench_pause(bench);
+    spec->setup(bench, count);
+    micro_tests_bench_resume(bench);
+    bench->iterations = count;
+    spec->function(bench);
+    done += count;
+  }
+  bench->iterations = iterations;
+}
+
+MICRO_TESTS_DEF double _micro_tests_bench_paused(const MicroTestsBench *bench)
+{
+  // A pause reads the timer twice while it runs, like the overhead
+  uint64_t ticks = bench->paused_ticks + bench->pauses * _micro_tests_timer.overhead;
+  return (double)ticks * _micro_tests_timer.ns_per_tick * 1e-9;
+}
+
+MICRO_TESTS_DEF double _micro_tests_bench_call(const MicroTestsBenchSpec *spec,
+                                               MicroTestsBench *bench)
+{
+  bench->paused_ticks = 0;
+  bench->pauses       = 0;
+  if (bench->thread_count <= 1)
+  {
+    uint64_t start = _micro_tests_timer_start();
+    _micro_tests_bench_body(spec, bench);
+    double elapsed = _micro_tests_timer_seconds(start, _micro_tests_timer_stop())
+      - _micro_tests_bench_paused(bench);
+    return (elapsed > 0) ? elapsed : 0;
+  }
+
+#ifdef MICRO_TESTS_MULTITHREADED
+  int count = bench->thread_count;
+  MicroTestsBenchThread *threads =
+    MICRO_TESTS_CALLOC(count, sizeof(MicroTestsBenchThread));
+  pthread_t *handles = MICRO_TESTS_CALLOC(count, sizeof(pthread_t));
+  if (threads == NULL || handles == NULL)
+  {
+    MICRO_TESTS_FREE(threads);
+    MICRO_TESTS_FREE(handles);
+    return -1;
+  }
+
+  // Pin the threads to the allowed CPUs, one each while they last
+  cpu_set_t allowed;
+  int cpus[CPU_SETSIZE];
+  int cpu_count = 0;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+      if (CPU_ISSET(cpu, &allowed))
+        cpus[cpu_count++] = cpu;
+
+  int ready = 0, go = 0, started = 0;
+  for (; started < count; ++started)
+  {
+    threads[started] = (MicroTestsBenchThread){
+      .spec  = spec,
+      .bench = *bench,
+      .cpu   = (cpu_count > 0) ? cpus[started % cpu_count] : -1,
+      .ready = &ready,
+      .go    = &go,
+    };
+    threads[started].bench.thread_index = started;
+    if (pthread_create(&handles[started], NULL, _micro_tests_bench_thread,
+                       &threads[started]) != 0)
+      break;
+  }
+
+  while (__atomic_load_n(&ready, __ATOMIC_ACQUIRE) < started)
+    sched_yield();
+  uint64_t start = _micro_tests_timer_start();
+  __atomic_store_n(&go, 1, __ATOMIC_RELEASE);
+  for (int i = 0; i < started; ++i)
+    pthread_join(handles[i], NULL);
+  double elapsed = _micro_tests_timer_seconds(start, _micro_tests_timer_stop());
+
+  // The threads pause independently, remove the average pause
+  for (int i = 0; i < started; ++i)
+    elapsed -= _micro_tests_bench_paused(&threads[i].bench) / started;
+  elapsed = (elapsed > 0) ? elapsed : 0;
+  if (started > 0)
+  {
+    bench->bytes       = threads[0].bench.bytes;
+    bench->items       = threads[0].bench.items;
+    bench->allocs      = threads[0].bench.allocs;
+    bench->alloc_bytes = threads[0].bench.alloc_bytes;
+    bench->frees       = threads[0].bench.frees;
+  }
+  MICRO_TESTS_FREE(threads);
+  MICRO_TESTS_FREE(handles);
+  if (started < count)
+  {
+    fprintf(stderr, "Error: Could not start %d benchmark threads\n", count);
+    return -1;
+  }
+  return elapsed;
+#else
+  return -1;
+#endif
+}
+
+MICRO_TESTS_DEF int _micro_tests_bench_measure(const MicroTestsBenchSpec *spec,
+                                               MicroTestsBench *bench,
+                                               MicroTestsBenchResult *result)
+{
+  enum { WINDOW = MICRO_TESTS_BENCH_WARMUP_WINDOW };
+  double threads = (bench->thread_count > 1) ? bench->thread_count : 1;
+  double start = _micro_tests_time();
+  if (_micro_tests_bench_calibrate(spec, bench,
+                                   MICRO_TESTS_BENCH_MIN_TIME_MS * 1e-3) < 0)
+    return -1;
+
+  // Warmup, until the last WINDOW measurements have no trend
+  double window[WINDOW];
+  double window_start[WINDOW];
+  size_t taken = 0;
+  double warmup_deadline = start + MICRO_TESTS_BENCH_MAX_WARMUP_MS * 1e-3;
+  *result = (MicroTestsBenchResult){ .precision = 1 };
+  for (;;)
+  {
+    window_start[taken % WINDOW] = _micro_tests_time();
+    double elapsed = _micro_tests_bench_call(spec, bench);
+    if (elapsed < 0)
+      return -1;
+    window[taken % WINDOW] = elapsed * 1e9 / ((double)bench->iterations * threads);
+    taken++;
+    if (taken >= WINDOW && WINDOW >= 3
+        && _micro_tests_bench_steady(window, WINDOW, taken % WINDOW))
+    {
+      result->steady = 1;
+      break;
+    }
+    if (_micro_tests_time() >= warmup_deadline)
+      break;
+  }
+  size_t kept = (taken < WINDOW) ? taken : WINDOW;
+  result->warmup_samples = taken - kept;
+  result->warmup_seconds = (result->steady)
+    ? window_start[taken % WINDOW] - start : _micro_tests_time() - start;
+
+  // The steady window is the start of the measurements. Kept sorted,
+  // for the median and its confidence interval
+  double samples[MICRO_TESTS_BENCH_MAX_SAMPLES];
+  size_t count = 0;
+  double deadline = _micro_tests_time() + MICRO_TESTS_BENCH_MAX_TIME_MS * 1e-3;
+  for (size_t i = 0; count < MICRO_TESTS_BENCH_MAX_SAMPLES; ++i)
+  {
+    double sample;
+    if (i < kept)
+      sample = window[i];
+    else
+    {
+      double elapsed = _micro_tests_bench_call(spec, bench);
+      if (elapsed < 0)
+        return -1;
+      sample = elapsed * 1e9 / ((double)bench->iterations * threads);
+    }
+
+    size_t j = count++;
+    for (; j > 0 && samples[j - 1] > sample; --j)
+      samples[j] = samples[j - 1];
+    samples[j] = sample;
+
+    if (count < MICRO_TESTS_BENCH_REPETITIONS || i + 1 < kept)
+      continue;
+    result->precision = _micro_tests_median_precision(samples, count);
+    if (result->precision <= MICRO_TESTS_BENCH_PRECISION
+        || _micro_tests_time() >= deadline)
+      break;
+  }
+  result->ns = _micro_tests_median(samples, count);
+  return 0;
+}
+
+MICRO_TESTS_DEF int _micro_tests_bench_steady(const double *window,
+                                              size_t count, size_t oldest)
+{
+  // Least squares line through (i, window[oldest + i])
+  double mean_x = (double)(count - 1) / 2, mean_y = 0;
+  for (size_t i = 0; i < count; ++i)
+    mean_y += window[(oldest + i) % count] / count;
+
+  double sxx = 0, sxy = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    double dx = (double)i - mean_x;
+    sxx += dx * dx;
+    sxy += dx * (window[(oldest + i) % count] - mean_y);
+  }
+  double slope = sxy / sxx;
+
+  double residuals = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    double r = window[(oldest + i) % count] - mean_y
+      - slope * ((double)i - mean_x);
+    residuals += r * r;
+  }
+  double se = _micro_tests_sqrt(residuals / (double)(count - 2) / sxx);
+
+  double drift = (slope < 0 ? -slope : slope) * (double)(count - 1);
+  return drift <= _micro_tests_t95(count - 2) * se * (double)(count - 1)
+    || drift <= MICRO_TESTS_BENCH_PRECISION * mean_y;
+}
+
+MICRO_TESTS_DEF int _micro_tests_bench_calibrate(const MicroTestsBenchSpec *spec,
+                                                 MicroTestsBench *bench,
+                                                 double seconds)
+{
+  bench->iterations = 1;
+  bench->bytes      = 0;
+  bench->items      = 0;
+  for (;;)
+  {
+    double elapsed = _micro_tests_bench_call(spec, bench);
+    if (elapsed < 0)
+      return -1;
+    if (elapsed >= seconds || bench->iterations >= UINT64_MAX / 16)
+      return 0;
+    double scale = (elapsed > 0) ? 1.4 * seconds / elapsed : 16;
+    scale = (scale > 16) ? 16 : (scale < 2) ? 2 : scale;
+    bench->iterations = (uint64_t)(bench->iterations * scale);
+  }
+}
+
+MICRO_TESTS_DEF double _micro_tests_median(double *values, size_t count)
+{
+  // Insertion sort, the samples are few
+  for (size_t i = 1; i < count; ++i)
+  {
+    double value = values[i];
+    size_t j = i;
+    for (; j > 0 && values[j - 1] > value; --j)
+      values[j] = values[j - 1];
+    values[j] = value;
+  }
+  return (count % 2) ? values[count / 2]
+    : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+MICRO_TESTS_DEF double _micro_tests_median_precision(const double *sorted,
+                                                     size_t count)
+{
+  // 1-based ranks n/2 -+ 1.96 sqrt(n) / 2, clamped to the samples
+  double half = 0.98 * _micro_tests_sqrt((double)count);
+  double lo_rank = (double)count / 2 - half;
+  double hi_rank = (double)count / 2 + 1 + half;
+  size_t lo = (lo_rank >= 1) ? (size_t)lo_rank : 1;
+  size_t hi = (hi_rank < (double)count) ? (size_t)hi_rank + 1 : count;
+  hi = (hi > count) ? count : hi;
+
+  double median = (count % 2) ? sorted[count / 2]
+    : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+  if (median <= 0)
+    return 0;
+  return (sorted[hi - 1] - sorted[lo - 1]) / (2 * median);
+}
+
+MICRO_TESTS_DEF double _micro_tests_t95(size_t df)
+{
+  static const double table[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+  };
+  if (df == 0)
+    return 0;
+  if (df <= sizeof(table) / sizeof(table[0]))
+    return table[df - 1];
+  return (df <= 60) ? 2.000 : (df <= 120) ? 1.980 : 1.960;
+}
+
+MICRO_TESTS_DEF void _micro_tests_bench_print_delta(double value,
+                                                    double baseline)
+{
+  if (baseline > 0)
+    printf(" (%+.1f%%)", (value / baseline - 1) * 100);
+}
+
+MICRO_TESTS_DEF const char*
+_micro_tests_bench_lookup(MicroTests *micro_tests, const char *key)
+{
+  if (micro_tests->baseline == NULL)
+    return NULL;
+
+  size_t key_len = strlen(key);
+  for (const char *line = micro_tests->baseline; *line != '\0';)
+  {
+    if (strncmp(line, key, key_len) == 0 && line[key_len] == ' ')
+      return line + key_len + 1;
+    const char *end = strchr(line, '\n');
+    if (end == NULL)
+      break;
+    line = end + 1;
+  }
+  return NULL;
+}
+
+MICRO_TESTS_DEF void _micro_tests_bench_report(MicroTests *micro_tests,
+                                               MicroTest *test,
+                                               const char *key,
+                                               const MicroTestsBenchResult *result,
+                                               MicroTestsBench *bench)
+{
+  double ns = result->ns;
+  // Bytes per nanosecond are GB/s, items per nanosecond are Gitems/s
+  double gb_per_s = (double)bench->bytes / ns;
+  double mitems_per_s = (double)bench->items / ns * 1e3;
+  double iterations = (bench->iterations > 0) ? (double)bench->iterations : 1;
+  double allocs_per_op = (double)bench->allocs / iterations;
+  double bytes_per_op = (double)bench->alloc_bytes / iterations;
+
+#ifdef MICRO_TESTS_BENCH_ALLOCS
+  if (micro_tests->baseline_out != NULL)
+    fprintf(micro_tests->baseline_out, "%s %.3f %.6g %.6g %.6g %.6g\n", key,
+            ns, gb_per_s, mitems_per_s, allocs_per_op, bytes_per_op);
+#else
+  if (micro_tests->baseline_out != NULL)
+    fprintf(micro_tests->baseline_out, "%s %.3f %.6g %.6g\n", key,
+            ns, gb_per_s, mitems_per_s);
+#endif
+  if (micro_tests->quiet)
+    return;
+
+  // Older baselines have no throughput nor allocations
+  const char *baseline = _micro_tests_bench_lookup(micro_tests, key);
+  double baseline_ns = 0, baseline_gb = 0, baseline_mitems = 0;
+  double baseline_allocs = -1, baseline_alloc_bytes = -1;
+  if (baseline != NULL)
+    sscanf(baseline, "%lf %lf %lf %lf %lf", &baseline_ns, &baseline_gb,
+           &baseline_mitems, &baseline_allocs, &baseline_alloc_bytes);
+
+  // The key without "suite."
+  printf("suite: %s, benchmark: %s", test->test_suite,
+         key + strlen(test->test_suite) + 1);
+  printf(" %.2f ns/op +-%.1f%%", ns, result->precision * 100);
+  _micro_tests_bench_print_delta(ns, baseline_ns);
+  if (bench->bytes > 0)
+  {
+    printf(", %.3f GB/s", gb_per_s);
+    _micro_tests_bench_print_delta(gb_per_s, baseline_gb);
+  }
+  if (bench->items > 0)
+  {
+    printf(", %.3f Mitems/s", mitems_per_s);
+    _micro_tests_bench_print_delta(mitems_per_s, baseline_mitems);
+  }
+#ifdef MICRO_TESTS_BENCH_ALLOCS
+  printf(", %.2f allocs/op, %.0f B/op, %.2f frees/op", allocs_per_op,
+         bytes_per_op, (double)bench->frees / iterations);
+  // The baseline is rounded, tolerate the rounding
+  if (baseline_allocs >= 0
+      && (allocs_per_op > baseline_allocs + 0.005
+          || allocs_per_op < baseline_allocs - 0.005
+          || bytes_per_op > baseline_alloc_bytes + 0.5
+          || bytes_per_op < baseline_alloc_bytes - 0.5))
+    printf(" (baseline %.2f allocs/op, %.0f B/op)", baseline_allocs,
+           baseline_alloc_bytes);
+#else
+  (void) allocs_per_op;
+  (void) bytes_per_op;
+  (void) baseline_allocs;
+  (void) baseline_alloc_bytes;
+#endif
+  printf(", %llu iterations", (unsigned long long)bench->iterations);
+  if (result->steady)
+    printf(", warmup %.2f s", result->warmup_seconds);
+  else
+    printf(", no steady state after %.2f s", result->warmup_seconds);
+  if (baseline_ns > 0)
+    printf(", baseline %.2f ns/op", baseline_ns);
+}
+
+MICRO_TESTS_DEF int _micro_tests_bench_scaling(MicroTests *micro_tests,
+                                               MicroTest *test)
+{
+#ifdef MICRO_TESTS_MULTITHREADED
+  const MicroTestsBenchSpec *spec = test->bench;
+  double first_ns = 0;
+  int first_threads = 0;
+
+  char key[512];
+  for (const char *it = spec->threads; *it != '\0';)
+  {
+    char *end;
+    long threads = strtol(it, &end, 10);
+    if (end == it || threads <= 0 || threads > MICRO_TESTS_MAX_THREADS)
+    {
+      fprintf(stderr, "Error: Invalid thread count in \"%s\" of benchmark %s.%s\n",
+              spec->threads, test->test_suite, test->test_name);
+      return 1;
+    }
+    it = (*end == ',') ? end + 1 : end;
+
+    MicroTestsBench bench = {
+      .n            = spec->range_lo,
+      .thread_count = (int)threads,
+    };
+    MicroTestsBenchResult result;
+    if (_micro_tests_bench_measure(spec, &bench, &result) < 0)
+      return 1;
+    double ns = result.ns;
+
+    // Aggregate throughput relative to the first thread count
+    if (first_threads == 0)
+    {
+      first_ns = ns;
+      first_threads = (int)threads;
+    }
+    double speedup = first_ns / ns;
+    double efficiency = speedup * first_threads / threads;
+
+    snprintf(key, sizeof(key), "%s.%s/t%ld", test->test_suite,
+             test->test_name, threads);
+    _micro_tests_bench_report(micro_tests, test, key, &result, &bench);
+    if (!micro_tests->quiet)
+      printf(", speedup %.2fx, efficiency %.0f%%\n", speedup,
+             efficiency * 100);
+  }
+  return 0;
+#else
+  (void) micro_tests;
+  fprintf(stderr, "suite: %s, benchmark: %s FAILED, thread scaling needs "
+          "MICRO_TESTS_MULTITHREADED\n", test->test_suite, test->test_name);
+  return 1;
+#endif
+}
+
+MICRO_TESTS_DEF int _micro_tests_bench_ab(MicroTests *micro_tests,
+                                          MicroTest *test)
+{
+  const MicroTestsBenchSpec *spec = test->bench;
+  enum { ROUNDS = MICRO_TESTS_BENCH_AB_ROUNDS };
+
+  // Short calls, so that the rounds follow drifts of the machine
+  MicroTestsBench bench[2];
+  for (int v = 0; v < 2; ++v)
+  {
+    bench[v] = (MicroTestsBench){ .n = spec->range_lo, .variant = v };
+    if (_micro_tests_bench_calibrate(spec, &bench[v],
+                                     MICRO_TESTS_BENCH_MIN_TIME_MS * 1e-3) < 0)
+      return 1;
+  }
+
+  // xorshift64, the order of the variants changes at each round
+  uint64_t random = (uint64_t)(_micro_tests_time() * 1e9) | 1;
+  double ns[2][ROUNDS];
+  double ratio[ROUNDS];
+  for (int r = 0; r < ROUNDS; ++r)
+  {
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+    int first = (int)(random & 1);
+    for (int k = 0; k < 2; ++k)
+    {
+      int v = first ^ k;
+      ns[v][r] = _micro_tests_bench_call(spec, &bench[v]) * 1e9
+        / (double)bench[v].iterations;
+    }
+    // Above 1 when the second variant is faster
+    ratio[r] = ns[0][r] / ns[1][r];
+  }
+
+  double mean = 0, variance = 0;
+  for (int r = 0; r < ROUNDS; ++r)
+    mean += ratio[r] / ROUNDS;
+  for (int r = 0; r < ROUNDS; ++r)
+    variance += (ratio[r] - mean) * (ratio[r] - mean) / (ROUNDS - 1);
+  double margin = _micro_tests_t95(ROUNDS - 1)
+    * _micro_tests_sqrt(variance / ROUNDS);
+
+  char key[512];
+  for (int v = 0; v < 2; ++v)
+  {
+    snprintf(key, sizeof(key), "%s.%s/%c", test->test_suite,
+             test->test_name, 'A' + v);
+    // The rounds alternate, so a drift would show in the interval.
+    // The median sorts the rounds that the precision needs sorted
+    double median = _micro_tests_median(ns[v], ROUNDS);
+    MicroTestsBenchResult result = {
+      .ns        = median,
+      .precision = _micro_tests_median_precision(ns[v], ROUNDS),
+      .steady    = 1,
+    };
+    _micro_tests_bench_report(micro_tests, test, key, &result, &bench[v]);
+    if (!micro_tests->quiet)
+      printf("\n");
+  }
+
+  snprintf(key, sizeof(key), "%s.%s/AB", test->test_suite, test->test_name);
+  if (micro_tests->baseline_out != NULL)
+    fprintf(micro_tests->baseline_out, "%s %.4f %.4f %.4f\n", key, mean,
+            mean - margin, mean + margin);
+  if (!micro_tests->quiet)
+  {
+    printf("suite: %s, benchmark: %s B/A speedup %.3fx, 95%% CI %.3fx .. %.3fx",
+           test->test_suite, test->test_name, mean, mean - margin,
+           mean + margin);
+    printf((mean - margin > 1) ? ", B is faster"
+           : (mean + margin < 1) ? ", B is slower"
+           : ", no significant difference");
+    const char *baseline = _micro_tests_bench_lookup(micro_tests, key);
+    double baseline_mean;
+    if (baseline != NULL && sscanf(baseline, "%lf", &baseline_mean) == 1)
+      printf(", baseline %.3fx", baseline_mean);
+    printf("\n");
+  }
+  return 0;
+}
+
+MICRO_TESTS_DEF int _micro_tests_bench_one(MicroTests *micro_tests,
+                                           MicroTest *test)
+{
+  const MicroTestsBenchSpec *spec = test->bench;
+  if (spec->ab)
+    return _micro_tests_bench_ab(micro_tests, test);
+  if (spec->threads != NULL)
+    return _micro_tests_bench_scaling(micro_tests, test);
+
+  size_t mult = (spec->range_mult >= 2) ? spec->range_mult : 2;
+
+  // A multiplicative range has at most one size per bit
+  size_t n[sizeof(size_t) * 8 + 1];
+  double ns[sizeof(size_t) * 8 + 1];
+  size_t count = 0;
+
+  char key[512];
+  for (size_t size = spec->range_lo;;)
+  {
+    MicroTestsBench bench = { .n = size };
+    n[count] = size;
+    MicroTestsBenchResult result;
+    if (_micro_tests_bench_measure(spec, &bench, &result) < 0)
+      return 1;
+    ns[count] = result.ns;
+
+    if (spec->range_hi == 0)
+      snprintf(key, sizeof(key), "%s.%s", test->test_suite, test->test_name);
+    else
+      snprintf(key, sizeof(key), "%s.%s/%zu", test->test_suite,
+               test->test_name, size);
+
+    _micro_tests_bench_report(micro_tests, test, key, &result, &bench);
+    if (!micro_tests->quiet)
+      printf("\n");
+    count++;
+
+    if (spec->range_hi == 0 || size > spec->range_hi / mult)
+      break;
+    size = (size > 0) ? size * mult : 1;
+  }
+
+  // Fewer sizes can not tell the classes apart
+  if (count < 3)
+    return 0;
+
+  double intercept, coefficient, errors[_MICRO_TESTS_O_COUNT];
+  MicroTestsComplexity fit = _micro_tests_bench_fit(n, ns, count, &intercept,
+                                                    &coefficient, errors);
+
+  snprintf(key, sizeof(key), "%s.%s/O", test->test_suite, test->test_name);
+  if (micro_tests->baseline_out != NULL)
+    fprintf(micro_tests->baseline_out, "%s %d %.6g\n", key, (int)fit,
+            coefficient);
+
+  // The worst class the benchmark is allowed to fit
+  MicroTestsComplexity allowed = spec->complexity;
+  const char *baseline = _micro_tests_bench_lookup(micro_tests, key);
+  int baseline_fit;
+  if (baseline != NULL && sscanf(baseline, "%d", &baseline_fit) == 1
+      && baseline_fit > MICRO_TESTS_O_AUTO && baseline_fit < _MICRO_TESTS_O_COUNT
+      && (allowed == MICRO_TESTS_O_AUTO || baseline_fit < (int)allowed))
+    allowed = (MicroTestsComplexity)baseline_fit;
+
+  // Only a clearly worse fit of the allowed class fails, noise alone
+  // moves the best fit between neighboring classes
+  int failed = (allowed != MICRO_TESTS_O_AUTO && fit > allowed
+                && errors[allowed] > errors[fit] * MICRO_TESTS_BENCH_FIT_MARGIN
+                                     + 0.05);
+  FILE *out = failed ? stderr : stdout;
+  if (failed || !micro_tests->quiet)
+  {
+    fprintf(out, "suite: %s, benchmark: %s %s, %.3g ns + %.3g ns * f(n), rms %.0f%%",
+            test->test_suite, test->test_name,
+            _micro_tests_complexity_name(fit), intercept, coefficient,
+            errors[fit] * 100);
+    if (failed)
+      fprintf(out, " FAILED, expected %s, rms %.0f%%",
+              _micro_tests_complexity_name(allowed), errors[allowed] * 100);
+    fprintf(out, "\n");
+  }
+  return failed;
+}
+
+MICRO_TESTS_DEF int _micro_tests_read_line(const char *path, char *line,
+                                           size_t size)
+{
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+    return -1;
+  char *read = fgets(line, (int)size, file);
+  fclose(file);
+  if (read == NULL)
+    return -1;
+  line[strcspn(line, "\n")] = '\0';
+  return 0;
+}
+
+MICRO_TESTS_DEF int _micro_tests_bench_environment(char *summary, size_t size)
+{
+  int noise = 0;
+  char line[64];
+
+  // The same governor on all the CPUs, or "mixed"
+  char governor[64] = "unknown";
+  long cpus = sysconf(_SC_NPROCESSORS_CONF);
+  for (long cpu = 0; cpu < cpus; ++cpu)
+  {
+    char path[128];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%ld/cpufreq/scaling_governor", cpu);
+    if (_micro_tests_read_line(path, line, sizeof(line)) < 0)
+      continue;
+    if (strcmp(governor, "unknown") == 0)
+      snprintf(governor, sizeof(governor), "%s", line);
+    else if (strcmp(governor, line) != 0)
+      snprintf(governor, sizeof(governor), "mixed");
+  }
+  if (strcmp(governor, "unknown") != 0 && strcmp(governor, "performance") != 0)
+  {
+    fprintf(stderr, "warning: CPU frequency governor is %s, not performance\n",
+            governor);
+    noise++;
+  }
+
+  // Either the generic boost switch or the one of intel_pstate
+  const char *boost = "unknown";
+  if (_micro_tests_read_line("/sys/devices/system/cpu/cpufreq/boost",
+                             line, sizeof(line)) == 0)
+    boost = (strcmp(line, "0") == 0) ? "off" : "on";
+  else if (_micro_tests_read_line("/sys/devices/system/cpu/intel_pstate/no_turbo",
+                                  line, sizeof(line)) == 0)
+    boost = (strcmp(line, "1") == 0) ? "off" : "on";
+  if (strcmp(boost, "on") == 0)
+  {
+    fprintf(stderr, "warning: turbo boost is enabled\n");
+    noise++;
+  }
+
+  const char *smt = "unknown";
+  if (_micro_tests_read_line("/sys/devices/system/cpu/smt/active",
+                             line, sizeof(line)) == 0)
+    smt = (strcmp(line, "0") == 0) ? "off" : "on";
+  if (strcmp(smt, "on") == 0)
+    fprintf(stderr, "warning: SMT is active, sibling threads share a core\n");
+
+  char online[64] = "unknown";
+  _micro_tests_read_line("/sys/devices/system/cpu/online", online,
+                         sizeof(online));
+
+  // Other runnable tasks compete for the CPUs
+  double load = -1;
+  long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (_micro_tests_read_line("/proc/loadavg", line, sizeof(line)) == 0)
+    sscanf(line, "%lf", &load);
+  if (load > 1.0 && load > 0.1 * online_cpus)
+  {
+    fprintf(stderr, "warning: load average is %.2f on %ld CPUs\n", load,
+            online_cpus);
+    noise++;
+  }
+
+  // Randomized addresses change the alignment between runs
+  char aslr[16] = "unknown";
+  _micro_tests_read_line("/proc/sys/kernel/randomize_va_space", aslr,
+                         sizeof(aslr));
+  if (strcmp(aslr, "unknown") != 0 && strcmp(aslr, "0") != 0)
+    fprintf(stderr, "warning: ASLR is enabled (randomize_va_space %s)\n",
+            aslr);
+
+  snprintf(summary, size,
+           "governor=%s boost=%s smt=%s online=%s load=%.2f aslr=%s",
+           governor, boost, smt, online, load, aslr);
+  return noise;
+}
+
+MICRO_TESTS_DEF int _micro_tests_bench_run(MicroTests *micro_tests)
+{
+  size_t count = _micro_tests_count();
+  MicroTest* test = _micro_tests_tests();
+
+  char environment[512];
+  int noise = _micro_tests_bench_environment(environment, sizeof(environment));
+  if (noise > 0 && micro_tests->save_baseline_file != NULL
+      && !micro_tests->force)
+  {
+    fprintf(stderr, "Error: Not saving a baseline from a noisy environment, "
+            "use --force to save it anyway\n");
+    return 1;
+  }
+
+  if (micro_tests->baseline_file != NULL)
+  {
+    FILE *file = fopen(micro_tests->baseline_file, "r");
+    if (file == NULL)
+    {
+      perror(micro_tests->baseline_file);
+      return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    micro_tests->baseline = MICRO_TESTS_CALLOC(1, (size > 0) ? size + 1 : 1);
+    if (micro_tests->baseline != NULL && size > 0)
+      micro_tests->baseline[fread(micro_tests->baseline, 1, size, file)] = '\0';
+    fclose(file);
+  }
+
+  if (micro_tests->save_baseline_file != NULL)
+  {
+    micro_tests->baseline_out = fopen(micro_tests->save_baseline_file, "w");
+    if (micro_tests->baseline_out == NULL)
+    {
+      perror(micro_tests->save_baseline_file);
+      MICRO_TESTS_FREE(micro_tests->baseline);
+      return 1;
+    }
+  }
+
+  _micro_tests_timer_init();
+
+  if (micro_tests->print_banner)
+    micro_tests_print_banner();
+  if (!micro_tests->quiet)
+  {
+    if (_micro_tests_timer.tsc)
+      printf("timer: tsc at %.3f GHz, overhead %.1f ns subtracted\n",
+             1 / _micro_tests_timer.ns_per_tick,
+             (double)_micro_tests_timer.overhead * _micro_tests_timer.ns_per_tick);
+    else
+      printf("timer: clock_gettime, overhead %.1f ns subtracted\n",
+             (double)_micro_tests_timer.overhead);
+    printf("environment: %s%s\n", environment, (noise > 0) ? " (noisy)" : "");
+    const char *baseline = _micro_tests_bench_lookup(micro_tests, "environment");
+    if (baseline != NULL)
+      printf("baseline environment: %.*s\n", (int)strcspn(baseline, "\n"),
+             baseline);
+    printf("\n");
+  }
+  if (micro_tests->baseline_out != NULL)
+    fprintf(micro_tests->baseline_out, "environment %s\n", environment);
+
+  int failed = 0;
+  for (size_t i = 0; i < count; i++)
+    if (_micro_tests_is_selected(micro_tests, &test[i]))
+      failed += _micro_tests_bench_one(micro_tests, &test[i]);
+
+  if (!micro_tests->quiet)
+    printf("\nBenchmarks done: %d %s failed\n\n", failed,
+           (failed == 1) ? "benchmark" : "benchmarks");
+
+  if (micro_tests->baseline_out != NULL)
+    fclose(micro_tests->baseline_out);
+  MICRO_TESTS_FREE(micro_tests->baseline);
+  micro_tests->baseline_out = NULL;
+  micro_tests->baseline = NULL;
+  return failed;
+}
+
+#endif // MICRO_TESTS_BENCHMARK
+
+#ifdef MICRO_TESTS_GLOBALS_CHECK
+
+MICRO_TESTS_DEF void _micro_tests_globals_ignore(char *snapshot)
+{
+  struct { const void *start; size_t size; } ignored[] = {
+    { __micro_tests_start, (size_t)(__micro_tests_stop - __micro_tests_start) },
+    { &_micro_tests_registry, sizeof(_micro_tests_registry) },
+#ifdef MICRO_TESTS_MULTITHREADED
+    { &_micro_tests_pool, sizeof(_micro_tests_pool) },
+#endif
+#ifdef MICRO_TESTS_BENCHMARK
+    { &_micro_tests_timer, sizeof(_micro_tests_timer) },
+#endif
+#ifdef MICRO_TESTS_PROFILE
+    { &_micro_tests_profile, sizeof(_micro_tests_profile) },
+#endif
+  };
+
+  uintptr_t begin = (uintptr_t)__data_start, end = (uintptr_t)_end;
+  for (size_t i = 0; i < sizeof(ignored) / sizeof(ignored[0]); ++i)
+  {
+    uintptr_t start = (uintptr_t)ignored[i].start;
+    if (start >= begin && start + ignored[i].size <= end)
+      memcpy(snapshot + (start - begin), ignored[i].start, ignored[i].size);
+  }
+}
+
+MICRO_TESTS_DEF int _micro_tests_run_check_globals(MicroTests *micro_tests)
+{
+  int failed = 0;
+  MicroTest* test = _micro_tests_tests();
+  size_t globals_size = (size_t)(_end - __data_start);
+
+  // Heap memory, so that the snapshot is not part of what it checks
+  char *snapshot = MICRO_TESTS_CALLOC(globals_size, 1);
+  MicroTest **writers =
+    MICRO_TESTS_CALLOC(micro_tests->order_count > 0 ? micro_tests->order_count : 1,
+                       sizeof(MicroTest*));
+  if (snapshot == NULL || writers == NULL)
+  {
+    fprintf(stderr, "Error: could not allocate %zu bytes for --check-globals\n",
+            globals_size);
+    MICRO_TESTS_FREE(snapshot);
+    MICRO_TESTS_FREE(writers);
+    return -1;
+  }
+  size_t writers_count = 0;
+
+  _MICRO_TESTS_REPORT(on_run_start, micro_tests, micro_tests->order_count);
+  memcpy(snapshot, __data_start, globals_size);
+  for (size_t i = 0; i < micro_tests->order_count; i++)
+  {
+    size_t index = micro_tests->order[i];
+    MicroTest* current = &test[index];
+
+    MicroTestsStatus status = MICRO_TESTS_SKIPPED;
+    if (_micro_tests_deps_status(micro_tests, index) == MICRO_TESTS_DEPS_READY)
+    {
+      _MICRO_TESTS_REPORT(on_test_start, micro_tests, current);
+      double start = _micro_tests_time();
+      status = _micro_tests_exec(micro_tests, current);
+      micro_tests->durations[index] = _micro_tests_time() - start;
+    }
+
+    // Only copy the globals again when the test changed them, the
+    // state of the framework itself changes with the runs. The serial
+    // tests and the ones using resources are declared already
+    _micro_tests_globals_ignore(snapshot);
+    _Bool declared = (current->flags & MICRO_TESTS_FLAG_SERIAL)
+      || current->resources != NULL;
+    if (declared)
+      memcpy(snapshot, __data_start, globals_size);
+    else if (memcmp(snapshot, __data_start, globals_size) != 0)
+    {
+      size_t offset = 0;
+      while (snapshot[offset] == __data_start[offset])
+        offset++;
+      fprintf(stderr, "warning: %s:%u: test %s writes global state at %p (.data+0x%zx)\n",
+              current->file_name, (unsigned) current->line_number,
+              current->function_name, (void*)&__data_start[offset], offset);
+      writers[writers_count++] = current;
+      memcpy(snapshot, __data_start, globals_size);
+    }
+
+    if (status == MICRO_TESTS_FAILED)
+      failed++;
+    micro_tests->test_state[index] = (status == MICRO_TESTS_OK)
+      ? MICRO_TESTS_SCHED_DONE
+      : (status == MICRO_TESTS_FAILED) ? MICRO_TESTS_SCHED_FAILED
+      : MICRO_TESTS_SCHED_SKIPPED;
+    _MICRO_TESTS_REPORT(on_test_end, micro_tests, current, status);
+#ifdef MICRO_TESTS_CAPTURE
+    _micro_tests_capture_emit(status);
+#endif
+  }
+  _MICRO_TESTS_REPORT(on_run_end, micro_tests, failed);
+
+  fprintf(stderr, "%zu %s global state%s\n", writers_count,
+          (writers_count == 1) ? "test writes" : "tests write",
+          (writers_count > 0) ? ", register them with TEST_SERIAL or TEST_RESOURCES:" : "");
+  for (size_t i = 0; i < writers_count; ++i)
+    fprintf(stderr, "  suite: %s, test: %s\n",
+            writers[i]->test_suite, writers[i]->test_name);
+
+  MICRO_TESTS_FREE(writers);
+  MICRO_TESTS_FREE(snapshot);
+  return failed;
+}
+
+#endif // MICRO_TESTS_GLOBALS_CHECK
+
+#ifdef MICRO_TESTS_MULTITHREADED
+
+MICRO_TESTS_DEF int _micro_tests_resources_overlap(const char *a,
+                                                   const char *b)
+{
+  while (*a != '\0')
+  {
+    size_t a_len = strcspn(a, ",");
+    const char *it = b;
+    while (*it != '\0')
+    {
+      size_t it_len = strcspn(it, ",");
+      if (a_len == it_len && a_len > 0 && strncmp(a, it, a_len) == 0)
+        return 1;
+      it += it_len + (it[it_len] == ',');
+    }
+    a += a_len + (a[a_len] == ',');
+  }
+  return 0;
+}
+
+MICRO_TESTS_DEF int _micro_tests_conflict(MicroTest *a, MicroTest *b)
+{
+  if ((a->flags | b->flags) & MICRO_TESTS_FLAG_SERIAL)
+    return 1;
+  if (a->resources == NULL || b->resources == NULL)
+    return 0;
+  return _micro_tests_resources_overlap(a->resources, b->resources);
+}
+
+MICRO_TESTS_DEF MicroTest*
+_micro_tests_get_next_test(MicroTests *micro_tests, int thread_index,
+                           _Bool *skip)
+{
+  pthread_mutex_lock(&micro_tests->current_test_index_mutex);
+
+  MicroTest* test = _micro_tests_tests();
+  size_t *order = micro_tests->order;
+  unsigned char *state = micro_tests->test_state;
+  MicroTest *next = NULL;
+
+  for (;;)
+  {
+    MicroTest *serial = NULL;
+    _Bool pending = 0;
+
+    // Skip the tests at the head that were already started
+    while ((size_t)micro_tests->current_test_index < micro_tests->order_count
+           && state[order[micro_tests->current_test_index]] != MICRO_TESTS_SCHED_PENDING
+           && state[order[micro_tests->current_test_index]] != MICRO_TESTS_SCHED_BROKEN)
+      micro_tests->current_test_index++;
+
+    for (size_t i = micro_tests->current_test_index; i < micro_tests->order_count; ++i)
+    {
+      size_t index = order[i];
+      if (state[index] != MICRO_TESTS_SCHED_PENDING
+          && state[index] != MICRO_TESTS_SCHED_BROKEN)
+        continue;
+
+      pending = 1;
+      int deps = _micro_tests_deps_status(micro_tests, index);
+      if (deps == MICRO_TESTS_DEPS_SKIP)
+      {
+        *skip = 1;
+        next = &test[index];
+        break;
+      }
+      if (deps == MICRO_TESTS_DEPS_WAIT)
+        continue;
+
+      if (test[index].flags & MICRO_TESTS_FLAG_SERIAL)
+      {
+        if (serial == NULL)
+          serial = &test[index];
+        continue;
+      }
+
+      _Bool conflict = 0;
+      for (int t = 0; t < micro_tests->thread_number && !conflict; ++t)
+        conflict = micro_tests->running[t] != NULL
+          && _micro_tests_conflict(micro_tests->running[t], &test[index]);
+      if (conflict)
+        continue;
+
+      *skip = 0;
+      next = &test[index];
+      break;
+    }
+
+    // Serial tests run last, when nothing else is running
+    if (next == NULL && serial != NULL && micro_tests->running_count == 0)
+    {
+      *skip = 0;
+      next = serial;
+    }
+
+    // Stay while tests run, they may publish jobs
+    if (next != NULL || (!pending && micro_tests->running_count == 0))
+      break;
+
+    if (_micro_tests_job_help(micro_tests))
+      continue;
+
+    // None of the remaining tests can start yet
+    micro_tests->waiting_count++;
+    pthread_cond_wait(&micro_tests->test_done_cond,
+                      &micro_tests->current_test_index_mutex);
+    micro_tests->waiting_count--;
+  }
+
+  if (next != NULL)
+  {
+    state[next - test] = MICRO_TESTS_SCHED_RUNNING;
+    micro_tests->running[thread_index] = next;
+    micro_tests->running_count++;
+    micro_tests->started_count++;
+  }
+  
+  pthread_mutex_unlock(&micro_tests->current_test_index_mutex);
+  return next;
+}
+
+MICRO_TESTS_DEF void _micro_tests_test_done(MicroTests *micro_tests,
+                                            int thread_index,
+                                            MicroTestsStatus status)
+{
+  pthread_mutex_lock(&micro_tests->current_test_index_mutex);
+
+  MicroTest *current = micro_tests->running[thread_index];
+  micro_tests->test_state[current - _micro_tests_tests()] =
+    (status == MICRO_TESTS_OK) ? MICRO_TESTS_SCHED_DONE
+    : (status == MICRO_TESTS_FAILED) ? MICRO_TESTS_SCHED_FAILED
+    : MICRO_TESTS_SCHED_SKIPPED;
+  micro_tests->running[thread_index] = NULL;
+  micro_tests->running_count--;
+  pthread_cond_broadcast(&micro_tests->test_done_cond);
+
+  pthread_mutex_unlock(&micro_tests->current_test_index_mutex);
+}
+
+MICRO_TESTS_DEF void *_micro_tests_thread(void *args)
+{
+  long failed = 0;
+  MicroTests *micro_tests = ((MicroTestsThread*) args)->micro_tests;
+  int thread_index = ((MicroTestsThread*) args)->thread_index;
+  _Bool skip;
+  MicroTest *micro_test = _micro_tests_get_next_test(micro_tests, thread_index, &skip);
+  while (micro_test != NULL)
+  {
+    MicroTestsStatus status = MICRO_TESTS_SKIPPED;
+    if (!skip)
+    {
+      pthread_mutex_lock(&micro_tests->reporter_mutex);
+      _MICRO_TESTS_REPORT(on_test_start, micro_tests, micro_test);
+      pthread_mutex_unlock(&micro_tests->reporter_mutex);
+
+      double start = _micro_tests_time();
+      status = _micro_tests_exec(micro_tests, micro_test);
+      micro_tests->durations[micro_test - _micro_tests_tests()] =
+        _micro_tests_time() - start;
+      if (status == MICRO_TESTS_FAILED)
+        failed++;
+    }
+
+    pthread_mutex_lock(&micro_tests->reporter_mutex);
+    _MICRO_TESTS_REPORT(on_test_end, micro_tests, micro_test, status);
+#ifdef MICRO_TESTS_CAPTURE
+    _micro_tests_capture_emit(status);
+#endif
+    pthread_mutex_unlock(&micro_tests->reporter_mutex);
+
+    _micro_tests_test_done(micro_tests, thread_index, status);
+
+    _Bool retire = 0;
+    pthread_mutex_lock(&micro_tests->current_test_index_mutex);
+    if (micro_tests->retire_count > 0)
+    {
+      micro_tests->retire_count--;
+      retire = 1;
+    }
+    pthread_mutex_unlock(&micro_tests->current_test_index_mutex);
+    if (retire)
+      break;
+
+    micro_test = _micro_tests_get_next_test(micro_tests, thread_index, &skip);
+  }
+  
+  __atomic_store_n(&((MicroTestsThread*) args)->alive, 0, __ATOMIC_RELEASE);
+  return (void*)failed;
+}
+
+MICRO_TESTS_DEF void _micro_tests_job_run(MicroTestsJob *job)
+{
+  for (;;)
+  {
+    size_t i = __atomic_fetch_add(&job->next, job->chunk, __ATOMIC_RELAXED);
+    if (i >= job->end)
+      break;
+    size_t end = (job->end - i < job->chunk) ? job->end : i + job->chunk;
+    for (size_t it = i; it < end; ++it)
+      job->fn(it, job->ctx);
+    __atomic_fetch_add(&job->done, end - i, __ATOMIC_RELEASE);
+  }
+}
+
+MICRO_TESTS_DEF int _micro_tests_job_help(MicroTests *micro_tests)
+{
+  MicroTestsJob *job = micro_tests->jobs;
+  while (job != NULL
+         && __atomic_load_n(&job->next, __ATOMIC_RELAXED) >= job->end)
+    job = job->next_job;
+  if (job == NULL)
+    return 0;
+
+  // The owner waits for the helpers before releasing the job
+  job->helpers++;
+  pthread_mutex_unlock(&micro_tests->current_test_index_mutex);
+  _micro_tests_job_run(job);
+  pthread_mutex_lock(&micro_tests->current_test_index_mutex);
+  job->helpers--;
+  pthread_cond_broadcast(&micro_tests->test_done_cond);
+  return 1;
+}
+
+MICRO_TESTS_DEF void _micro_tests_job_publish(MicroTests *micro_tests,
+                                              MicroTestsJob *job)
+{
+  pthread_mutex_lock(&micro_tests->current_test_index_mutex);
+  job->next_job = micro_tests->jobs;
+  micro_tests->jobs = job;
+  pthread_cond_broadcast(&micro_tests->test_done_cond);
+  pthread_mutex_unlock(&micro_tests->current_test_index_mutex);
+}
+
+MICRO_TESTS_DEF void _micro_tests_job_wait(MicroTests *micro_tests,
+                                           MicroTestsJob *job)
+{
+  _micro_tests_job_run(job);
+
+  pthread_mutex_lock(&micro_tests->current_test_index_mutex);
+  MicroTestsJob **it = &micro_tests->jobs;
+  while (*it != NULL && *it != job)
+    it = &(*it)->next_job;
+  if (*it == job)
+    *it = job->next_job;
+  while (__atomic_load_n(&job->done, __ATOMIC_ACQUIRE) < job->total
+         || job->helpers > 0)
+    pthread_cond_wait(&micro_tests->test_done_cond,
+                      &micro_tests->current_test_index_mutex);
+  pthread_mutex_unlock(&micro_tests->current_test_index_mutex);
+}
+
+MICRO_TESTS_DEF int _micro_tests_cpu_count(void)
+{
+  int cpus = 1;
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    cpus = CPU_COUNT(&set);
+
+  // cgroup v2 exposes cpu.max in the cgroup of the process, v1 two
+  // separate files
+  long long quota_cpus = 0;
+  char path[512] = "/sys/fs/cgroup/cpu.max";
+  FILE *file = fopen("/proc/self/cgroup", "r");
+  if (file != NULL)
+  {
+    char line[400];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+      if (strncmp(line, "0::", 3) == 0)
+      {
+        line[strcspn(line, "\n")] = '\0';
+        snprintf(path, sizeof(path), "/sys/fs/cgroup%s/cpu.max", line + 3);
+      }
+    }
+    fclose(file);
+  }
+  char cpu_max[64] = "", cfs_quota[32] = "", cfs_period[32] = "";
+  if ((file = fopen(path, "r")) != NULL
+      || (file = fopen("/sys/fs/cgroup/cpu.max", "r")) != NULL)
+  {
+    if (fgets(cpu_max, sizeof(cpu_max), file) == NULL)
+      cpu_max[0] = '\0';
+    fclose(file);
+    quota_cpus = _micro_tests_cpu_quota(cpu_max, NULL, NULL);
+  } else if ((file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r")) != NULL)
+  {
+    if (fgets(cfs_quota, sizeof(cfs_quota), file) == NULL)
+      cfs_quota[0] = '\0';
+    fclose(file);
+    if ((file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r")) != NULL)
+    {
+      if (fgets(cfs_period, sizeof(cfs_period), file) == NULL)
+        cfs_period[0] = '\0';
+      fclose(file);
+    }
+    quota_cpus = _micro_tests_cpu_quota(NULL, cfs_quota, cfs_period);
+  }
+
+  if (quota_cpus > 0 && quota_cpus < cpus)
+    cpus = (int)quota_cpus;
+  return (cpus > 0) ? cpus : 1;
+}
+
+MICRO_TESTS_DEF long long _micro_tests_cpu_quota(const char *cpu_max,
+                                                 const char *cfs_quota,
+                                                 const char *cfs_period)
+{
+  long long quota = -1, period = 0;
+  if (cpu_max != NULL)
+  {
+    char max[32];
+    if (sscanf(cpu_max, "%31s %lld", max, &period) == 2
+        && _micro_tests_strcmp(max, "max") != 0)
+      quota = atoll(max);
+  } else if (cfs_quota != NULL && cfs_period != NULL)
+  {
+    if (sscanf(cfs_quota, "%lld", &quota) != 1)
+      quota = -1;
+    if (sscanf(cfs_period, "%lld", &period) != 1)
+      period = 0;
+  }
+
+  if (quota <= 0 || period <= 0)
+    return 0;
+  return (quota + period - 1) / period;
+}
+
+MICRO_TESTS_DEF int _micro_tests_spawn_thread(MicroTests *micro_tests,
+                                              pthread_t *threads,
+                                              MicroTestsThread *args,
+                                              int index)
+{
+  args[index] = (MicroTestsThread){
+    .micro_tests  = micro_tests,
+    .thread_index = index,
+    .alive        = 1,
+    .cpu_clock    = CLOCK_MONOTONIC,
+    .cpu_time     = 0,
+  };
+  if (pthread_create(&threads[index], NULL, &_micro_tests_thread, (void*) &args[index]) != 0)
+  {
+    perror("run_multithreaded: Error in pthread_create");
+    return -1;
+  }
+  if (pthread_getcpuclockid(threads[index], &args[index].cpu_clock) != 0)
+    args[index].cpu_clock = CLOCK_MONOTONIC;
+  return 0;
+}
+
+MICRO_TESTS_DEF void _micro_tests_adapt_threads(MicroTests *micro_tests,
+                                                pthread_t *threads,
+                                                MicroTestsThread *args,
+                                                int *spawned)
+{
+  struct timespec interval = {
+    .tv_sec  = MICRO_TESTS_ADAPT_INTERVAL_MS / 1000,
+    .tv_nsec = (MICRO_TESTS_ADAPT_INTERVAL_MS % 1000) * 1000000L,
+  };
+  double last = _micro_tests_time();
 
-  for (unsigned int i = micro_tests->current_test_index; i < count; ++i)
+  for (;;)
   {
-    MicroTest* current = &test[i];
-    
-    if (current->marker == 0xDeadBeaf)
+    nanosleep(&interval, NULL);
+    double now = _micro_tests_time();
+    double wall = now - last;
+    last = now;
+
+    // CPU used by the live threads since the last adjustment
+    int live = 0;
+    double busy = 0;
+    for (int i = 0; i < *spawned; ++i)
     {
-      if (micro_tests->run_suite != NULL &&
-          _micro_tests_strcmp(micro_tests->run_suite, current->test_suite) != 0)
-        continue;
-      if (micro_tests->run_test != NULL &&
-          _micro_tests_strcmp(micro_tests->run_test, current->test_name) != 0)
+      struct timespec ts;
+      if (!__atomic_load_n(&args[i].alive, __ATOMIC_ACQUIRE)
+          || args[i].cpu_clock == CLOCK_MONOTONIC
+          || clock_gettime(args[i].cpu_clock, &ts) != 0)
         continue;
+      double cpu_time = (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+      busy += cpu_time - args[i].cpu_time;
+      args[i].cpu_time = cpu_time;
+      live++;
+    }
+    if (live == 0)
+      break;
+    busy /= wall;
 
-      micro_tests->current_test_index++;
-      pthread_mutex_unlock(&micro_tests->current_test_index_mutex);
-      return current;
+    pthread_mutex_lock(&micro_tests->current_test_index_mutex);
+    int grow = _micro_tests_adapt_step(micro_tests, live, busy, *spawned);
+    pthread_mutex_unlock(&micro_tests->current_test_index_mutex);
+
+    if (micro_tests->debug && (grow > 0 || micro_tests->retire_count > 0))
+      printf("debug: %d threads keep %.2f CPUs busy, adding %d, retiring %d\n",
+             live, busy, grow, micro_tests->retire_count);
+
+    for (int i = 0; i < grow; ++i)
+    {
+      if (_micro_tests_spawn_thread(micro_tests, threads, args, *spawned) < 0)
+        break;
+      (*spawned)++;
     }
   }
-  
-  pthread_mutex_unlock(&micro_tests->current_test_index_mutex);
-  return NULL;
 }
 
-MICRO_TESTS_DEF void *_micro_tests_thread(void *args)
+MICRO_TESTS_DEF int _micro_tests_adapt_step(MicroTests *micro_tests,
+                                            int live, double busy,
+                                            int spawned)
 {
-  long ret = 0;
-  MicroTests *micro_tests = (MicroTests*) args;
-  MicroTest *micro_test = _micro_tests_get_next_test(micro_tests);
-  while (micro_test != NULL)
+  size_t remaining = micro_tests->order_count - micro_tests->started_count;
+  int grow = 0;
+  if (remaining > 0 && micro_tests->waiting_count == 0
+      && busy < 0.5 * live && busy < 0.9 * micro_tests->cpu_count)
   {
-    if (micro_test->marker != 0xDeadBeaf)
-      return (void*)-1;
-
-    if (micro_tests->debug)
-    {
-      printf("(thread %lu) ", pthread_self());
-    }
-    
-    ret += micro_test->function_pointer();       // Execute the test.
-    if (ret < 0)
-    {
-      fprintf(stderr, "suite: %s test: %s FAILED\n",
-              micro_test->test_suite,
-              micro_test->test_name);
-    } else if (!micro_tests->quiet) {
-      printf("suite: %s, test: %s OK\n",
-             micro_test->test_suite,
-             micro_test->test_name);
-    }
-    micro_test = _micro_tests_get_next_test(micro_tests);
+    // The threads are mostly blocked
+    grow = (live / 2 > 0) ? live / 2 : 1;
+    if ((size_t)grow > remaining)
+      grow = (int)remaining;
+    if (grow > micro_tests->thread_number - spawned)
+      grow = micro_tests->thread_number - spawned;
+  } else if (busy > 0.9 * micro_tests->cpu_count
+             && live - micro_tests->retire_count > micro_tests->cpu_count)
+  {
+    // The CPUs are saturated, fewer threads compete for them
+    int extra = live - micro_tests->retire_count - micro_tests->cpu_count;
+    micro_tests->retire_count += (extra / 2 > 0) ? extra / 2 : 1;
   }
-  
-  return (void*)ret; 
+  return grow;
 }
 
 MICRO_TESTS_DEF int
 _micro_tests_run_multithreaded(MicroTests *micro_tests)
 {
   micro_tests->current_test_index = 0;
-  pthread_mutex_init(&micro_tests->current_test_index_mutex, NULL);
+  micro_tests->running_count = 0;
   
-  if (micro_tests->print_banner)
-    printf("Running multithreaded with %d threads.\n\n", micro_tests->thread_number);
-
-  if (pthread_mutex_init(&micro_tests->current_test_index_mutex, NULL) < 0)
+  if (pthread_mutex_init(&micro_tests->current_test_index_mutex, NULL) != 0
+      || pthread_mutex_init(&micro_tests->reporter_mutex, NULL) != 0)
   {
     perror("pthread_mutex_init");
     return -1;
   }
+  if (pthread_cond_init(&micro_tests->test_done_cond, NULL) != 0)
+  {
+    perror("pthread_cond_init");
+    return -1;
+  }
   
+  micro_tests->started_count = 0;
+  micro_tests->waiting_count = 0;
+  micro_tests->retire_count  = 0;
+  micro_tests->jobs          = NULL;
+  micro_tests->cpu_count     = _micro_tests_cpu_count();
+  if (micro_tests->adaptive_threads)
+    micro_tests->thread_number = MICRO_TESTS_MAX_THREADS;
+
   pthread_t *thread_buff = MICRO_TESTS_CALLOC(micro_tests->thread_number,
                                               sizeof(pthread_t));
+  MicroTestsThread *thread_args =
+    MICRO_TESTS_CALLOC(micro_tests->thread_number, sizeof(MicroTestsThread));
+  micro_tests->running = MICRO_TESTS_CALLOC(micro_tests->thread_number,
+                                            sizeof(MicroTest*));
 
-  // Spawn threads
-  for (int i = 0; i < micro_tests->thread_number; ++i)
+  _MICRO_TESTS_REPORT(on_run_start, micro_tests, micro_tests->order_count);
+  _micro_tests_pool = micro_tests;
+
+  // Spawn threads, one per CPU to start with when adaptive
+  int initial = micro_tests->thread_number;
+  if (micro_tests->adaptive_threads && micro_tests->cpu_count < initial)
+    initial = micro_tests->cpu_count;
+  int spawned = 0;
+  for (int i = 0; i < initial; ++i)
   {
-    if (pthread_create(&thread_buff[i], NULL, &_micro_tests_thread, (void*) micro_tests) != 0)
-      perror("run_multithreaded: Error in pthread_create");
+    if (_micro_tests_spawn_thread(micro_tests, thread_buff, thread_args, spawned) == 0)
+      spawned++;
   }
 
+  if (micro_tests->adaptive_threads)
+    _micro_tests_adapt_threads(micro_tests, thread_buff, thread_args, &spawned);
+
   // Wait for threads
-  long ret = 0;
+  long failed = 0;
   void *ret_tmp;
-  for (int i = 0; i < micro_tests->thread_number; ++i)
+  for (int i = 0; i < spawned; ++i)
   {
     if (pthread_join(thread_buff[i], &ret_tmp) != 0)
       perror("pthread_join");
-    ret += (long)ret_tmp;
+    failed += (long)ret_tmp;
   }
+  _micro_tests_pool = NULL;
   
+  MICRO_TESTS_FREE(micro_tests->running);
+  MICRO_TESTS_FREE(thread_args);
   MICRO_TESTS_FREE(thread_buff);
-  pthread_mutex_destroy(&micro_tests->current_test_index_mutex);
 
-  if (!micro_tests->quiet)
-    printf("\nTests done: %ld %s failed\n\n", -ret, (ret == -1) ? "test" : "tests");
+  _MICRO_TESTS_REPORT(on_run_end, micro_tests, (int)failed);
 
+  pthread_cond_destroy(&micro_tests->test_done_cond);
+  pthread_mutex_destroy(&micro_tests->reporter_mutex);
   pthread_mutex_destroy(&micro_tests->current_test_index_mutex);
-  return ret;
+  return failed;
 }
 #endif // MICRO_TESTS_MULTITHREADED
 
+// Calls the task of a job, for the jobs of a MicroTestsTaskGroup
+static void _micro_tests_task_trampoline(size_t i, void *ctx)
+{
+  (void) i;
+  MicroTestsJob *job = ctx;
+  job->task(job->arg);
+}
+
+MICRO_TESTS_DEF void micro_tests_parallel_for(size_t begin, size_t end,
+                                              void (*fn)(size_t i, void *ctx),
+                                              void *ctx)
+{
+  if (end <= begin)
+    return;
+#ifdef MICRO_TESTS_MULTITHREADED
+  MicroTests *pool = _micro_tests_pool;
+  if (pool != NULL && pool->thread_number > 1)
+  {
+    // A few chunks per thread, so that late helpers still balance
+    size_t chunk = (end - begin) / (size_t)(4 * pool->thread_number);
+    MicroTestsJob job = {
+      .fn       = fn,
+      .ctx      = ctx,
+      .next     = begin,
+      .end      = end,
+      .chunk    = (chunk > 0) ? chunk : 1,
+      .done     = 0,
+      .total    = end - begin,
+      .helpers  = 0,
+    };
+    _micro_tests_job_publish(pool, &job);
+    _micro_tests_job_wait(pool, &job);
+    return;
+  }
+#endif
+  for (size_t i = begin; i < end; ++i)
+    fn(i, ctx);
+}
+
+MICRO_TESTS_DEF void micro_tests_task_spawn(MicroTestsTaskGroup *group,
+                                            void (*fn)(void *arg),
+                                            void *arg)
+{
+#ifdef MICRO_TESTS_MULTITHREADED
+  MicroTests *pool = _micro_tests_pool;
+  MicroTestsJob *job = NULL;
+  if (pool != NULL && pool->thread_number > 1)
+    job = MICRO_TESTS_CALLOC(1, sizeof(MicroTestsJob));
+  if (job != NULL)
+  {
+    *job = (MicroTestsJob){
+      .fn        = _micro_tests_task_trampoline,
+      .task      = fn,
+      .arg       = arg,
+      .next      = 0,
+      .end       = 1,
+      .chunk     = 1,
+      .total     = 1,
+      .next_task = group->tasks,
+    };
+    job->ctx = job;
+    group->tasks = job;
+    _micro_tests_job_publish(pool, job);
+    return;
+  }
+#else
+  (void) group;
+  (void) _micro_tests_task_trampoline;
+#endif
+  fn(arg);
+}
+
+MICRO_TESTS_DEF void micro_tests_task_wait(MicroTestsTaskGroup *group)
+{
+#ifdef MICRO_TESTS_MULTITHREADED
+  while (group->tasks != NULL)
+  {
+    MicroTestsJob *job = group->tasks;
+    group->tasks = job->next_task;
+    _micro_tests_job_wait(_micro_tests_pool, job);
+    MICRO_TESTS_FREE(job);
+  }
+#else
+  (void) group;
+#endif
+}
+
+MICRO_TESTS_DEF void micro_tests_bench_pause(MicroTestsBench *bench)
+{
+#ifdef MICRO_TESTS_BENCHMARK
+  bench->pause_start = _micro_tests_timer_stop();
+#ifdef MICRO_TESTS_BENCH_ALLOCS
+  _micro_tests_allocs_paused = _micro_tests_allocs;
+#endif
+#else
+  (void) bench;
+#endif
+}
+
+MICRO_TESTS_DEF void micro_tests_bench_resume(MicroTestsBench *bench)
+{
+#ifdef MICRO_TESTS_BENCHMARK
+#ifdef MICRO_TESTS_BENCH_ALLOCS
+  _micro_tests_allocs = _micro_tests_allocs_paused;
+#endif
+  uint64_t now = _micro_tests_timer_start();
+  if (now > bench->pause_start)
+    bench->paused_ticks += now - bench->pause_start;
+  bench->pauses++;
+#else
+  (void) bench;
+#endif
+}
+
 MICRO_TESTS_DEF int micro_tests_run(int argc, char **argv)
 {
   MicroTests micro_tests;
@@ -643,28 +7873,136 @@ MICRO_TESTS_DEF int micro_tests_run(int argc, char **argv)
     return 0;
   }
 
+#ifdef MICRO_TESTS_ORCHESTRATOR
+  if (micro_tests.executable_count > 0)
+  {
+    int failed = _micro_tests_orchestrate(&micro_tests);
+    MICRO_TESTS_FREE(micro_tests.executables);
+    return failed;
+  }
+#endif
+
+  if (micro_tests.test_file != NULL
+      && _micro_tests_select_from_file(&micro_tests) < 0)
+    return 1;
+
   if (micro_tests.show_list)
   {
     micro_tests_show_list(&micro_tests);
     return 0;
   }
 
-  if (micro_tests.print_banner)
-    micro_tests_print_banner();
-  
+#ifndef MICRO_TESTS_NO_MANIFEST
+  if (micro_tests.manifest_file != NULL)
+    return (micro_tests_show_manifest(&micro_tests) < 0) ? 1 : 0;
+#endif
+
   if (micro_tests.debug)
   {
     printf("debug: __micro_tests_start=%p, __micro_tests_stop=%p\n",
            (void*)__micro_tests_start,
            (void*)__micro_tests_stop);
+#ifdef MICRO_TESTS_PLUGINS
+    printf("debug: %zu tests registered, %zu plugins loaded\n",
+           _micro_tests_count(), _micro_tests_registry.plugin_count);
+#else
+    printf("debug: %zu tests registered\n", _micro_tests_count());
+#endif
+  }
+
+#ifdef MICRO_TESTS_BENCHMARK
+  if (micro_tests.run_benchmarks)
+    return _micro_tests_bench_run(&micro_tests);
+#endif
+
+#if defined(MICRO_TESTS_CAPTURE) && defined(MICRO_TESTS_MULTITHREADED)
+  // The threads share stdout and stderr, each test needs a process
+  if (micro_tests.capture && micro_tests.run_multithreaded
+#ifdef MICRO_TESTS_ISOLATION
+      && !micro_tests.run_isolated
+#endif
+      )
+  {
+    fprintf(stderr, "Error: --capture with --multithreaded needs --isolated\n");
+    return 1;
+  }
+#endif
+
+#if defined(MICRO_TESTS_GLOBALS_CHECK) && defined(MICRO_TESTS_ISOLATION)
+  if (micro_tests.check_globals && micro_tests.run_isolated)
+  {
+    fprintf(stderr, "Error: --check-globals can not see the globals of --isolated tests\n");
+    return 1;
+  }
+#endif
+
+#ifdef MICRO_TESTS_ISOLATION
+  if (micro_tests.run_isolated && _micro_tests_board_open(&micro_tests) < 0)
+    return 1;
+#endif
+
+#ifdef MICRO_TESTS_PROFILE
+#ifdef MICRO_TESTS_ISOLATION
+  if (micro_tests.profile_file != NULL && micro_tests.run_isolated)
+  {
+    fprintf(stderr, "Error: --profile can not sample --isolated tests\n");
+    return 1;
   }
+#endif
+  if (micro_tests.profile_file != NULL
+      && _micro_tests_profile_start() < 0)
+    return 1;
+#endif
+
+#ifdef MICRO_TESTS_CACHE
+  if (micro_tests.cache_dir != NULL
+      && _micro_tests_cache_load(&micro_tests, argc, argv) < 0)
+    return 1;
+#endif
+
+  if (_micro_tests_plan(&micro_tests) < 0)
+    return 1;
 
+  int failed;
+#ifdef MICRO_TESTS_DISTRIBUTED
+  if (micro_tests.coordinator_port != NULL)
+    failed = _micro_tests_coordinate(&micro_tests);
+  else if (micro_tests.worker_address != NULL)
+    failed = _micro_tests_work(&micro_tests);
+  else
+#endif
+#ifdef MICRO_TESTS_GLOBALS_CHECK
+  if (micro_tests.check_globals)
+    failed = _micro_tests_run_check_globals(&micro_tests);
+  else
+#endif
 #ifdef MICRO_TESTS_MULTITHREADED
   if (micro_tests.run_multithreaded && micro_tests.thread_number > 0)
-    return _micro_tests_run_multithreaded(&micro_tests);
+    failed = _micro_tests_run_multithreaded(&micro_tests);
+  else
 #endif
+    failed = _micro_tests_run(&micro_tests);
 
-  return _micro_tests_run(&micro_tests);
+#ifdef MICRO_TESTS_CACHE
+  if (micro_tests.cache_dir != NULL)
+  {
+    _micro_tests_cache_save(&micro_tests);
+    MICRO_TESTS_FREE(micro_tests.cache_file);
+    MICRO_TESTS_FREE(micro_tests.cached);
+  }
+#endif
+  _micro_tests_plan_free(&micro_tests);
+#ifdef MICRO_TESTS_ISOLATION
+  if (micro_tests.run_isolated)
+    _micro_tests_board_close(&micro_tests);
+#endif
+#ifdef MICRO_TESTS_PROFILE
+  if (micro_tests.profile_file != NULL
+      && _micro_tests_profile_write(&micro_tests) < 0)
+    failed++;
+#endif
+  MICRO_TESTS_FREE(micro_tests.selection);
+  return failed;
 }
 
 MICRO_TESTS_DEF void micro_tests_print_banner(void)
@@ -683,12 +8021,54 @@ MICRO_TESTS_DEF void micro_tests_print_help(void)
   printf("\n");
   printf("  --help,-h             show help message\n");
   printf("  --list                list tests\n");
+#ifndef MICRO_TESTS_NO_MANIFEST
+  printf("  --manifest <file>     list the tests of an executable without running it\n");
+#endif // MICRO_TESTS_NO_MANIFEST
+#ifdef MICRO_TESTS_PLUGINS
+  printf("  --load <library>      also run the tests of a shared library\n");
+#endif // MICRO_TESTS_PLUGINS
+#ifdef MICRO_TESTS_DISTRIBUTED
+  printf("  --coordinator <port>  hand out batches of the tests to the workers\n");
+  printf("  --worker <host:port>  run the batches of a coordinator\n");
+#endif // MICRO_TESTS_DISTRIBUTED
+#ifdef MICRO_TESTS_ORCHESTRATOR
+  printf("  --orchestrate <file>  run the tests of another executable in batches\n");
+  printf("  --jobs <n>            batches running at the same time (use with --orchestrate)\n");
+#endif // MICRO_TESTS_ORCHESTRATOR
   printf("  --suite <suite-name>  run a specific suite\n");
   printf("  --test  <test-name>   run a specific test\n");
+  printf("  --durations <file>    schedule with and update the recorded durations\n");
+  printf("  --test-file <file>    run the \"suite.test\" tests listed in a file\n");
+#ifndef _MICRO_TESTS_REPORTER
+  printf("  --reporter <name>     output format: console, tap, junit or json\n");
+#endif // _MICRO_TESTS_REPORTER
 #ifdef MICRO_TESTS_MULTITHREADED
   printf("  --multithreaded       run tests on multiple threads\n");
   printf("  --threads <n>         specify the number n of threads (use with --multithreaded)\n");
+  printf("  --threads auto        adapt the number of threads to the load of the tests\n");
 #endif // MICRO_TESTS_MULTITHREADED
+#ifdef MICRO_TESTS_ISOLATION
+  printf("  --isolated            run each test in its own process\n");
+#endif // MICRO_TESTS_ISOLATION
+#ifdef MICRO_TESTS_GLOBALS_CHECK
+  printf("  --check-globals       report the tests that write global state\n");
+#endif // MICRO_TESTS_GLOBALS_CHECK
+#ifdef MICRO_TESTS_BENCHMARK
+  printf("  --bench               run the benchmarks instead of the tests\n");
+  printf("  --baseline <file>     compare the benchmarks with saved results\n");
+  printf("  --save-baseline <file> save the results of the benchmarks\n");
+  printf("  --force               save the baseline from a noisy environment\n");
+#endif // MICRO_TESTS_BENCHMARK
+#ifdef MICRO_TESTS_CAPTURE
+  printf("  --capture             show the output of the tests only if they fail\n");
+#endif // MICRO_TESTS_CAPTURE
+#ifdef MICRO_TESTS_CACHE
+  printf("  --cache <dir>         skip the tests that passed with the same build\n");
+  printf("  --no-cache            run the tests that passed too (use with --cache)\n");
+#endif // MICRO_TESTS_CACHE
+#ifdef MICRO_TESTS_PROFILE
+  printf("  --profile <file>      save the folded stacks of the tests\n");
+#endif // MICRO_TESTS_PROFILE
   printf("  --no-banner           do not print the banner\n");
   printf("  --debug               additional debug prints\n");
   printf("  --quiet               do not print OK results\n");
@@ -696,29 +8076,446 @@ MICRO_TESTS_DEF void micro_tests_print_help(void)
 
 MICRO_TESTS_DEF void micro_tests_show_list(MicroTests *micro_tests)
 {
-  size_t count = (__micro_tests_stop - __micro_tests_start) / sizeof(MicroTest);
-  MicroTest* test = (MicroTest*)__micro_tests_start;
+  size_t count = _micro_tests_count();
+  MicroTest* test = _micro_tests_tests();
 
   for (size_t i = 0; i < count; i++)
   {
     MicroTest* current = &test[i];
-    
-    if (current->marker == 0xDeadBeaf)
+    if (!_micro_tests_is_selected(micro_tests, current))
+      continue;
+      
+    printf("suite: %s, test: %s\n",
+           current->test_suite,
+           current->test_name);
+  }
+}
+
+#ifndef MICRO_TESTS_NO_MANIFEST
+
+MICRO_TESTS_DEF long
+micro_tests_manifest_read(const char *path,
+                          int (*fn)(const MicroTestsManifestEntry *entry,
+                                    void *ctx),
+                          void *ctx)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ElfW(Ehdr)))
+  {
+    close(fd);
+    return -1;
+  }
+  size_t size = st.st_size;
+  void *image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED)
+    return -1;
+
+  const unsigned char *bytes = image;
+  const ElfW(Ehdr) *header = image;
+  long count = -1;
+  if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0
+      || header->e_ident[EI_CLASS] != ((sizeof(void*) == 8) ? ELFCLASS64 : ELFCLASS32)
+      || header->e_shoff == 0 || header->e_shstrndx >= header->e_shnum
+      || header->e_shoff + (size_t)header->e_shnum * sizeof(ElfW(Shdr)) > size)
+    goto done;
+
+  const ElfW(Shdr) *sections = (const ElfW(Shdr)*)(bytes + header->e_shoff);
+  const ElfW(Shdr) *names = &sections[header->e_shstrndx];
+  if (names->sh_offset + names->sh_size > size)
+    goto done;
+  for (size_t i = 0; i < header->e_shnum; ++i)
+  {
+    if (sections[i].sh_name >= names->sh_size
+        || strncmp((const char*)bytes + names->sh_offset + sections[i].sh_name,
+                   ".micro_tests_manifest", names->sh_size - sections[i].sh_name) != 0
+        || sections[i].sh_type != SHT_PROGBITS
+        || sections[i].sh_offset + sections[i].sh_size > size)
+      continue;
+
+    // The linker may pad between the records with zeros
+    const unsigned char *it = bytes + sections[i].sh_offset;
+    const unsigned char *end = it + sections[i].sh_size;
+    count = 0;
+    while (it + sizeof(MicroTestsManifestRecord) <= end)
     {
-      if (micro_tests->run_suite != NULL &&
-          _micro_tests_strcmp(micro_tests->run_suite, current->test_suite) != 0)
+      MicroTestsManifestRecord record;
+      memcpy(&record, it, sizeof(record));
+      if (record.size == 0)
+      {
+        it += 4;
+        continue;
+      }
+      if (record.size < sizeof(record) || record.size > (size_t)(end - it))
+        break;
+
+      const char *text = (const char*)it + sizeof(record);
+      const char *text_end = (const char*)it + record.size;
+      it += record.size;
+      if (record.version != MICRO_TESTS_MANIFEST_VERSION)
         continue;
-      if (micro_tests->run_test != NULL &&
-          _micro_tests_strcmp(micro_tests->run_test, current->test_name) != 0)
+
+      // Four strings, the last one terminated inside the record
+      const char *strings[4];
+      size_t found = 0;
+      for (const char *s = text; found < 4 && s < text_end;)
+      {
+        strings[found++] = s;
+        const char *nul = memchr(s, '\0', text_end - s);
+        if (nul == NULL)
+        {
+          found = 0;
+          break;
+        }
+        s = nul + 1;
+      }
+      if (found < 4)
         continue;
-      
-      printf("suite: %s, test: %s\n",
-             current->test_suite,
-             current->test_name);
+
+      MicroTestsManifestEntry entry = {
+        .suite = strings[0],
+        .name  = strings[1],
+        .file  = strings[2],
+        .line  = record.line,
+        .tags  = strings[3],
+      };
+      count++;
+      if (fn != NULL && fn(&entry, ctx) != 0)
+        break;
+    }
+    break;
+  }
+
+done:
+  munmap(image, size);
+  return count;
+}
+
+static int _micro_tests_manifest_print(const MicroTestsManifestEntry *entry,
+                                       void *ctx)
+{
+  MicroTests *micro_tests = ctx;
+  if (micro_tests->run_suite != NULL &&
+      _micro_tests_strcmp(micro_tests->run_suite, entry->suite) != 0)
+    return 0;
+  if (micro_tests->run_test != NULL &&
+      _micro_tests_strcmp(micro_tests->run_test, entry->name) != 0)
+    return 0;
+
+  printf("suite: %s, test: %s, location: %s:%u", entry->suite, entry->name,
+         entry->file, (unsigned)entry->line);
+  if (entry->tags[0] != '\0')
+    printf(", tags: %s", entry->tags);
+  printf("\n");
+  return 0;
+}
+
+MICRO_TESTS_DEF int micro_tests_show_manifest(MicroTests *micro_tests)
+{
+  if (micro_tests_manifest_read(micro_tests->manifest_file,
+                                _micro_tests_manifest_print, micro_tests) < 0)
+  {
+    fprintf(stderr, "Error: No test manifest in %s\n",
+            micro_tests->manifest_file);
+    return -1;
+  }
+  return 0;
+}
+
+#endif // MICRO_TESTS_NO_MANIFEST
+
+//
+// Reporters
+//
+
+#if !defined(_MICRO_TESTS_REPORTER) || defined(MICRO_TESTS_REPORTER_CONSOLE)
+
+MICRO_TESTS_DEF void
+_micro_tests_console_on_run_start(MicroTests *micro_tests, size_t test_count)
+{
+  (void) test_count;
+  if (!micro_tests->print_banner)
+    return;
+
+  micro_tests_print_banner();
+#ifdef MICRO_TESTS_MULTITHREADED
+  if (micro_tests->run_multithreaded && micro_tests->adaptive_threads)
+    printf("Running multithreaded with an adaptive number of threads, %d CPUs available.\n\n",
+           micro_tests->cpu_count);
+  else if (micro_tests->run_multithreaded)
+    printf("Running multithreaded with %d threads.\n\n", micro_tests->thread_number);
+#endif
+}
+
+MICRO_TESTS_DEF void
+_micro_tests_console_on_test_start(MicroTests *micro_tests, MicroTest *test)
+{
+  (void) micro_tests;
+  (void) test;
+}
+
+MICRO_TESTS_DEF void
+_micro_tests_console_on_test_end(MicroTests *micro_tests, MicroTest *test,
+                                 MicroTestsStatus status)
+{
+  if (status == MICRO_TESTS_OK && micro_tests->quiet)
+    return;
+
+  FILE *out = (status == MICRO_TESTS_FAILED) ? stderr : stdout;
+#ifdef MICRO_TESTS_MULTITHREADED
+  if (micro_tests->debug && micro_tests->run_multithreaded)
+    fprintf(out, "(thread %lu) ", (unsigned long) pthread_self());
+#endif
+  fprintf(out, "suite: %s, test: %s %s\n",
+          test->test_suite,
+          test->test_name,
+          (status == MICRO_TESTS_OK) ? "OK"
+          : (status == MICRO_TESTS_FAILED) ? "FAILED" : "SKIPPED");
+}
+
+MICRO_TESTS_DEF void
+_micro_tests_console_on_run_end(MicroTests *micro_tests, int failed)
+{
+  if (!micro_tests->quiet)
+    printf("\nTests done: %d %s failed\n\n", failed, (failed == 1) ? "test" : "tests");
+}
+
+#endif // console
+
+#if !defined(_MICRO_TESTS_REPORTER) || defined(MICRO_TESTS_REPORTER_TAP)
+
+MICRO_TESTS_DEF void
+_micro_tests_tap_on_run_start(MicroTests *micro_tests, size_t test_count)
+{
+  (void) micro_tests;
+  printf("TAP version 14\n");
+  printf("1..%zu\n", test_count);
+}
+
+MICRO_TESTS_DEF void
+_micro_tests_tap_on_test_start(MicroTests *micro_tests, MicroTest *test)
+{
+  (void) micro_tests;
+  // A reader of the stream, like --orchestrate, knows which test was
+  // running if the process crashes
+  printf("# running %s.%s\n", test->test_suite, test->test_name);
+  fflush(stdout);
+}
+
+MICRO_TESTS_DEF void
+_micro_tests_tap_on_test_end(MicroTests *micro_tests, MicroTest *test,
+                             MicroTestsStatus status)
+{
+  micro_tests->reported_count++;
+  if (status == MICRO_TESTS_OK)
+  {
+    printf("ok %zu - %s.%s\n", micro_tests->reported_count,
+           test->test_suite, test->test_name);
+  } else if (status == MICRO_TESTS_SKIPPED)
+  {
+    printf("ok %zu - %s.%s # SKIP prerequisite did not succeed\n",
+           micro_tests->reported_count, test->test_suite, test->test_name);
+  } else
+  {
+    printf("not ok %zu - %s.%s\n", micro_tests->reported_count,
+           test->test_suite, test->test_name);
+    printf("  ---\n");
+    printf("  at:\n");
+    printf("    file: %s\n", test->file_name);
+    printf("    line: %u\n", (unsigned) test->line_number);
+    printf("  ...\n");
+  }
+  // A reader of the stream, like --orchestrate, keeps the outcomes
+  // reported before a crash
+  fflush(stdout);
+}
+
+MICRO_TESTS_DEF void
+_micro_tests_tap_on_run_end(MicroTests *micro_tests, int failed)
+{
+  (void) micro_tests;
+  if (failed > 0)
+    printf("# failed %d of %zu tests\n", failed, micro_tests->reported_count);
+}
+
+#endif // tap
+
+#if !defined(_MICRO_TESTS_REPORTER) || defined(MICRO_TESTS_REPORTER_JUNIT)
+
+MICRO_TESTS_DEF void _micro_tests_print_xml(FILE *out, const char *text)
+{
+  for (const unsigned char *it = (const unsigned char*)text; *it != '\0'; ++it)
+  {
+    switch (*it)
+    {
+    case '&':  fputs("&amp;", out);  break;
+    case '<':  fputs("&lt;", out);   break;
+    case '>':  fputs("&gt;", out);   break;
+    case '"':  fputs("&quot;", out); break;
+    case '\'': fputs("&apos;", out); break;
+    default:
+      if (*it < 0x20 && *it != '\t' && *it != '\n' && *it != '\r')
+        fputc('?', out);
+      else
+        fputc(*it, out);
     }
   }
 }
 
+MICRO_TESTS_DEF void
+_micro_tests_junit_on_run_start(MicroTests *micro_tests, size_t test_count)
+{
+  (void) test_count;
+  // The test cases are held until the counts of the <testsuite> are
+  // known
+  micro_tests->report_buffer = open_memstream(&micro_tests->report_text,
+                                              &micro_tests->report_size);
+  if (micro_tests->report_buffer == NULL)
+    perror("open_memstream");
+}
+
+MICRO_TESTS_DEF void
+_micro_tests_junit_on_test_start(MicroTests *micro_tests, MicroTest *test)
+{
+  (void) micro_tests;
+  (void) test;
+}
+
+MICRO_TESTS_DEF void
+_micro_tests_junit_on_test_end(MicroTests *micro_tests, MicroTest *test,
+                               MicroTestsStatus status)
+{
+  FILE *out = (micro_tests->report_buffer != NULL)
+    ? micro_tests->report_buffer : stdout;
+  micro_tests->reported_count++;
+  fputs("    <testcase classname=\"", out);
+  _micro_tests_print_xml(out, test->test_suite);
+  fputs("\" name=\"", out);
+  _micro_tests_print_xml(out, test->test_name);
+  fputs("\" file=\"", out);
+  _micro_tests_print_xml(out, test->file_name);
+  fprintf(out, "\" line=\"%u\"", (unsigned) test->line_number);
+  if (status == MICRO_TESTS_OK)
+    fprintf(out, "/>\n");
+  else if (status == MICRO_TESTS_SKIPPED)
+  {
+    micro_tests->skipped_count++;
+    fprintf(out, ">\n      <skipped message=\"prerequisite did not succeed\"/>\n    </testcase>\n");
+  }
+  else
+    fprintf(out, ">\n      <failure message=\"test failed\"/>\n    </testcase>\n");
+}
+
+MICRO_TESTS_DEF void
+_micro_tests_junit_on_run_end(MicroTests *micro_tests, int failed)
+{
+  printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+  printf("<testsuites tests=\"%zu\" failures=\"%d\" skipped=\"%zu\">\n",
+         micro_tests->reported_count, failed, micro_tests->skipped_count);
+  printf("  <testsuite name=\"micro-tests\" tests=\"%zu\" failures=\"%d\" "
+         "skipped=\"%zu\">\n",
+         micro_tests->reported_count, failed, micro_tests->skipped_count);
+  if (micro_tests->report_buffer != NULL)
+  {
+    fclose(micro_tests->report_buffer);
+    fwrite(micro_tests->report_text, 1, micro_tests->report_size, stdout);
+    free(micro_tests->report_text);
+    micro_tests->report_buffer = NULL;
+    micro_tests->report_text = NULL;
+  }
+  printf("  </testsuite>\n");
+  printf("</testsuites>\n");
+}
+
+#endif // junit
+
+#if !defined(_MICRO_TESTS_REPORTER) || defined(MICRO_TESTS_REPORTER_JSON)
+
+MICRO_TESTS_DEF void _micro_tests_print_json(FILE *out, const char *text)
+{
+  for (const unsigned char *it = (const unsigned char*)text; *it != '\0'; ++it)
+  {
+    if (*it == '"' || *it == '\\')
+      fprintf(out, "\\%c", *it);
+    else if (*it < 0x20)
+      fprintf(out, "\\u%04x", *it);
+    else
+      fputc(*it, out);
+  }
+}
+
+MICRO_TESTS_DEF void
+_micro_tests_json_on_run_start(MicroTests *micro_tests, size_t test_count)
+{
+  (void) micro_tests;
+  printf("{\"count\":%zu,\"tests\":[\n", test_count);
+}
+
+MICRO_TESTS_DEF void
+_micro_tests_json_on_test_start(MicroTests *micro_tests, MicroTest *test)
+{
+  (void) micro_tests;
+  (void) test;
+}
+
+MICRO_TESTS_DEF void
+_micro_tests_json_on_test_end(MicroTests *micro_tests, MicroTest *test,
+                              MicroTestsStatus status)
+{
+  printf("%s{\"suite\":\"", (micro_tests->reported_count > 0) ? ",\n" : "");
+  _micro_tests_print_json(stdout, test->test_suite);
+  printf("\",\"name\":\"");
+  _micro_tests_print_json(stdout, test->test_name);
+  printf("\",\"file\":\"");
+  _micro_tests_print_json(stdout, test->file_name);
+  printf("\",\"line\":%u,\"status\":\"%s\"}", (unsigned) test->line_number,
+         (status == MICRO_TESTS_OK) ? "ok"
+         : (status == MICRO_TESTS_FAILED) ? "failed" : "skipped");
+  micro_tests->reported_count++;
+}
+
+MICRO_TESTS_DEF void
+_micro_tests_json_on_run_end(MicroTests *micro_tests, int failed)
+{
+  printf("%s],\"failed\":%d}\n",
+         (micro_tests->reported_count > 0) ? "\n" : "", failed);
+}
+
+#endif // json
+
+#ifndef _MICRO_TESTS_REPORTER
+
+#define _MICRO_TESTS_REPORTER_ENTRY(__name)                \
+  { #__name,                                               \
+    _micro_tests_##__name##_on_run_start,                  \
+    _micro_tests_##__name##_on_test_start,                 \
+    _micro_tests_##__name##_on_test_end,                   \
+    _micro_tests_##__name##_on_run_end }
+
+const MicroTestsReporter micro_tests_reporters[] = {
+  _MICRO_TESTS_REPORTER_ENTRY(console),
+  _MICRO_TESTS_REPORTER_ENTRY(tap),
+  _MICRO_TESTS_REPORTER_ENTRY(junit),
+  _MICRO_TESTS_REPORTER_ENTRY(json),
+  { NULL, NULL, NULL, NULL, NULL },
+};
+
+MICRO_TESTS_DEF const MicroTestsReporter*
+micro_tests_find_reporter(const char *name)
+{
+  for (const MicroTestsReporter *r = micro_tests_reporters; r->name != NULL; ++r)
+  {
+    if (_micro_tests_strcmp(name, r->name) == 0)
+      return r;
+  }
+  return NULL;
+}
+
+#endif // _MICRO_TESTS_REPORTER
+
 #endif // MICRO_TESTS_IMPLEMENTATION
 
 //
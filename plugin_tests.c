@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+
+// Tests built as a shared library and run with --load, the
+// implementation is in the runner
+#include "micro-tests.h"
+
+TEST(plugin_tests, simple_assertion)
+{
+  ASSERT(1);
+  TEST_SUCCESS;
+}
+
+TEST(plugin_tests, simple_assert_eq)
+{
+  ASSERT_EQ(2 + 2, 4);
+  TEST_SUCCESS;
+}
+
+TEST_AFTER(plugin_tests, uses_runner_test, "base_tests.simple_assertion")
+{
+  TEST_SUCCESS;
+}
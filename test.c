@@ -4,6 +4,16 @@
 // Github:  @San7o
 
 #define MICRO_TESTS_MULTITHREADED
+#define MICRO_TESTS_ISOLATION
+#define MICRO_TESTS_GLOBALS_CHECK
+#define MICRO_TESTS_BENCHMARK
+#define MICRO_TESTS_BENCH_ALLOCS
+#define MICRO_TESTS_PROFILE
+#define MICRO_TESTS_ORCHESTRATOR
+#define MICRO_TESTS_DISTRIBUTED
+#define MICRO_TESTS_CACHE
+#define MICRO_TESTS_CAPTURE
+#define MICRO_TESTS_PLUGINS
 #define MICRO_TESTS_IMPLEMENTATION
 #include "micro-tests.h"
 
@@ -25,6 +35,921 @@ TEST(base_tests2, simple_assert_not_eq)
   TEST_SUCCESS;
 }
 
+static int shared_counter = 0;
+// Tests using shared_counter right now, more than one means that the
+// scheduler let them overlap
+static int counter_users = 0;
+
+static int use_counter(void)
+{
+  int users = __atomic_add_fetch(&counter_users, 1, __ATOMIC_ACQ_REL);
+  // Long enough for the other threads to start their tests
+  struct timespec pause = { 0, 20000000 };
+  nanosleep(&pause, NULL);
+  return users;
+}
+
+static void release_counter(void)
+{
+  __atomic_sub_fetch(&counter_users, 1, __ATOMIC_ACQ_REL);
+}
+
+TEST_RESOURCES(resource_tests, increment_counter, "shared_counter")
+{
+  int users = use_counter();
+  int before = shared_counter;
+  shared_counter = before + 1;
+  int alone = __atomic_load_n(&counter_users, __ATOMIC_ACQUIRE) == 1;
+  release_counter();
+  ASSERT_EQ(users, 1);
+  ASSERT(alone);
+  ASSERT_EQ(shared_counter, before + 1);
+  TEST_SUCCESS;
+}
+
+TEST_RESOURCES(resource_tests, double_counter, "shared_counter")
+{
+  int users = use_counter();
+  int before = shared_counter;
+  shared_counter = before * 2;
+  int alone = __atomic_load_n(&counter_users, __ATOMIC_ACQUIRE) == 1;
+  release_counter();
+  ASSERT_EQ(users, 1);
+  ASSERT(alone);
+  ASSERT_EQ(shared_counter, before * 2);
+  TEST_SUCCESS;
+}
+
+TEST_SERIAL(resource_tests, reset_counter)
+{
+  int users = use_counter();
+  shared_counter = 0;
+  int alone = __atomic_load_n(&counter_users, __ATOMIC_ACQUIRE) == 1;
+  release_counter();
+  ASSERT_EQ(users, 1);
+  ASSERT(alone);
+  ASSERT_EQ(shared_counter, 0);
+  TEST_SUCCESS;
+}
+
+// Mapped before the run, so that the processes of --isolated share it
+static int *cache_populated = NULL;
+
+__attribute__((constructor))
+static void map_cache(void)
+{
+  void *shared = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared != MAP_FAILED)
+    cache_populated = shared;
+}
+
+TEST(dependency_tests, populate_cache)
+{
+  ASSERT(cache_populated != NULL);
+  *cache_populated = 1;
+  TEST_SUCCESS;
+}
+
+TEST_AFTER(dependency_tests, use_cache, "populate_cache")
+{
+  ASSERT(cache_populated != NULL);
+  ASSERT(*cache_populated);
+  TEST_SUCCESS;
+}
+
+TEST(dependency_tests, filter_keeps_prerequisites)
+{
+  char *argv[] = { "test", "--test", "use_cache" };
+  MicroTests micro_tests;
+  ASSERT_EQ(micro_tests_parse_args(&micro_tests, 3, argv), 0);
+  ASSERT_EQ(_micro_tests_plan(&micro_tests), 0);
+  const char *populate = "dependency_tests.populate_cache";
+  const char *use = "dependency_tests.use_cache";
+  size_t order_count = micro_tests.order_count;
+  size_t first = micro_tests.order[0], second = micro_tests.order[1];
+  _micro_tests_plan_free(&micro_tests);
+  ASSERT_EQ(order_count, 2);
+  ASSERT_EQ(first, (size_t)_micro_tests_find_test(populate, strlen(populate), ""));
+  ASSERT_EQ(second, (size_t)_micro_tests_find_test(use, strlen(use), ""));
+  TEST_SUCCESS;
+}
+
+static volatile int crash_requested = 0;
+
+TEST(isolation_tests, crash_if_requested)
+{
+  if (crash_requested)
+    abort();
+  TEST_SUCCESS;
+}
+
+TEST_SERIAL(isolation_tests, crash_is_reported)
+{
+  char *argv[] = { "test" };
+  MicroTests micro_tests;
+  ASSERT_EQ(micro_tests_parse_args(&micro_tests, 1, argv), 0);
+  ASSERT_EQ(_micro_tests_board_open(&micro_tests), 0);
+  const char *name = "isolation_tests.crash_if_requested";
+  long index = _micro_tests_find_test(name, strlen(name), "");
+  ASSERT(index >= 0);
+
+  // Without the message of the parent about the signal
+  fflush(stderr);
+  int saved = dup(STDERR_FILENO);
+  int null = open("/dev/null", O_WRONLY);
+  dup2(null, STDERR_FILENO);
+  close(null);
+  crash_requested = 1;
+  MicroTestsStatus status =
+    _micro_tests_exec_isolated(&micro_tests, &_micro_tests_tests()[index]);
+  crash_requested = 0;
+  dup2(saved, STDERR_FILENO);
+  close(saved);
+
+  _micro_tests_board_close(&micro_tests);
+  ASSERT_EQ(status, MICRO_TESTS_FAILED);
+  TEST_SUCCESS;
+}
+
+static int globals_written = 0;
+
+TEST(globals_tests, writes_global)
+{
+  globals_written++;
+  TEST_SUCCESS;
+}
+
+TEST(globals_tests, calibrates_timer)
+{
+  _micro_tests_timer_init();
+  TEST_SUCCESS;
+}
+
+// Call run with stdout and stderr redirected to a memory file, and
+// read what was printed. Returns what run returned, or -1 if the
+// output could not be redirected
+static int capture_output(int (*run)(void *ctx), void *ctx, char *buffer,
+                          size_t size)
+{
+  buffer[0] = '\0';
+  int fd = memfd_create("captured_output", 0);
+  if (fd < 0)
+    return -1;
+  int saved[2];
+  if (_micro_tests_capture_redirect(fd, saved) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+  int result = run(ctx);
+  _micro_tests_capture_restore(saved);
+  ssize_t length = pread(fd, buffer, size - 1, 0);
+  buffer[length > 0 ? length : 0] = '\0';
+  close(fd);
+  return result;
+}
+
+static int run_check_globals(void *micro_tests)
+{
+  return _micro_tests_run_check_globals(micro_tests);
+}
+
+// Run --check-globals on one test and read what it printed
+static int check_globals_of(char *test, char *buffer, size_t size)
+{
+  char *argv[] = { "test", "--check-globals", "--test", test };
+  MicroTests micro_tests;
+  if (micro_tests_parse_args(&micro_tests, 4, argv) < 0
+      || _micro_tests_plan(&micro_tests) < 0)
+    return -1;
+  int failed = capture_output(run_check_globals, &micro_tests, buffer, size);
+  _micro_tests_plan_free(&micro_tests);
+  return failed;
+}
+
+TEST_SERIAL(globals_tests, mutation_is_caught)
+{
+  char output[1024];
+  ASSERT_EQ(check_globals_of("writes_global", output,
+                             sizeof(output)), 0);
+  ASSERT(strstr(output, "1 test writes global state") != NULL);
+  // The state of the framework is not reported, even if it changed
+  _micro_tests_timer.overhead = UINT64_MAX;
+  ASSERT_EQ(check_globals_of("calibrates_timer", output,
+                             sizeof(output)), 0);
+  ASSERT(_micro_tests_timer.overhead != UINT64_MAX);
+  ASSERT(strstr(output, "0 tests write global state") != NULL);
+  // Nor the tests that are declared
+  ASSERT_EQ(check_globals_of("increment_counter", output,
+                             sizeof(output)), 0);
+  ASSERT(strstr(output, "0 tests write global state") != NULL);
+  TEST_SUCCESS;
+}
+
+typedef struct {
+  size_t sum;
+  pthread_t caller;
+  int helped;
+} ParallelSum;
+
+static void add_index(size_t i, void *ctx)
+{
+  ParallelSum *parallel = ctx;
+  __atomic_fetch_add(&parallel->sum, i, __ATOMIC_RELAXED);
+  if (!pthread_equal(pthread_self(), parallel->caller))
+    __atomic_store_n(&parallel->helped, 1, __ATOMIC_RELEASE);
+
+  // Give the other threads up to a second to take a chunk
+  struct timespec pause = { 0, 1000000 };
+  for (int wait = 0; i == 0 && wait < 1000
+         && !__atomic_load_n(&parallel->helped, __ATOMIC_ACQUIRE); ++wait)
+    nanosleep(&pause, NULL);
+}
+
+// Serial, so that the other threads are free to help
+TEST_SERIAL(parallel_tests, parallel_for)
+{
+  ParallelSum parallel = { .sum = 0, .caller = pthread_self(), .helped = 0 };
+  MICRO_PARALLEL_FOR(0, 1000, add_index, &parallel);
+  ASSERT_EQ(parallel.sum, 499500);
+  if (_micro_tests_pool != NULL && _micro_tests_pool->thread_number > 1
+      && !_micro_tests_pool->adaptive_threads)
+    ASSERT(parallel.helped);
+  TEST_SUCCESS;
+}
+
+TEST(thread_tests, cgroup_quota)
+{
+  ASSERT_EQ(_micro_tests_cpu_quota("150000 100000\n", NULL, NULL), 2);
+  ASSERT_EQ(_micro_tests_cpu_quota("100000 100000\n", NULL, NULL), 1);
+  ASSERT_EQ(_micro_tests_cpu_quota("max 100000\n", NULL, NULL), 0);
+  ASSERT_EQ(_micro_tests_cpu_quota("", NULL, NULL), 0);
+  // The files of cgroup v1, where -1 means no quota
+  ASSERT_EQ(_micro_tests_cpu_quota(NULL, "400000\n", "100000\n"), 4);
+  ASSERT_EQ(_micro_tests_cpu_quota(NULL, "50000\n", "100000\n"), 1);
+  ASSERT_EQ(_micro_tests_cpu_quota(NULL, "-1\n", "100000\n"), 0);
+  ASSERT_EQ(_micro_tests_cpu_quota(NULL, "400000\n", ""), 0);
+  ASSERT_EQ(_micro_tests_cpu_quota(NULL, NULL, NULL), 0);
+  TEST_SUCCESS;
+}
+
+TEST(thread_tests, adapt_rules)
+{
+  MicroTests micro_tests = { 0 };
+  micro_tests.cpu_count     = 4;
+  micro_tests.thread_number = 16;
+  micro_tests.order_count   = 100;
+  micro_tests.started_count = 10;
+
+  // Mostly blocked threads grow by half, up to the limits
+  ASSERT_EQ(_micro_tests_adapt_step(&micro_tests, 4, 0.5, 4), 2);
+  ASSERT_EQ(_micro_tests_adapt_step(&micro_tests, 4, 0.5, 15), 1);
+  micro_tests.started_count = 99;
+  ASSERT_EQ(_micro_tests_adapt_step(&micro_tests, 4, 0.5, 4), 1);
+  micro_tests.started_count = 10;
+  micro_tests.waiting_count = 1;
+  ASSERT_EQ(_micro_tests_adapt_step(&micro_tests, 4, 0.5, 4), 0);
+  micro_tests.waiting_count = 0;
+  ASSERT_EQ(micro_tests.retire_count, 0);
+
+  // Saturated CPUs retire half of the excess threads at a time, down
+  // to one thread per CPU
+  const int retired[] = { 4, 6, 7, 8, 8 };
+  for (size_t i = 0; i < sizeof(retired) / sizeof(retired[0]); ++i)
+  {
+    ASSERT_EQ(_micro_tests_adapt_step(&micro_tests, 12, 3.9, 12), 0);
+    ASSERT_EQ(micro_tests.retire_count, retired[i]);
+  }
+  TEST_SUCCESS;
+}
+
+static int find_in_manifest(const MicroTestsManifestEntry *entry, void *ctx)
+{
+  uint32_t *line = ctx;
+  if (_micro_tests_strcmp(entry->name, "read_itself") != 0
+      || entry->line != *line)
+    return 0;
+  *line = 0;
+  return 1;
+}
+
+TEST(manifest_tests, read_itself)
+{
+  uint32_t line = __LINE__ - 2;
+  size_t registered = (__micro_tests_stop - __micro_tests_start) / sizeof(MicroTest);
+  ASSERT_EQ(micro_tests_manifest_read("/proc/self/exe", NULL, NULL),
+            (long)registered);
+  micro_tests_manifest_read("/proc/self/exe", find_in_manifest, &line);
+  ASSERT_EQ(line, 0);
+  TEST_SUCCESS;
+}
+
+TEST_WITH(manifest_tests, with_options, MICRO_TESTS_SERIAL,
+          MICRO_TESTS_AFTER("read_itself"))
+{
+  TEST_SUCCESS;
+}
+
+static int copy_tags(const MicroTestsManifestEntry *entry, void *ctx)
+{
+  if (_micro_tests_strcmp(entry->name, "with_options") != 0)
+    return 0;
+  snprintf(ctx, 64, "%s", entry->tags);
+  return 1;
+}
+
+TEST(manifest_tests, tags_of_options)
+{
+  char tags[64] = "";
+  micro_tests_manifest_read("/proc/self/exe", copy_tags, tags);
+  ASSERT(_micro_tests_strcmp(tags, "serial after=read_itself") == 0);
+  const char *name = "manifest_tests.with_options";
+  long index = _micro_tests_find_test(name, strlen(name), "");
+  ASSERT(index >= 0);
+  MicroTest *test = &_micro_tests_tests()[index];
+  ASSERT(test->flags & MICRO_TESTS_FLAG_SERIAL);
+  ASSERT(_micro_tests_strcmp(test->depends, "read_itself") == 0);
+  TEST_SUCCESS;
+}
+
+static volatile int profile_requested = 0;
+
+// Busy for 100 ms of CPU time, in a frame of its own
+static __attribute__((noinline)) void spin_cpu(void)
+{
+  struct timespec start, now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+  do
+  {
+    // Mostly in this frame, rarely in the one of clock_gettime
+    for (volatile int i = 0; i < 1000000; ++i);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  } while ((now.tv_sec - start.tv_sec) * 1000000000L
+           + (now.tv_nsec - start.tv_nsec) < 100000000L);
+}
+
+TEST(profile_tests, busy)
+{
+  if (profile_requested)
+    spin_cpu();
+  TEST_SUCCESS;
+}
+
+TEST_SERIAL(profile_tests, folded_stacks)
+{
+  // Not inside a run that profiles already
+  if (_micro_tests_profile.samples != NULL)
+    TEST_SUCCESS;
+
+  char path[] = "/tmp/micro-tests-profile-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT(fd >= 0);
+  close(fd);
+  char *argv[] = { "test", "--profile", path, "--quiet" };
+  MicroTests micro_tests;
+  ASSERT_EQ(micro_tests_parse_args(&micro_tests, 4, argv), 0);
+  const char *name = "profile_tests.busy";
+  long index = _micro_tests_find_test(name, strlen(name), "");
+  ASSERT(index >= 0);
+
+  ASSERT_EQ(_micro_tests_profile_start(), 0);
+  profile_requested = 1;
+  MicroTestsStatus status =
+    _micro_tests_exec(&micro_tests, &_micro_tests_tests()[index]);
+  profile_requested = 0;
+  int written = _micro_tests_profile_write(&micro_tests);
+
+  char output[4096] = { 0 };
+  FILE *file = fopen(path, "r");
+  size_t length = (file != NULL) ? fread(output, 1, sizeof(output) - 1, file) : 0;
+  if (file != NULL)
+    fclose(file);
+  unlink(path);
+  ASSERT_EQ(status, MICRO_TESTS_OK);
+  ASSERT_EQ(written, 0);
+  ASSERT(length > 0);
+
+  // The stack of the test, from the test function to the busy loop
+  char *line = strstr(output, "profile_tests.busy;profile_tests_busy;spin_cpu ");
+  ASSERT(line != NULL);
+  unsigned long count = 0;
+  ASSERT_EQ(sscanf(strchr(line, ' '), " %lu", &count), 1);
+  ASSERT(count > 0);
+  TEST_SUCCESS;
+}
+
+TEST(bench_tests, fit_with_noise)
+{
+  size_t n[7];
+  double linear[7], quadratic[7], logarithmic[7];
+  // Up to 10% of noise, and a constant cost that dominates the
+  // smallest sizes
+  const double noise[7] = { 1.1, 0.9, 1.05, 0.92, 1.08, 0.95, 1.02 };
+  for (size_t i = 0; i < 7; ++i)
+  {
+    n[i] = (size_t)256 << i;
+    linear[i] = 500 + 2.0 * n[i] * noise[i];
+    quadratic[i] = 500 + 0.01 * n[i] * n[i] * noise[i];
+    logarithmic[i] = 50 + 3.0 * _micro_tests_log2(n[i]) * noise[i];
+  }
+
+  double intercept, coefficient, errors[_MICRO_TESTS_O_COUNT];
+  ASSERT_EQ(_micro_tests_bench_fit(n, linear, 7, &intercept, &coefficient,
+                                   errors), MICRO_TESTS_O_N);
+  ASSERT(coefficient > 1.5 && coefficient < 2.5);
+  ASSERT_EQ(_micro_tests_bench_fit(n, logarithmic, 7, &intercept,
+                                   &coefficient, errors), MICRO_TESTS_O_LOG_N);
+  ASSERT_EQ(_micro_tests_bench_fit(n, quadratic, 7, &intercept, &coefficient,
+                                   errors), MICRO_TESTS_O_N2);
+  // Clearly worse than the best fit
+  ASSERT(errors[MICRO_TESTS_O_N]
+         > errors[MICRO_TESTS_O_N2] * MICRO_TESTS_BENCH_FIT_MARGIN + 0.05);
+  TEST_SUCCESS;
+}
+
+TEST(bench_tests, aligned_allocs)
+{
+  _MicroTestsAllocs before = _micro_tests_allocs;
+  void *volatile blocks[2] = { NULL, NULL };
+  void *block = NULL;
+  ASSERT_EQ(posix_memalign(&block, 64, 100), 0);
+  blocks[0] = block;
+  blocks[1] = aligned_alloc(64, 128);
+  // Not a power of two, nothing is allocated
+  ASSERT_EQ(posix_memalign(&block, 48, 100), EINVAL);
+  ASSERT(blocks[0] != NULL && blocks[1] != NULL);
+  ASSERT_EQ((uintptr_t)blocks[0] % 64, 0);
+  free(blocks[0]);
+  free(blocks[1]);
+
+  ASSERT_EQ(_micro_tests_allocs.allocs - before.allocs, 2);
+  ASSERT_EQ(_micro_tests_allocs.bytes - before.bytes, 228);
+  ASSERT_EQ(_micro_tests_allocs.frees - before.frees, 2);
+  TEST_SUCCESS;
+}
+
+TEST(distributed_tests, message_round_trip)
+{
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  ASSERT_EQ(_micro_tests_message_send(fds[0], MICRO_TESTS_MESSAGE_BATCH,
+                                      "a.b\nc.d\n", 8), 0);
+  unsigned char *buffer = NULL;
+  size_t capacity = 0, length = 0;
+  int type = _micro_tests_message_recv(fds[1], &buffer, &capacity, &length);
+  close(fds[0]);
+  close(fds[1]);
+  ASSERT_EQ(type, MICRO_TESTS_MESSAGE_BATCH);
+  ASSERT_EQ(length, 8);
+  ASSERT_EQ(strcmp((char*)buffer + 1, "a.b\nc.d\n"), 0);
+  free(buffer);
+  TEST_SUCCESS;
+}
+
+TEST(batch_tests, first)
+{
+  TEST_SUCCESS;
+}
+
+// Crashes the batch that runs it when the orchestrator asks
+TEST(batch_tests, crashes_if_asked)
+{
+  if (getenv("BATCH_TESTS_CRASH") != NULL)
+    abort();
+  TEST_SUCCESS;
+}
+
+TEST(batch_tests, second)
+{
+  TEST_SUCCESS;
+}
+
+TEST(batch_tests, third)
+{
+  TEST_SUCCESS;
+}
+
+TEST(batch_tests, fourth)
+{
+  TEST_SUCCESS;
+}
+
+static int run_orchestrate(void *micro_tests)
+{
+  return _micro_tests_orchestrate(micro_tests);
+}
+
+// Orchestrate the batch_tests of this executable on one job, in a
+// single batch if they have durations, and read what was printed
+static int orchestrate_batch_tests(_Bool durations, char *buffer, size_t size)
+{
+  char path[] = "/tmp/micro-tests-durations-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0)
+    return -1;
+  FILE *file = fdopen(fd, "w");
+  const char *names[] = { "first", "crashes_if_asked", "second", "third", "fourth" };
+  for (size_t i = 0; durations && i < sizeof(names) / sizeof(names[0]); ++i)
+    fprintf(file, "batch_tests.%s 0.001\n", names[i]);
+  fclose(file);
+
+  char *argv[] = { "test", "--orchestrate", "/proc/self/exe", "--suite",
+                   "batch_tests", "--jobs", "1", "--debug", "--durations",
+                   path };
+  MicroTests micro_tests;
+  if (micro_tests_parse_args(&micro_tests, 10, argv) < 0)
+    return -1;
+  int failed = capture_output(run_orchestrate, &micro_tests, buffer, size);
+  MICRO_TESTS_FREE(micro_tests.executables);
+  unlink(path);
+  return failed;
+}
+
+TEST_SERIAL(orchestrator_tests, batches_without_durations)
+{
+  char output[4096];
+  ASSERT_EQ(orchestrate_batch_tests(0, output, sizeof(output)), 0);
+  // Split by number of tests into one batch per test, since five tests
+  // are fewer than MICRO_TESTS_ORCHESTRATOR_BATCHES_PER_JOB on one job
+  ASSERT(strstr(output, "debug: 5 tests of 1 executables in 5 batches") != NULL);
+  ASSERT(strstr(output, "test: fourth OK") != NULL);
+  TEST_SUCCESS;
+}
+
+TEST_SERIAL(orchestrator_tests, crashed_batch)
+{
+  char output[4096];
+  setenv("BATCH_TESTS_CRASH", "1", 1);
+  int failed = orchestrate_batch_tests(1, output, sizeof(output));
+  unsetenv("BATCH_TESTS_CRASH");
+  // Only the test that crashed the batch fails, the ones after it run
+  // again
+  ASSERT_EQ(failed, 1);
+  ASSERT(strstr(output, "in 1 batches") != NULL);
+  ASSERT(strstr(output, "was killed by signal") != NULL);
+  ASSERT(strstr(output, "test: crashes_if_asked FAILED") != NULL);
+  ASSERT(strstr(output, "3 tests of the batch are queued again") != NULL);
+  ASSERT(strstr(output, "test: first OK") != NULL);
+  ASSERT(strstr(output, "test: fourth OK") != NULL);
+  TEST_SUCCESS;
+}
+
+TEST_SERIAL(orchestrator_tests, other_children_and_tmpdir)
+{
+  // A child of the program is left for the program to wait
+  pid_t other = fork();
+  if (other == 0)
+    _exit(0);
+  ASSERT(other > 0);
+  char output[4096];
+  ASSERT_EQ(orchestrate_batch_tests(1, output, sizeof(output)), 0);
+  ASSERT_EQ(waitpid(other, NULL, 0), other);
+
+  // The files of the batches are in $TMPDIR
+  const char *tmpdir = getenv("TMPDIR");
+  char *saved = (tmpdir != NULL) ? strdup(tmpdir) : NULL;
+  setenv("TMPDIR", "/nonexistent/micro-tests", 1);
+  int failed = orchestrate_batch_tests(1, output, sizeof(output));
+  if (saved != NULL)
+    setenv("TMPDIR", saved, 1);
+  else
+    unsetenv("TMPDIR");
+  free(saved);
+  ASSERT_EQ(failed, 5);
+  ASSERT(strstr(output, "Could not write the batch") != NULL);
+  TEST_SUCCESS;
+}
+
+TEST(remote_tests, first)
+{
+  TEST_SUCCESS;
+}
+
+// Crashes the batch that runs it when the coordinator test asks
+TEST(remote_tests, crashes_if_asked)
+{
+  if (getenv("REMOTE_TESTS_CRASH") != NULL)
+    abort();
+  TEST_SUCCESS;
+}
+
+TEST(remote_tests, second)
+{
+  TEST_SUCCESS;
+}
+
+TEST_SERIAL(remote_tests, alone)
+{
+  TEST_SUCCESS;
+}
+
+// Kills the worker that runs it, and its batch, the first time, when
+// the coordinator test asks with the path of a file to create
+TEST(remote_tests, kills_worker_once)
+{
+  const char *path = getenv("REMOTE_TESTS_KILL");
+  if (path != NULL && access(path, F_OK) != 0)
+  {
+    int fd = open(path, O_CREAT | O_WRONLY, 0600);
+    if (fd >= 0)
+      close(fd);
+    kill(getppid(), SIGKILL);
+    kill(getpid(), SIGKILL);
+  }
+  TEST_SUCCESS;
+}
+
+typedef struct {
+  MicroTests *micro_tests;
+  const char *worker;
+} RemoteRun;
+
+// Start two workers of this executable and coordinate them
+static int run_coordinator(void *ctx)
+{
+  RemoteRun *run = ctx;
+  pid_t workers[2];
+  for (int w = 0; w < 2; ++w)
+  {
+    workers[w] = fork();
+    if (workers[w] == 0)
+    {
+      execl("/proc/self/exe", "test", "--worker", run->worker, "--no-banner",
+            "--quiet", (char*)NULL);
+      _exit(127);
+    }
+  }
+  int failed = _micro_tests_coordinate(run->micro_tests);
+  for (int w = 0; w < 2; ++w)
+    if (workers[w] > 0)
+      waitpid(workers[w], NULL, 0);
+  return failed;
+}
+
+// Coordinate the remote_tests of this executable with two workers on
+// loopback, in one batch and the one of the serial test, and read
+// what was printed. The broken test, if any, is planned as if it had
+// an unknown prerequisite
+static int coordinate_remote_tests(const char *broken, char *buffer,
+                                   size_t size)
+{
+  // A free port, the race with another process is unlikely
+  int probe = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in address = {
+    .sin_family = AF_INET,
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  socklen_t address_length = sizeof(address);
+  if (probe < 0
+      || bind(probe, (struct sockaddr*)&address, sizeof(address)) != 0
+      || getsockname(probe, (struct sockaddr*)&address, &address_length) != 0)
+    return -1;
+  close(probe);
+  char port[16], worker[32];
+  snprintf(port, sizeof(port), "%u", ntohs(address.sin_port));
+  snprintf(worker, sizeof(worker), "127.0.0.1:%s", port);
+
+  char *argv[] = { "test", "--coordinator", port, "--suite", "remote_tests" };
+  MicroTests micro_tests;
+  if (micro_tests_parse_args(&micro_tests, 5, argv) < 0
+      || _micro_tests_plan(&micro_tests) < 0)
+    return -1;
+  for (size_t k = 0; k < micro_tests.order_count; ++k)
+    micro_tests.durations[micro_tests.order[k]] = 1e-3;
+  if (broken != NULL)
+    micro_tests.test_state[_micro_tests_find_test(broken, strlen(broken), "")] =
+      MICRO_TESTS_SCHED_BROKEN;
+  RemoteRun run = { &micro_tests, worker };
+  int failed = capture_output(run_coordinator, &run, buffer, size);
+  _micro_tests_plan_free(&micro_tests);
+  return failed;
+}
+
+TEST_SERIAL(distributed_tests, crashed_batch)
+{
+  char output[8192];
+  setenv("REMOTE_TESTS_CRASH", "1", 1);
+  int failed = coordinate_remote_tests(NULL, output, sizeof(output));
+  unsetenv("REMOTE_TESTS_CRASH");
+  // Only the crashing test fails, the ones after it run again
+  ASSERT_EQ(failed, 1);
+  ASSERT(strstr(output, "remote_tests.crashes_if_asked ended the batch") != NULL);
+  ASSERT(strstr(output, "test: crashes_if_asked FAILED") != NULL);
+  ASSERT(strstr(output, "they are queued again") != NULL);
+  ASSERT(strstr(output, "test: second OK") != NULL);
+  ASSERT(strstr(output, "test: kills_worker_once OK") != NULL);
+  TEST_SUCCESS;
+}
+
+TEST_SERIAL(distributed_tests, broken_is_skipped)
+{
+  char output[8192];
+  int failed = coordinate_remote_tests("remote_tests.second", output,
+                                       sizeof(output));
+  ASSERT_EQ(failed, 0);
+  ASSERT(strstr(output, "test: second SKIPPED") != NULL);
+  ASSERT(strstr(output, "test: first OK") != NULL);
+  TEST_SUCCESS;
+}
+
+TEST_SERIAL(distributed_tests, lost_worker)
+{
+  char path[] = "/tmp/micro-tests-kill-XXXXXX";
+  ASSERT(mkdtemp(path) != NULL);
+  char flag[sizeof(path) + 8];
+  snprintf(flag, sizeof(flag), "%s/killed", path);
+  setenv("REMOTE_TESTS_KILL", flag, 1);
+  char output[8192];
+  int failed = coordinate_remote_tests(NULL, output, sizeof(output));
+  unsetenv("REMOTE_TESTS_KILL");
+  int killed = access(flag, F_OK) == 0;
+  unlink(flag);
+  rmdir(path);
+
+  // The tests that the lost worker did not report run on the other one
+  ASSERT(killed);
+  ASSERT_EQ(failed, 0);
+  ASSERT(strstr(output, "Lost a worker, its batch is queued again") != NULL);
+  ASSERT(strstr(output, "test: kills_worker_once OK") != NULL);
+  TEST_SUCCESS;
+}
+
+TEST(selection_tests, test_file)
+{
+  char path[] = "/tmp/micro-tests-list-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT(fd >= 0);
+  const char list[] = "base_tests.simple_assertion\nbase_tests2.simple_assert_not_eq\n";
+  ASSERT_EQ(write(fd, list, sizeof(list) - 1), (ssize_t)sizeof(list) - 1);
+  close(fd);
+
+  char *argv[] = { "test", "--test-file", path };
+  MicroTests micro_tests;
+  ASSERT_EQ(micro_tests_parse_args(&micro_tests, 3, argv), 0);
+  int selected = _micro_tests_select_from_file(&micro_tests);
+  unlink(path);
+  ASSERT_EQ(selected, 0);
+  ASSERT_EQ(_micro_tests_plan(&micro_tests), 0);
+  size_t order_count = micro_tests.order_count;
+  const char *name = _micro_tests_tests()[micro_tests.order[0]].test_suite;
+  _micro_tests_plan_free(&micro_tests);
+  MICRO_TESTS_FREE(micro_tests.selection);
+  ASSERT_EQ(order_count, 2);
+  ASSERT(strncmp(name, "base_tests", 10) == 0);
+  TEST_SUCCESS;
+}
+
+TEST(cache_tests, key_of_the_arguments)
+{
+  char *suite_a[] = { "test", "--suite", "a" };
+  char *suite_b[] = { "test", "--suite", "b" };
+  char *cached_a[] = { "test", "--cache", "dir", "--suite", "a", "--no-cache" };
+  uint64_t key_a, key_b, key_cached_a;
+  ASSERT_EQ(_micro_tests_cache_key(3, suite_a, &key_a), 0);
+  ASSERT_EQ(_micro_tests_cache_key(3, suite_b, &key_b), 0);
+  ASSERT_EQ(_micro_tests_cache_key(6, cached_a, &key_cached_a), 0);
+  ASSERT_NOT_EQ(key_a, key_b);
+  ASSERT_EQ(key_a, key_cached_a);
+  TEST_SUCCESS;
+}
+
+// Report a passing, a failing and a skipped test with markup in their
+// file name
+static int run_fake_reporter(void *reporter_ctx)
+{
+  const MicroTestsReporter *reporter = reporter_ctx;
+  MicroTests micro_tests = { 0 };
+  MicroTest test = {
+    .test_suite  = "suite",
+    .test_name   = "name",
+    .file_name   = "dir \"a\\b\" & <c>.c",
+    .line_number = 7,
+  };
+  reporter->on_run_start(&micro_tests, 3);
+  reporter->on_test_end(&micro_tests, &test, MICRO_TESTS_OK);
+  reporter->on_test_end(&micro_tests, &test, MICRO_TESTS_FAILED);
+  reporter->on_test_end(&micro_tests, &test, MICRO_TESTS_SKIPPED);
+  reporter->on_run_end(&micro_tests, 1);
+  return 0;
+}
+
+// Run the fake run above with a reporter, and read what it printed
+static void report_fake_run(const char *name, char *buffer, size_t size)
+{
+  capture_output(run_fake_reporter, (void*)micro_tests_find_reporter(name),
+                 buffer, size);
+}
+
+TEST_SERIAL(reporter_tests, junit_escapes_and_counts)
+{
+  char output[2048];
+  report_fake_run("junit", output, sizeof(output));
+  ASSERT(strstr(output, "file=\"dir &quot;a\\b&quot; &amp; &lt;c&gt;.c\"")
+         != NULL);
+  ASSERT(strstr(output, "<testsuite name=\"micro-tests\" tests=\"3\" "
+                "failures=\"1\" skipped=\"1\">") != NULL);
+  ASSERT(strstr(output, "</testsuites>\n") != NULL);
+  TEST_SUCCESS;
+}
+
+TEST_SERIAL(reporter_tests, json_escapes)
+{
+  char output[2048];
+  report_fake_run("json", output, sizeof(output));
+  ASSERT(strstr(output, "\"file\":\"dir \\\"a\\\\b\\\" & <c>.c\"") != NULL);
+  ASSERT(strstr(output, "],\"failed\":1}\n") != NULL);
+  TEST_SUCCESS;
+}
+
+static int print_captured(void *ctx)
+{
+  (void) ctx;
+  printf("captured\n");
+  fprintf(stderr, "on stderr\n");
+  return 0;
+}
+
+TEST_SERIAL(capture_tests, redirect_stdout)
+{
+  char buffer[32];
+  ASSERT_EQ(capture_output(print_captured, NULL, buffer, sizeof(buffer)), 0);
+  ASSERT_EQ(strlen(buffer), 19);
+  ASSERT(strstr(buffer, "captured\n") != NULL);
+  ASSERT(strstr(buffer, "on stderr\n") != NULL);
+  TEST_SUCCESS;
+}
+
+static volatile int capture_requested = 0;
+
+TEST(capture_tests, prints_and_passes)
+{
+  if (capture_requested)
+    printf("output of a passing test\n");
+  TEST_SUCCESS;
+}
+
+TEST(capture_tests, prints_and_fails)
+{
+  if (capture_requested)
+    printf("output of a failing test\n");
+  ASSERT(!capture_requested);
+  TEST_SUCCESS;
+}
+
+// Run the two tests above like the runner
+static int run_capturing_tests(void *micro_tests_ctx)
+{
+  MicroTests *micro_tests = micro_tests_ctx;
+  const char *names[] = { "capture_tests.prints_and_passes",
+                          "capture_tests.prints_and_fails" };
+  capture_requested = 1;
+  for (size_t i = 0; i < 2; ++i)
+  {
+    MicroTest *test = &_micro_tests_tests()[
+      _micro_tests_find_test(names[i], strlen(names[i]), "")];
+    MicroTestsStatus status = _micro_tests_exec(micro_tests, test);
+    micro_tests->reporter->on_test_end(micro_tests, test, status);
+    _micro_tests_capture_emit(status);
+  }
+  capture_requested = 0;
+  return 0;
+}
+
+// Run the two tests above in this process or isolated, and read what
+// they printed
+static void capture_fake_run(_Bool isolated, char *buffer, size_t size)
+{
+  char *argv[] = { "test", "--capture" };
+  MicroTests micro_tests;
+  micro_tests_parse_args(&micro_tests, 2, argv);
+  micro_tests.run_isolated = isolated;
+  if (isolated)
+    _micro_tests_board_open(&micro_tests);
+
+  // The capture of the calling test is put aside
+  int outer = _micro_tests_capture_fd;
+  _micro_tests_capture_fd = -1;
+  capture_output(run_capturing_tests, &micro_tests, buffer, size);
+  _micro_tests_capture_fd = outer;
+  if (isolated)
+    _micro_tests_board_close(&micro_tests);
+}
+
+TEST_SERIAL(capture_tests, output_of_failures)
+{
+  char output[1024];
+  for (int isolated = 0; isolated <= 1; ++isolated)
+  {
+    capture_fake_run(isolated, output, sizeof(output));
+    ASSERT(strstr(output, "output of a passing test") == NULL);
+    char *failed = strstr(output, "test: prints_and_fails FAILED\n");
+    ASSERT(failed != NULL);
+    ASSERT(strstr(failed, "output of a failing test\n") != NULL);
+  }
+  TEST_SUCCESS;
+}
+
 #if 0
 TEST(base_tests2, assert_should_fail)
 {